@@ -3,18 +3,19 @@
 #include <sys/types.h>
 #include <cstdint>
 
+#include "./inferiormemory.h"
 
 class Breakpoint {
-    pid_t pid_ = 0;
+    InferiorMemory* mem_ = nullptr;
     std::intptr_t addr_ = 0;
     bool enabled_ = 0;
     std::uint8_t data_ = 0;
-    
-    static constexpr std::uint8_t mask_ = 0xFF;
 
 public:
+    static constexpr std::uint8_t int3 = 0xCC;
+
     Breakpoint() = default;
-    Breakpoint(pid_t pid, std::intptr_t addr);
+    Breakpoint(InferiorMemory* mem, std::intptr_t addr);
     
     Breakpoint(Breakpoint&&) = default;
     Breakpoint& operator=(Breakpoint&&) = default;
@@ -26,6 +27,8 @@ public:
     bool isEnabled() const;
     std::uint8_t getData() const;
     std::intptr_t getAddr() const;
+    void setData(std::uint8_t data);     //replaces the saved byte restored by disable()
+    void setEnabled(bool enabled);       //records a state patched in by someone else (ex: PatchBatch)
 
     bool enable();
     bool disable();
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <cstdint>
+#include <sys/user.h>
+
+#include "./inferiormemory.h"
+
+
+/*
+    Breakpoint condition, compiled once into bytecode for a small stack machine so a hit only costs a walk
+    over a few bytes. Expressions use C operators and precedence over 64-bit unsigned values:
+
+        registers       rax, rdi, rip, ... (user_regs_struct names, an optional $ prefix)
+        constants       decimal or 0x prefixed hex
+        *expr           8 byte load from the child, mask for narrower values: (*rdi & 0xFF) == 0x2A
+        unary           - ~ !
+        binary          * / %  + -  << >>  < <= > >=  == !=  &  ^  |  &&  ||
+
+    && and || short-circuit, so rdi != 0 && *rdi == 1 never dereferences null. Registers are read from the
+    register set already fetched for the stop, and loads go through the stop's memory cache.
+*/
+class Condition {
+
+public:
+    static std::optional<Condition> compile(std::string_view source, std::string& error);
+
+    Condition(Condition&&) = default;
+    Condition& operator=(Condition&&) = default;
+    ~Condition() = default;
+
+    Condition(const Condition&) = delete;
+    Condition& operator=(const Condition&) = delete;
+
+    //nullopt if a load failed or a division by zero
+    std::optional<uint64_t> evaluate(const user_regs_struct& regs, const InferiorMemory& mem) const;
+    const std::string& getSource() const;
+    size_t getCodeSize() const;
+
+    static inline constexpr size_t maxDepth = 16;       //evaluation stack size
+    static inline constexpr size_t maxNesting = 64;     //parentheses and unary operators, bounds the compiler's recursion
+
+private:
+    std::string source_;
+    std::vector<uint8_t> code_;
+
+    Condition() = default;
+    friend class ConditionCompiler;
+};
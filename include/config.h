@@ -27,7 +27,12 @@ public:
 
     struct DebugConfig {
         bool verbose_ = true;
+        bool timings_ = false;      //--verbose, prints the startup timing breakdown
         uint8_t context_ = 3;
+        unsigned jobs_ = 0;         //--jobs, indexing threads including the main one, 0 = one per core
+        bool indexCache_ = true;    //--no-cache disables reading and writing the on-disk index cache
+        bool lazy_ = false;         //--lazy, read units only when a query needs them
+        uint32_t unitCacheSize_ = 64;   //units kept read in lazy mode
         DebugConfig();
     };
 
@@ -38,6 +43,7 @@ public:
     */
     struct SymbolConfig {
     // size_t symbolListSize_;
+        bool cacheEnabled_ = false;     //substring queries are indexed, the query cache is optional
         size_t symbolCacheSize_ = 7;
         // bool strictSymbolMatch_ = false;
         uint8_t minCachedStringLength_ = 3; 
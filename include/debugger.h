@@ -5,6 +5,7 @@
 #include <vector>
 #include <utility>
 #include <optional>
+#include <array>
 #include <sys/types.h>
 #include <signal.h>
 
@@ -12,8 +13,22 @@
 #include <elf/elf++.hh>
 
 #include "./breakpoint.h"
+#include "./patchbatch.h"
 #include "./memorymap.h"
+#include "./inferiormemory.h"
+#include "./register.h"
 #include "./symbolmap.h"
+#include "./lineindex.h"
+#include "./functionindex.h"
+#include "./threadpool.h"
+#include "./indexloader.h"
+#include "./unwinder.h"
+#include "./instruction.h"
+#include "./debugregisters.h"
+#include "./pagewatchpoints.h"
+#include "./condition.h"
+#include "./tracepoint.h"
+#include "./tracelog.h"
 #include "./state.h"
 #include "./config.h"
 
@@ -28,48 +43,159 @@ class Debugger {
     Config::DebugConfig* config_;
     //uint8_t context_;
     Breakpoint* retAddrFromMain_;
+    static inline constexpr size_t maxMemoryDumpLength_ = 0x100000;    //1 MiB cap on read_memory ranges
+    static inline constexpr size_t maxMemoryWriteLength_ = 0x1000000;  //16 MiB cap on write_memory sources
 
     dwarf::dwarf dwarf_;
     elf::elf elf_;
+    ThreadPool pool_;
+    std::vector<std::pair<std::string, double>> startupTimes_;     //phase, seconds (main thread)
+    bool startupTimesShown_ = false;
+    bool dwarfLoaded_ = false;          //loadDwarfSections() ran
     MemoryMap memMap_;
-    SymbolMap symMap_;
-
+    InferiorMemory mem_;
+    mutable reg::RegisterCache regs_;
+    IndexLoader indexes_;       //line, function and symbol indexes, built in the background
+    Unwinder unwinder_;
+    DebugRegisters debugRegs_;  //hardware breakpoints and watchpoints
+    PageWatchpoints pageWatch_; //software watchpoints over write protected pages
+    bool watchFalseHit_ = false;        //last stop was a write to a watched page outside every range
+    uint64_t watchHits_ = 0;
+    uint64_t watchFalseHits_ = 0;       //stops resumed because of it
+
+
+    /*
+        Frame predicate of an internal breakpoint set by finish or next. A hit only counts when the stopped
+        frame is the one the command started in or one of its callers, hits in deeper frames (ex: the same
+        function recursing) are resumed by continueExecution() without returning to the prompt. Both kinds
+        compare against the CFA of the starting frame, which is the stack pointer right after it returns.
+    */
+    struct FramePredicate {
+        enum Kind : uint8_t {
+            stackPointer,       //return address, rsp must be >= value (the frame has returned)
+            frameAddress        //line of the current function, the stopped frame's CFA must be >= value
+        };
+        Kind kind;
+        uint64_t value;
+    };
 
     std::unordered_map<std::intptr_t, Breakpoint> addrToBp_;
-    std::unordered_map<const dwarf::compilation_unit*, std::vector<dwarf::section_offset>> functionDies_;
+    std::unordered_map<std::intptr_t, FramePredicate> framePredicates_;    //internal breakpoints only
+    bool frameMismatch_ = false;        //last stop was a breakpoint whose frame predicate failed
+    uint64_t frameMismatches_ = 0;      //hits resumed because of it
+
+    std::unordered_map<std::intptr_t, Condition> conditions_;     //user breakpoints with "if <expr>"
+    bool conditionMiss_ = false;        //last stop was a breakpoint whose condition was false
+    uint64_t conditionHits_ = 0;
+    uint64_t conditionMisses_ = 0;      //hits resumed because of it
+
+    std::unordered_map<std::intptr_t, Tracepoint> tracepoints_;   //user breakpoints that log and resume
+    TraceLog traceLog_;
+    bool traceHit_ = false;             //last stop was a tracepoint, already logged
+
+    /*
+        Stop addresses of a function for step over, computed once per function. The plan last used stays
+        resident: its breakpoints remain patched in between consecutive nexts, guarded by frame predicates, so
+        a next only lifts the current line's stops and sets the return address. Any command other than next
+        or a read-only one retires it.
+    */
+    struct StepPlan {
+        struct Stop {
+            std::intptr_t addr;         //load address
+            unsigned line;
+        };
+        std::vector<Stop> stops;
+    };
+
+    std::unordered_map<uint64_t, StepPlan> stepPlans_;                //function entry --> plan
+    std::optional<uint64_t> residentPlan_;                            //entry of the patched in plan
+    std::unordered_map<std::intptr_t, bool> residentStops_;           //address --> inserted (false: borrowed)
+
+    /*
+        Displaced stepping: resuming from an enabled breakpoint runs a copy of the original instruction in a
+        scratch page mapped into the child (one 16 byte slot per breakpoint, reused round robin), so the
+        int3 never leaves memory. RIP-relative operands are rebased onto the slot, and afterwards RIP (plus the
+        return address of a call) is mapped back. Instructions the decoder rejects, or that would be out of
+        rel32 reach of the page, are stepped in place by disabling the breakpoint instead.
+    */
+    struct ScratchSlot {
+        std::intptr_t owner = 0;                        //breakpoint address, 0 if free
+        uint8_t length = 0;
+        std::array<uint8_t, x86::maxLength> code{};     //original instruction bytes, before rebasing
+    };
+
+    static inline constexpr size_t scratchSize_ = 0x1000;
+    static inline constexpr size_t scratchSlotSize_ = 16;
+    std::optional<uint64_t> scratch_;                   //scratch page in the child, mapped on first use
+    bool scratchFailed_ = false;
+    std::vector<ScratchSlot> scratchSlots_;
+    std::unordered_map<std::intptr_t, size_t> slotOf_;  //breakpoint address --> slot
+    size_t nextSlot_ = 0;
+    uint64_t displacedSteps_ = 0;
+    uint64_t inPlaceSteps_ = 0;
 
 
     void initialize();
+    void loadDwarfSections();
+    void dumpStartupTimes();
+    std::optional<uint64_t> findMainSymbol() const;
+    std::optional<uint64_t> findMainEntry(uint64_t mainAddr);
     bool handleCommand(const std::string& args, std::string& prevArgs);   //bool used for spacing
     void handleChildState();
     void cleanup();
     
     std::pair<std::unordered_map<intptr_t, Breakpoint>::iterator, bool> 
-        setBreakpointAtAddress(std::intptr_t address/*, bool skipLineTableCheck = false*/);
+        setBreakpointAtAddress(std::intptr_t address, PatchBatch* batch = nullptr);
     std::pair<std::unordered_map<intptr_t, Breakpoint>::iterator, bool> 
         setBreakpointAtFunctionName(const std::string_view name);
-    std::pair<std::unordered_map<intptr_t, Breakpoint>::iterator, bool> 
+    std::vector<std::pair<std::unordered_map<intptr_t, Breakpoint>::iterator, bool>> 
         setBreakpointAtSourceLine(const std::string_view file, const unsigned line);   
     void removeBreakpoint(std::unordered_map<intptr_t, Breakpoint>::iterator it);
     void removeBreakpoint(std::intptr_t address);
     void dumpBreakpoints() const;
-
+    std::optional<size_t> setHardwareBreakpoint(uint64_t addr, DebugRegisters::Kind kind, uint8_t length = 1);
+    bool removeHardwareBreakpoint(size_t slot);
+    void dumpHardwareBreakpoints() const;
+    void reportHardwareHits();
+    std::optional<uint64_t> setPageWatchpoint(uint64_t addr, uint64_t length);
+    bool removePageWatchpoint(uint64_t id);
+    void dumpPageWatchpoints() const;
+    bool protectPages(const std::vector<PageWatchpoints::Run>& runs, bool watched);
+    bool handlePageWatchFault(uint64_t addr);
+
+    bool prepareToResume(bool singleStepping = false);
+    bool stepMayChangeAddressSpace() const;
     void continueExecution();
-    void singleStep();
-    void singleStepBreakpointCheck();
-    bool validMemoryRegionShouldStep(std::optional<dwarf::line_table::iterator> itr, bool shouldStep);
+    bool singleStep();
+    bool singleStepBreakpointCheck();
+    bool validMemoryRegionShouldStep(std::optional<LineIndex::iterator> itr, bool shouldStep);
     bool readStackSnapshot(std::vector<std::pair<uint64_t, bool>>& stack, size_t bytes = 64);
     bool writeStackSnapshot(std::vector<std::pair<uint64_t, bool>>& stack, size_t bytes = 64);
     void stepIn();
     void stepOut();
     void stepOver();
-    void stepOverBreakpoint();
+    bool stepOverBreakpoint();
+    bool displacedStep(uint64_t pc);
+    std::optional<uint64_t> getScratchArea();
+    void unmapScratchArea();
+    const StepPlan& getStepPlan(FunctionIndex::FunctionRef func, uint64_t pc);
+    void armStepPlan(uint64_t entry, const StepPlan& plan);
+    void retireStepPlan();
+    bool framePredicateHolds(uint64_t pc);
+    bool conditionHolds(uint64_t pc);
+    bool traceHit(uint64_t pc);
+    void dumpTracepoints() const;
     void skipUnsafeInstruction(const size_t bytes = 8);
     void jumpToInstruction(const uint64_t newRip);
     void printBacktrace();
+    void runBenchmark(const std::string& name, uint64_t iterations);
+    void dumpStats() const;
+    void resetStats();
 
     void waitForSignal();
     void handleSIGTRAP(siginfo_t signal);
+    void checkMainReturn();
+    std::optional<uint64_t> injectSyscall(uint64_t number, const std::array<uint64_t, 6>& args);
     siginfo_t getSignalInfo() const;
 
 
@@ -85,19 +211,25 @@ class Debugger {
     
 
     void readMemory(const uint64_t addr, uint64_t &data) const;
+    size_t readMemoryBlock(const uint64_t addr, uint8_t* buffer, const size_t len) const;
     void writeMemory(const uint64_t addr, const uint64_t &data);
+    size_t writeMemoryBlock(const uint64_t addr, const uint8_t* buffer, const size_t len);
+    std::optional<bool> canWrite(uint64_t addr) const;     //as the program sees it, nullopt if unmapped
     void dumpRegisters() const;
+    void dumpMemory(const uint64_t addr, const std::vector<uint8_t>& bytes, const char format = 'x') const;
 
-    void initializeFunctionDies();
-    void dumpFunctionDies();
+    void initializeFunctionIndex();
+    void dumpFunctions();
 
     std::optional<intptr_t> handleDuplicateFunctionNames(const std::string_view, 
-        const std::vector<dwarf::die>& functions);
-    std::optional<intptr_t> handleDuplicateFilenames(const std::string_view filepath, 
-        const std::vector<std::pair<std::string, intptr_t>>& fpAndAddr);
+        const FunctionIndex& functionIndex, const std::vector<FunctionIndex::FunctionRef>& functions);
+    std::optional<size_t> handleDuplicateFilenames(const std::string_view filepath, const LineIndex& lineIndex,
+        const std::vector<std::pair<uint32_t, std::vector<uint64_t>>>& fileAndAddrs);
 
-    std::optional<dwarf::die> getFunctionFromPCOffset(uint64_t pc) const;
-    std::optional<dwarf::line_table::iterator> getLineEntryFromPC(uint64_t pc) const;
+    std::optional<FunctionIndex::FunctionRef> getFunctionFromPCOffset(uint64_t pc);
+    std::optional<LineIndex::iterator> getLineEntryFromPC(uint64_t pc);
+    std::optional<uint64_t> getReturnAddress();
+    std::optional<Unwinder::Frame> getCallerFrame();
 
     void printSource(const std::string fileName, const unsigned line, const uint8_t numOfContextLines) const;
     void printSourceAtPC(); //can terminate debugger
@@ -105,7 +237,7 @@ class Debugger {
 
 
 public:
-    Debugger(pid_t pid, std::string progName);
+    Debugger(pid_t pid, std::string progName, Config config = Config());
     void run();
     
 };
\ No newline at end of file
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
+
+
+/*
+    Allocator over the four x86 debug address registers (DR0-DR3) of the child, which DR7 enables and
+    configures. Each slot is an execute breakpoint or a write / read-write watchpoint of 1, 2, 4 or 8
+    naturally aligned bytes. The registers are written with PTRACE_POKEUSER into user::u_debugreg, the
+    address first and DR7 last, so the kernel never sees an enabled slot with a stale address. A copy of
+    DR7 is kept, so setting or clearing a slot costs two POKEUSERs and checking for hits costs nothing
+    while no slot is in use.
+
+    The CPU reports hits in DR6 (bits 0-3, one per slot). takeHits() reads and clears it. Execute
+    breakpoints trap before the instruction runs, and the kernel sets RF so resuming does not hit it again.
+    Watchpoints trap right after the accessing instruction.
+*/
+class DebugRegisters {
+
+public:
+    static inline constexpr size_t slotCount = 4;
+
+    enum class Kind : uint8_t {
+        execute = 0b00,
+        write = 0b01,
+        readWrite = 0b11
+    };
+
+    struct Slot {
+        bool used = false;
+        uint64_t addr = 0;
+        Kind kind = Kind::execute;
+        uint8_t length = 1;
+    };
+
+    DebugRegisters() = default;
+    explicit DebugRegisters(pid_t pid);
+
+    DebugRegisters(DebugRegisters&&) = default;
+    DebugRegisters& operator=(DebugRegisters&&) = default;
+    ~DebugRegisters() = default;
+
+    DebugRegisters(const DebugRegisters&) = delete;
+    DebugRegisters& operator=(const DebugRegisters&) = delete;
+
+    static bool validLength(uint8_t length);
+    std::optional<size_t> set(uint64_t addr, Kind kind, uint8_t length = 1);   //slot, nullopt if none free
+    bool clear(size_t slot);
+    void clearAll();
+    std::optional<size_t> find(uint64_t addr, Kind kind) const;
+
+    bool active() const;                    //any slot in use
+    uint8_t takeHits();                     //DR6 bits 0-3 of the last stop, DR6 is cleared
+    const std::array<Slot, slotCount>& getSlots() const;
+    static const char* getKindName(Kind kind);
+
+private:
+    pid_t pid_ = 0;
+    std::array<Slot, slotCount> slots_{};
+    uint64_t dr7_ = 0;
+
+    bool poke(size_t reg, uint64_t value);
+    std::optional<uint64_t> peek(size_t reg) const;
+};
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <optional>
+#include <functional>
+#include <span>
+#include <cstdint>
+#include <cstddef>
+
+#include <dwarf/dwarf++.hh>
+
+#include "./lineindex.h"
+#include "./threadpool.h"
+#include "./indexcache.h"
+
+
+/*
+    Address --> function index over every user-defined function in the DWARF info. Each function is a
+    compact record (name, owning unit, entry and prologue-end address) instead of a dwarf::die copy, and
+    every [low, high) fragment of its code (DW_AT_ranges included) is stored in one address-sorted table
+    of non-overlapping intervals. A lookup is a single binary search over that table instead of a walk of
+    every DIE in every unit.
+
+    Functions are also hashed by name. Every function is reachable through its DWARF name, its linkage
+    name, its demangled name and every "::" suffix of its qualified name, so "method", "Class::method" and
+    "ns::Class::method" all resolve to the same record. Overloads share a key and come back together.
+
+    Each unit is walked and demangled on its own (readUnit()), so units are read in parallel and the
+    per-unit tables are appended in unit order. Only the name hash and the interval table are built on one
+    thread. An index can also be merged from only some units, ex: to answer a query early.
+*/
+class FunctionIndex {
+
+public:
+    struct Name {
+        uint32_t offset = 0;        //offset into the name arena
+        uint32_t length = 0;
+    };
+
+    struct Range {
+        uint64_t low;
+        uint64_t high;
+    };
+
+    struct Function {
+        Name name;                  //DW_AT_name, ex: method
+        Name qualifiedName;         //enclosing namespaces and classes, ex: ns::Class::method
+        Name linkageName;           //mangled name, empty for C functions
+        Name displayName;           //readable demangled name with parameters, qualifiedName if not mangled
+        uint32_t unit;              //index into dwarf::compilation_units()
+        uint32_t rangeBegin;        //fragments in getRanges()
+        uint32_t rangeCount;
+        uint64_t entry;             //DW_AT_low_pc, or the first listed range for DW_AT_ranges functions
+        uint64_t prologueEnd;       //first address past the prologue, entry if it can't be determined
+        uint64_t low;               //bounds over all fragments
+        uint64_t high;
+    };
+
+    using FunctionRef = std::reference_wrapper<const Function>;
+
+    //Declaration in another unit (DW_FORM_ref_addr) whose scope is only known once every unit is read
+    struct PendingScope {
+        uint32_t function;                  //index into UnitFunctions::functions
+        dwarf::section_offset declaration;
+    };
+
+    //Functions of a single unit, names and ranges are local to the unit until it is merged
+    struct UnitFunctions {
+        dwarf::section_offset offset = 0;   //unit offset in .debug_info
+        std::string unitName;
+        std::vector<Function> functions;
+        std::vector<Range> ranges;
+        std::string names;
+        std::unordered_map<dwarf::section_offset, std::string> declScopes;     //declaration --> "ns::Class::"
+        std::vector<PendingScope> pendingScopes;
+    };
+
+    FunctionIndex() = default;
+    FunctionIndex(const dwarf::dwarf& dwarf, const LineIndex& lines, ThreadPool& pool);
+    explicit FunctionIndex(std::vector<UnitFunctions> units);
+
+    //rows: line rows covering the unit's code sorted by address, for prologue ends. Safe from any thread.
+    static UnitFunctions readUnit(const dwarf::compilation_unit& cu, std::span<const LineIndex::Entry> rows);
+
+    void save(IndexCache::Writer& writer) const;
+    static std::optional<FunctionIndex> load(IndexCache::Reader& reader);  //nullopt if the data is inconsistent
+
+    FunctionIndex(FunctionIndex&&) = default;
+    FunctionIndex& operator=(FunctionIndex&&) = default;
+    ~FunctionIndex() = default;
+
+    FunctionIndex(const FunctionIndex&) = delete;
+    FunctionIndex& operator=(const FunctionIndex&) = delete;
+
+    std::optional<FunctionRef> find(uint64_t pc) const;     //function whose code covers pc
+    bool contains(const Function& func, uint64_t pc) const;
+    std::vector<FunctionRef> findByName(std::string_view name) const;  //every overload matching name
+
+    std::string_view getName(const Function& func) const;
+    std::string_view getQualifiedName(const Function& func) const;
+    std::string_view getLinkageName(const Function& func) const;
+    std::string_view getDisplayName(const Function& func) const;
+    std::string_view getUnitName(uint32_t unit) const;
+    std::span<const Range> getRanges(const Function& func) const;
+    const std::vector<Function>& getFunctions() const;
+    size_t size() const;
+    bool initialized() const;
+
+private:
+    struct Interval {
+        uint64_t low;
+        uint64_t high;
+        uint32_t function;
+    };
+
+    std::vector<Function> functions_;
+    std::vector<Range> ranges_;
+    std::vector<Interval> intervals_;
+    std::vector<Name> unitNames_;
+    std::string names_;
+    std::unordered_map<std::string, std::vector<uint32_t>> byName_;
+
+    static Name intern(std::string& arena, std::string_view name);
+    std::string_view getString(Name name) const;
+    bool validName(Name name) const;
+    void indexNames();
+    void addName(std::string_view name, uint32_t function);
+    void addQualifiedNames(std::string_view qualified, uint32_t function);
+    static std::vector<UnitFunctions> readUnits(const dwarf::dwarf& dwarf, const LineIndex& lines, 
+        ThreadPool& pool);
+    static uint64_t findPrologueEnd(std::span<const LineIndex::Entry> rows, uint64_t entry, uint64_t high);
+};
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <filesystem>
+#include <type_traits>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+#include <elf/elf++.hh>
+
+#include "./config.h"
+
+class LineIndex;
+class FunctionIndex;
+class SymbolMap;
+
+
+/*
+    On-disk copy of the line, function and symbol indexes so a binary that was already debugged starts
+    without reading any DWARF or demangling anything. One file per binary lives under
+    $XDG_CACHE_HOME/peek (~/.cache/peek if unset), named after the binary's GNU build-id, or after a hash
+    of its path, mtime and size when it has none. The full key is stored in the file as well.
+
+    The file is a header (magic, format version, key, payload size and checksum) followed by every index
+    written as flat arrays of their POD records and string arenas. Records without padding are copied
+    as is, the ones with padding or bools are packed field by field, so no uninitialized byte ends up in
+    the file and a bool is only ever read back from a 0 or 1 byte. Each array carries its element size,
+    so a record layout change is caught even if the version was not bumped. Loading maps the file, checks
+    the header and checksum, copies the arrays out and rebuilds only the hash maps. Every index also checks
+    its own ids and offsets, anything that does not add up makes the load fail and the caller rebuilds.
+    Files are written to a temporary name and renamed, so a reader never sees a partial file.
+*/
+class IndexCache {
+
+public:
+    static constexpr uint32_t version = 2;
+
+    struct Key {
+        std::string id;                     //"build-id:<hex>" or "file:<path>:<mtime ns>:<size>"
+        std::filesystem::path file;
+    };
+
+    //Appends arrays and strings to a buffer, every item is padded to 8 bytes
+    class Writer {
+    public:
+        template<typename T>
+        void writeValue(const T& value) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            append(&value, sizeof(T));
+        }
+
+        template<typename T>
+        void writeArray(const std::vector<T>& values) {
+            static_assert(std::has_unique_object_representations_v<T>, "use writeRecords()");
+            writeValue<uint64_t>(values.size());
+            writeValue<uint64_t>(sizeof(T));
+            append(values.data(), values.size() * sizeof(T));
+        }
+
+        //Packs the listed fields of every record back to back, the element size is the sum of theirs
+        template<typename T, typename... Fields>
+        void writeRecords(const std::vector<T>& values, Fields T::*... fields) {
+            static_assert((std::is_trivially_copyable_v<Fields> && ...));
+            constexpr size_t recordSize = (sizeof(Fields) + ...);
+            writeValue<uint64_t>(values.size());
+            writeValue<uint64_t>(recordSize);
+            char* out = extend(values.size() * recordSize);
+            for(const auto& value : values) {
+                ((std::memcpy(out, &(value.*fields), sizeof(Fields)), out += sizeof(Fields)), ...);
+            }
+        }
+
+        void writeString(std::string_view str);
+        const std::string& getBuffer() const;
+
+    private:
+        std::string buffer_;
+        void append(const void* data, size_t length);
+        char* extend(size_t length);        //zero filled, padded like append()
+    };
+
+    //Reads back what a Writer wrote, every read is bounds checked and a failed read fails all later ones
+    class Reader {
+    public:
+        Reader(const char* data, size_t size);
+
+        template<typename T>
+        bool readValue(T& value) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            return take(&value, sizeof(T));
+        }
+
+        template<typename T>
+        bool readArray(std::vector<T>& values) {
+            static_assert(std::has_unique_object_representations_v<T>, "use readRecords()");
+            uint64_t count = 0, size = 0;
+            if(!readValue(count) || !readValue(size) || size != sizeof(T) || count > remaining() / sizeof(T)) {
+                return fail();
+            }
+            values.resize(count);
+            return take(values.data(), count * sizeof(T));
+        }
+
+        //Reads what writeRecords() wrote with the same field list, a bool byte other than 0 or 1 fails
+        template<typename T, typename... Fields>
+        bool readRecords(std::vector<T>& values, Fields T::*... fields) {
+            constexpr size_t recordSize = (sizeof(Fields) + ...);
+            uint64_t count = 0, size = 0;
+            if(!readValue(count) || !readValue(size) || size != recordSize || count > remaining() / recordSize) {
+                return fail();
+            }
+            const char* in = skip(count * recordSize);
+            if(!in) return false;
+            values.resize(count);
+            for(auto& value : values) {
+                if(!(readField(in, value.*fields) && ...)) return fail();
+            }
+            return true;
+        }
+
+        bool readString(std::string& str);
+        bool atEnd() const;
+
+    private:
+        const char* data_;
+        size_t size_;
+        size_t pos_ = 0;
+        bool ok_ = true;
+
+        bool take(void* out, size_t length);
+        const char* skip(size_t length);        //nullptr if out of bounds
+        size_t remaining() const;
+        bool fail();
+
+        template<typename F>
+        static bool readField(const char*& in, F& field) {
+            static_assert(std::is_trivially_copyable_v<F>);
+            if constexpr(std::is_same_v<F, bool>) {
+                static_assert(sizeof(bool) == 1);
+                uint8_t byte = static_cast<uint8_t>(*in);
+                if(byte > 1) return false;
+                field = (byte != 0);
+            }
+            else std::memcpy(&field, in, sizeof(F));
+            in += sizeof(F);
+            return true;
+        }
+    };
+
+    static std::optional<Key> makeKey(const elf::elf& elf, const std::string& programPath);
+    static bool store(const Key& key, const LineIndex& lines, const FunctionIndex& functions,
+        const SymbolMap& symbols);
+    static bool load(const Key& key, LineIndex& lines, FunctionIndex& functions, SymbolMap& symbols,
+        const elf::elf& elf, uint64_t loadAddress, Config::SymbolConfig* config);
+};
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <list>
+#include <array>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <chrono>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+#include <dwarf/dwarf++.hh>
+#include <elf/elf++.hh>
+
+#include "./lineindex.h"
+#include "./functionindex.h"
+#include "./symbolmap.h"
+#include "./threadpool.h"
+#include "./indexcache.h"
+#include "./config.h"
+
+
+/*
+    Builds the line, function and symbol indexes on a background thread so the prompt is usable while
+    debug info is still being read. Each index becomes ready on its own and getters only wait for the one
+    they return, so commands that need no index never block.
+
+    The first stage reads every unit's line table and functions on the pool. A unit is claimed before it
+    is read, which lets the main thread pull a unit forward: a query that only needs a few units (a
+    breakpoint in one source file, main at startup) reads them itself, or waits for just those if a pool
+    thread already has them, and gets small indexes merged from those units alone. Once the global
+    indexes are merged, every query goes through them instead.
+
+    Units and sections are read through libelfin, so Debugger::loadDwarfSections() must run before start().
+    With an index cache key, a cached copy is tried first (loadCache()) and a fresh build is written back
+    to the cache once every index is merged.
+
+    startLazy() builds nothing up front. Every unit gets its address ranges from .debug_aranges (or from
+    its root DIE when the unit has none there) and a PC, file or function name query reads only the units
+    it hits, on the calling thread. Read units are kept most recently used first and trimmed to a fixed
+    count by trimUnits(), which callers run between commands so references returned while a command runs
+    stay valid. Asking for a global index (ex: listing every function) starts the full background build,
+    after which every query goes through the global indexes as usual.
+*/
+class IndexLoader {
+
+public:
+    enum class Index : uint8_t {
+        lines,
+        functions,
+        symbols
+    };
+
+    //Indexes merged from a subset of units, positions in functions refer to that subset
+    struct Partial {
+        LineIndex lines;
+        FunctionIndex functions;
+    };
+
+    IndexLoader() = default;
+    ~IndexLoader();
+
+    IndexLoader(IndexLoader&&) = delete;
+    IndexLoader& operator=(IndexLoader&&) = delete;
+    IndexLoader(const IndexLoader&) = delete;
+    IndexLoader& operator=(const IndexLoader&) = delete;
+
+    void start(const dwarf::dwarf& dwarf, const elf::elf& elf, uint64_t loadAddress,
+        Config::SymbolConfig* config, ThreadPool& pool, std::optional<IndexCache::Key> cacheKey = std::nullopt);
+    void startLazy(const dwarf::dwarf& dwarf, const elf::elf& elf, uint64_t loadAddress,
+        Config::SymbolConfig* config, ThreadPool& pool, size_t unitCacheSize, 
+        std::optional<IndexCache::Key> cacheKey = std::nullopt);
+    bool loadCache(const IndexCache::Key& key, const elf::elf& elf, uint64_t loadAddress,
+        Config::SymbolConfig* config);     //every index is ready on success, start() is not needed
+    void finish();                          //wait for the background thread, the pool is free afterwards
+
+    bool isReady(Index index) const;
+    bool isFinished() const;
+    void wait(Index index) const;           //rethrows if building that index failed
+
+    //global indexes, in lazy mode the first call starts the full build
+    const LineIndex& getLineIndex();
+    const FunctionIndex& getFunctionIndex();
+    SymbolMap& getSymbolMap();
+
+    //indexes covering pc (the global ones unless lazy), empty if no unit covers pc
+    const LineIndex& getLineIndex(uint64_t pc);
+    const FunctionIndex& getFunctionIndex(uint64_t pc);
+    const FunctionIndex& getFunctionIndex(const FunctionIndex::Function& func);     //index that holds func
+    void trimUnits();                       //drop lazily read units past the cache size
+    void setFunctionIndex(FunctionIndex index);     //only after finish()
+    const std::vector<std::pair<std::string, double>>& getTimes() const;    //only after finish()
+
+    //nullopt once the global indexes are merged (use them instead) or when no unit qualifies
+    std::optional<Partial> loadUnitsForFile(std::string_view path);     //units whose main file ends with path
+    std::optional<Partial> loadUnitForAddress(uint64_t addr);           //unit whose code covers addr
+    std::optional<Partial> loadUnitsForName(std::string_view name);     //lazy only, units defining name
+
+private:
+    enum UnitState : uint8_t {
+        pending,
+        loading,
+        loaded
+    };
+
+    struct UnitRange {
+        uint64_t low;
+        uint64_t high;
+        uint32_t unit;
+    };
+
+    struct LazyUnit {
+        size_t unit;
+        LineIndex::UnitLines lines;
+        FunctionIndex::UnitFunctions functions;
+        std::optional<Partial> index;           //indexes of this unit alone, built on its first PC query
+    };
+
+    const dwarf::dwarf* dwarf_ = nullptr;
+    const elf::elf* elf_ = nullptr;
+    uint64_t loadAddress_ = 0;
+    Config::SymbolConfig* config_ = nullptr;
+    ThreadPool* pool_ = nullptr;
+    bool started_ = false;
+    bool launched_ = false;                     //the background build is running or done
+    bool lazy_ = false;
+    std::optional<IndexCache::Key> cacheKey_;
+    std::vector<std::string> unitPaths_;        //normalized main source file of every unit
+    std::vector<UnitRange> unitRanges_;         //disjoint, sorted by address
+    std::vector<std::optional<std::vector<std::string>>> unitFiles_;   //lazy only, nullopt if unreadable
+    bool unitFilesBuilt_ = false;
+    std::list<LazyUnit> lazyUnits_;             //most recently used first
+    size_t unitCacheSize_ = 0;
+    Partial empty_;
+    std::unique_ptr<std::atomic<uint8_t>[]> unitStates_;
+    std::vector<LineIndex::UnitLines> unitLines_;
+    std::vector<FunctionIndex::UnitFunctions> unitFunctions_;
+    std::vector<std::exception_ptr> unitErrors_;    //why a loaded unit has empty tables
+    bool unitsMerged_ = false;                  //unit tables were handed to the global merge
+
+    mutable std::mutex mutex_;
+    mutable std::condition_variable cv_;
+    std::array<bool, 3> ready_{};
+    std::array<std::exception_ptr, 3> errors_;
+    std::atomic<bool> finished_ = false;
+    std::vector<std::pair<std::string, double>> times_;     //stage, seconds
+
+    LineIndex lines_;
+    FunctionIndex functions_;
+    SymbolMap symbols_;
+    std::thread thread_;
+
+    void prepare(const dwarf::dwarf& dwarf, const elf::elf& elf, uint64_t loadAddress,
+        Config::SymbolConfig* config, ThreadPool& pool, std::optional<IndexCache::Key> cacheKey);
+    void launch();
+    void run();
+    void buildSymbols();
+    void loadUnit(size_t unit);
+    bool lazy() const;
+    void buildUnitRanges();
+    void buildUnitFiles();
+    std::optional<size_t> findUnit(uint64_t addr) const;
+    LazyUnit& loadLazyUnit(size_t unit);
+    Partial* findLazyIndex(uint64_t pc);
+    std::optional<Partial> mergeUnits(const std::vector<size_t>& units);
+    template<typename Build> void runStage(Index index, const std::string& name, Build&& build);
+};
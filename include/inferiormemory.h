@@ -0,0 +1,84 @@
+#pragma once
+
+#include <sys/types.h>
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <vector>
+#include <unordered_map>
+
+
+/*
+    Bulk access to the memory of the child process. Reads are attempted with process_vm_readv() first
+    (one syscall for the whole range), then with pread() on /proc/pid/mem, and only then word-by-word
+    with PTRACE_PEEKDATA. Writes mirror this with process_vm_writev(), pwrite() and PTRACE_POKEDATA.
+    process_vm_writev() honours page permissions, so read-only pages (ex: .text) skip straight to
+    /proc/pid/mem, which the kernel lets a tracer write regardless of protection. The object must be
+    constructed after the child has exec'd, otherwise the /proc/pid/mem descriptor refers to the address
+    space of the forked debugger image.
+
+    Reads are served from a page-granular cache that is only valid for a single stop of the child. Every
+    resume calls invalidate(), which bumps the stop generation and lazily retires every cached page. Misses
+    fill a whole run of pages with one bulk read, and writes are copied through to cached pages so the
+    cache never disagrees with the child while it is stopped.
+*/
+class InferiorMemory {
+
+public:
+    InferiorMemory() = default;     //default until actually constructed in initializeMapsAndLoadAddress()
+    explicit InferiorMemory(pid_t pid);
+
+    InferiorMemory(InferiorMemory&& other) noexcept;
+    InferiorMemory& operator=(InferiorMemory&& other) noexcept;
+    ~InferiorMemory();
+
+    InferiorMemory(const InferiorMemory&) = delete;
+    InferiorMemory& operator=(const InferiorMemory&) = delete;
+
+    static inline constexpr size_t wordSize = sizeof(uint64_t);
+    static inline constexpr size_t pageSize = 0x1000;
+    static inline constexpr size_t maxCachedPages = 256;    //1 MiB of cached memory per stop
+
+    struct CacheStats {
+        uint64_t pageHits = 0;
+        uint64_t pageMisses = 0;
+        uint64_t uncachedReads = 0;     //reads too large to be worth caching
+        uint64_t readSyscalls = 0;
+        uint64_t writeSyscalls = 0;
+        uint64_t invalidations = 0;
+    };
+
+    size_t read(uint64_t addr, void* buffer, size_t len) const;     //returns number of bytes read
+    size_t write(uint64_t addr, const void* buffer, size_t len, bool writable = true);   //bytes written
+    bool initialized() const;
+    int getLastError() const;       //errno saved right after the last failed read or write syscall
+
+    void invalidate();      //child is about to resume, every cached page becomes stale
+    uint64_t getGeneration() const;
+    const CacheStats& getStats() const;
+    void resetStats();
+
+private:
+    struct Page {
+        uint64_t generation = 0;
+        std::array<uint8_t, pageSize> data;
+    };
+
+    pid_t pid_ = 0;
+    int memFd_ = -1;
+    uint64_t generation_ = 1;       //generation 0 marks a page that was never filled
+    mutable std::unordered_map<uint64_t, Page> pages_;
+    mutable std::vector<uint8_t> scratch_;
+    mutable CacheStats stats_;
+    mutable int lastError_ = 0;
+
+    const uint8_t* getCachedPage(uint64_t pageAddr) const;
+    size_t fillPages(uint64_t pageAddr, size_t count) const;
+    size_t readUncached(uint64_t addr, uint8_t* buffer, size_t len) const;
+    size_t readVM(uint64_t addr, uint8_t* buffer, size_t len) const;
+    size_t readProcMem(uint64_t addr, uint8_t* buffer, size_t len) const;
+    size_t readPeek(uint64_t addr, uint8_t* buffer, size_t len) const;
+    size_t writeVM(uint64_t addr, const uint8_t* buffer, size_t len);
+    size_t writeProcMem(uint64_t addr, const uint8_t* buffer, size_t len);
+    size_t writePoke(uint64_t addr, const uint8_t* buffer, size_t len);
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <optional>
+#include <cstdint>
+#include <cstddef>
+
+
+/*
+    x86-64 instruction length decoder, only as deep as displaced stepping needs: the length, where a
+    RIP-relative disp32 sits, and whether the instruction transfers control relative to RIP or pushes a
+    return address. Legacy prefixes, REX, the 0F/0F38/0F3A maps, VEX and EVEX are understood. Anything
+    else (3DNow!, opcodes invalid in 64-bit mode, EIP-relative addressing, 16-bit branch targets) is
+    rejected, and so are instructions that have to run in place (syscall, int n, ...).
+*/
+namespace x86 {
+    inline constexpr size_t maxLength = 15;
+
+    struct Instruction {
+        enum Kind : uint8_t {
+            plain,              //no control transfer, or one to an absolute target (ex: ret, jmp *%rax)
+            jump,               //jmp/jcc/loop/jrcxz rel8 or rel32
+            call,               //call rel32
+            indirectCall        //call r/m64
+        };
+        uint8_t length = 0;
+        uint8_t ripDisplacement = 0;        //offset of the RIP-relative disp32, 0 if there is none
+        Kind kind = plain;
+    };
+
+    std::optional<Instruction> decode(const uint8_t* code, size_t size);
+}
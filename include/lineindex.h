@@ -0,0 +1,118 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <optional>
+#include <span>
+#include <cstdint>
+#include <cstddef>
+
+#include <dwarf/dwarf++.hh>
+
+#include "./threadpool.h"
+#include "./indexcache.h"
+
+
+/*
+    Flat PC --> line index over the line tables of every compilation unit. All rows are merged once into a
+    single address-sorted array, so a lookup is one binary search instead of a walk over every CU's range
+    list followed by line_table::find_address(). The addresses are also kept in their own contiguous array
+    so the search only touches 8 bytes per probe.
+
+    The reverse direction (file:line --> addresses) is a second flat array of every statement row that
+    starts a new line, sorted by (file id, line, address). Files are found through every trailing path
+    suffix of their name (foo.cpp, src/foo.cpp, ...), so a breakpoint location resolves with two hash and
+    binary searches and returns every code location of the line, not just the first.
+
+    Each unit's line table is decoded and sorted on its own (readUnit()), so the per-unit work runs in
+    parallel on a ThreadPool. The sorted runs are then merged pairwise, which is also spread across the
+    pool. An index can also be merged from only some units, ex: to answer a query before every unit is read.
+*/
+class LineIndex {
+
+public:
+    struct Entry {
+        uint64_t address;
+        uint32_t fileId;
+        uint32_t line;
+        bool isStmt;
+        bool prologueEnd;       //compiler marked this row as the first one past the function prologue
+        bool endSequence;       //first address past a sequence, not an actual line
+    };
+
+    struct LineLocation {
+        uint32_t fileId;
+        uint32_t line;
+        uint64_t address;
+    };
+
+    //Rows of a single unit, fileId indexes files until the unit is merged
+    struct UnitLines {
+        std::vector<Entry> entries;     //sorted like the merged index
+        std::vector<std::string> files;
+        std::vector<LineLocation> locations;
+    };
+
+    //Position in the index, can be stepped forward through rows in address order
+    class iterator {
+    public:
+        iterator() = default;
+        iterator(const LineIndex* index, size_t row);
+
+        const Entry& operator*() const;
+        const Entry* operator->() const;
+        iterator& operator++();
+        iterator operator++(int);
+        bool operator==(const iterator& other) const = default;
+
+        const std::string& getFilePath() const;
+        size_t getRow() const;
+
+    private:
+        const LineIndex* index_ = nullptr;
+        size_t row_ = 0;
+    };
+
+    LineIndex() = default;
+    LineIndex(const dwarf::dwarf& dwarf, ThreadPool& pool);
+    explicit LineIndex(std::vector<UnitLines> units, ThreadPool* pool = nullptr);  //no pool: merge on caller
+
+    static UnitLines readUnit(const dwarf::compilation_unit& cu);   //safe to call from any thread
+
+    void save(IndexCache::Writer& writer) const;
+    static std::optional<LineIndex> load(IndexCache::Reader& reader);  //nullopt if the data is inconsistent
+
+    LineIndex(LineIndex&&) = default;
+    LineIndex& operator=(LineIndex&&) = default;
+    ~LineIndex() = default;
+
+    LineIndex(const LineIndex&) = delete;
+    LineIndex& operator=(const LineIndex&) = delete;
+
+    std::optional<iterator> find(uint64_t pc) const;     //row covering pc, nullopt if pc has no line
+    iterator lowerBound(uint64_t addr) const;           //first row at or after addr
+    iterator begin() const;
+    iterator end() const;
+    std::span<const Entry> getEntries() const;
+
+    std::vector<uint32_t> findFiles(std::string_view path) const;     //files whose path ends with path
+    std::vector<uint64_t> getLineAddresses(uint32_t fileId, uint32_t line) const;
+
+    const std::string& getFilePath(uint32_t fileId) const;
+    size_t size() const;
+    size_t fileCount() const;
+    bool initialized() const;
+
+private:
+    std::vector<uint64_t> addresses_;
+    std::vector<Entry> entries_;
+    std::vector<std::string> files_;
+    std::vector<LineLocation> locations_;
+    std::unordered_map<std::string, std::vector<uint32_t>> fileSuffixes_;
+
+    static std::vector<UnitLines> readUnits(const dwarf::dwarf& dwarf, ThreadPool& pool);
+    static void addLocations(const std::vector<Entry>& sequence, std::vector<LineLocation>& locations);
+    void addFileSuffixes(const std::string& path, uint32_t fileId);
+};
@@ -1,14 +1,23 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <sys/types.h>
 #include <cstdint>
 #include <vector>
 #include <array>
 #include <optional>
-#include <functional>
 
 
+/*
+    Mappings of the child parsed from /proc/pid/maps. The map is not reparsed on every stop: the debugger
+    calls invalidate() whenever the child may have changed its address space, and the next query reparses
+    it. Every reparse bumps the generation, so callers can tell whether chunk data they saw is still current.
+    Chunks are kept in address order (as the kernel lists them), so address lookups are a binary search.
+    Since any query can reparse, nothing handed out refers into the parsed state: a lookup returns a copy
+    of the chunk, pathname included, and getChunks() a copy of the array. What a caller holds stays valid
+    however often the map is reparsed afterwards (ex: after an injected syscall).
+*/
 class MemoryMap {
 
 public: 
@@ -23,6 +32,9 @@ public:
     MemoryMap& operator=(const MemoryMap&) = delete;
     
     void reload();
+    void invalidate();      //address space may have changed, reparse on the next query
+    bool isStale() const;
+    uint64_t getGeneration() const;
     //parseProcPidMaps()
     
 
@@ -60,11 +72,16 @@ public:
         uint64_t addrHigh;  //non-inclusive
         Permissions perms;
         Path path;
+        uint64_t offset;    //file offset mapped at addrLow
+        uint32_t devMajor;
+        uint32_t devMinor;
+        uint64_t inode;     //0 for anonymous mappings
         std::string pathname;
        // const std::string pathSuffix;     //can be empty if path type has no suffix
         //suffix/tid may be needed later 
         bool isPathtypeExec() const; 
         bool contains(uint64_t addr) const;     //return if addr in range [addrLow, addrHigh)
+        uint64_t getFileOffset(uint64_t addr) const;    //offset of addr in the backing file
 
         bool canRead() const;
         bool canWrite() const;
@@ -76,13 +93,13 @@ public:
     // static bool canWrite(Chunk& c);
     // static bool canExecute(Chunk& c);
     // static bool isShared(Chunk& c);
-    static std::string getFileNameFromChunk(Chunk c);
+    static std::string getFileNameFromChunk(const Chunk& c);
     
-    const std::vector<Chunk>& getChunks() const;
+    std::vector<Chunk> getChunks() const;
     void printChunk(uint64_t pc) const;
     void dumpChunks() const;
 
-    std::optional<std::reference_wrapper<const Chunk>> getChunkFromAddr(uint64_t addr) const;
+    std::optional<Chunk> getChunkFromAddr(uint64_t addr) const;
     // bool canRead(uint64_t addr);
     // bool canWrite(uint64_t addr);
 
@@ -92,7 +109,16 @@ private:
     //may need to incorporate mutex --> look into lock_guard for RAII
     pid_t pid_ = 0;
     std::string exec_;
-    std::vector<Chunk> chunks_;
+    std::string mapsPath_;
+    mutable std::vector<Chunk> chunks_;
+    mutable std::vector<char> buffer_;      //raw contents of /proc/pid/maps, reused between parses
+    mutable size_t lastHit_ = 0;            //chunk of the previous lookup, lookups cluster heavily
+    mutable bool stale_ = false;
+    mutable uint64_t generation_ = 1;
 
+    static inline constexpr size_t initialBufferSize_ = 0x10000;
+
+    bool parse() const;
+    void refresh() const;   //reparse if stale
     Path getPathFromFullPathname(std::string_view s) const;
 };
\ No newline at end of file
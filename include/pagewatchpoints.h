@@ -0,0 +1,74 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include <optional>
+#include <functional>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+
+/*
+    Bookkeeping for software watchpoints over ranges of any size. The debugger removes write permission
+    from every page a watched range touches (an injected mprotect), so a write anywhere on those pages
+    faults with SEGV_ACCERR. Pages are reference counted across watchpoints and remember the protection
+    they had before the first watchpoint, which is what they get back after the last one is removed.
+
+    add(), remove() and clear() return the pages whose protection has to change, coalesced into runs of
+    contiguous pages with the same original protection so each run is a single mprotect. Faults on a
+    watched page outside every range are false hits, counted for each watchpoint sharing the page.
+*/
+class PageWatchpoints {
+
+public:
+    static inline constexpr uint64_t pageSize = 0x1000;
+
+    struct Watchpoint {
+        uint64_t addr;
+        uint64_t length;
+        uint64_t hits = 0;
+        uint64_t falseHits = 0;     //writes elsewhere on its pages
+    };
+
+    struct Run {
+        uint64_t addr;              //page aligned
+        uint64_t length;            //multiple of pageSize
+        int prot;                   //protection before watching
+    };
+
+    PageWatchpoints() = default;
+
+    PageWatchpoints(PageWatchpoints&&) = default;
+    PageWatchpoints& operator=(PageWatchpoints&&) = default;
+    ~PageWatchpoints() = default;
+
+    PageWatchpoints(const PageWatchpoints&) = delete;
+    PageWatchpoints& operator=(const PageWatchpoints&) = delete;
+
+    //id of the new watchpoint and the newly watched pages, protection() is asked for those pages only
+    std::pair<uint64_t, std::vector<Run>> add(uint64_t addr, uint64_t length,
+        const std::function<int(uint64_t)>& protection);
+    std::optional<std::vector<Run>> remove(uint64_t id);        //pages no longer watched, nullopt if no such id
+    std::vector<Run> clear();
+
+    std::optional<Run> getPage(uint64_t addr) const;            //watched page containing addr
+    std::optional<uint64_t> find(uint64_t addr) const;          //lowest id whose range contains addr
+    void countFalseHit(uint64_t page);
+    Watchpoint& get(uint64_t id);
+
+    bool empty() const;
+    const std::map<uint64_t, Watchpoint>& getWatchpoints() const;
+
+private:
+    struct Page {
+        int prot;
+        size_t watchers;
+    };
+
+    std::map<uint64_t, Watchpoint> watchpoints_;    //id --> watchpoint
+    std::map<uint64_t, Page> pages_;                //page address --> page
+    uint64_t nextId_ = 1;
+
+    static std::vector<Run> coalesce(const std::vector<std::pair<uint64_t, int>>& pages);
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "./breakpoint.h"
+#include "./inferiormemory.h"
+
+
+/*
+    Batched int3 patching for mass breakpoint operations (step over plans, cleanup). Enables and disables
+    are queued, then apply() sorts them by address and patches every touched page with one read and one
+    write (/proc/pid/mem for text pages) spanning its first to last breakpoint, instead of a read and a
+    write per breakpoint. Bytes in between are written back as they were read during the same stop.
+
+    The original byte under each int3 stays in its Breakpoint, which is the shadow table readMemoryBlock()
+    and writeMemoryBlock() already consult. A queued operation that would not change a breakpoint's state
+    is dropped, and the last operation queued for a breakpoint wins. Breakpoints must outlive apply().
+*/
+class PatchBatch {
+
+public:
+    explicit PatchBatch(InferiorMemory* mem);
+
+    PatchBatch(PatchBatch&&) = default;
+    PatchBatch& operator=(PatchBatch&&) = default;
+    ~PatchBatch() = default;
+
+    PatchBatch(const PatchBatch&) = delete;
+    PatchBatch& operator=(const PatchBatch&) = delete;
+
+    void enable(Breakpoint& bp);
+    void disable(Breakpoint& bp);
+    size_t apply();             //breakpoints patched, the queue is emptied either way
+
+    bool empty() const;
+    size_t size() const;
+
+private:
+    struct Op {
+        Breakpoint* bp;
+        bool enable;
+    };
+
+    InferiorMemory* mem_ = nullptr;
+    std::vector<Op> ops_;
+    std::vector<uint8_t> buffer_;
+
+    size_t applyPage(const Op* first, const Op* last);
+};
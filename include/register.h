@@ -5,6 +5,7 @@
 #include <array>
 #include <cstdint>
 #include <sys/user.h>
+#include <sys/types.h>
 
 
 
@@ -51,14 +52,48 @@ namespace reg {		//register is a reserved keyword
 	extern const std::array<regDescriptor, 27> regDescriptorList;
 
 
-	bool setRegisterValue(pid_t pid, const Reg r, uint64_t val);
-    uint64_t getRegisterValue(const pid_t pid, const Reg r);
-    uint64_t getRegisterValue(const pid_t pid, const int dwarfNum);
+	/*
+		Holds the child's user_regs_struct for the current stop. The first read of a stop issues a single 
+		PTRACE_GETREGS, every later read and write is served from the copy. Writes only mark the copy dirty,
+		flush() writes it back with one PTRACE_SETREGS right before the child is resumed, and invalidate() 
+		drops it so the next stop fetches fresh values.
+	*/
+	class RegisterCache {
+	public:
+		RegisterCache() = default;
+		explicit RegisterCache(pid_t pid);
+
+		struct CacheStats {
+			uint64_t hits = 0;
+			uint64_t fetches = 0;		//PTRACE_GETREGS calls
+			uint64_t flushes = 0;		//PTRACE_SETREGS calls
+		};
+
+		user_regs_struct& get();			//fetches on first use in a stop
+		void markDirty();
+		bool flush();						//returns false if a dirty register file could not be written
+		void invalidate();
+		bool isValid() const;
+
+		const CacheStats& getStats() const;
+		void resetStats();
+
+	private:
+		pid_t pid_ = 0;
+		user_regs_struct regs_{};
+		bool valid_ = false;
+		bool dirty_ = false;
+		CacheStats stats_;
+	};
+
+	bool setRegisterValue(RegisterCache& cache, const Reg r, uint64_t val);
+    uint64_t getRegisterValue(RegisterCache& cache, const Reg r);
+    uint64_t getRegisterValue(RegisterCache& cache, const int dwarfNum);
 
     std::string getRegisterName(const Reg r);
     Reg getRegFromName(const std::string_view regName);
-	bool getAllRegisterValues(const pid_t pid, user_regs_struct& rawRegVals);
-	bool setAllRegisterValues(const pid_t pid, user_regs_struct& rawRegVals);
+	bool getAllRegisterValues(RegisterCache& cache, user_regs_struct& rawRegVals);
+	bool setAllRegisterValues(RegisterCache& cache, user_regs_struct& rawRegVals);
 }
 
   
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <optional>
 #include <unordered_map>
 #include <vector>
 #include <cstdint>
@@ -8,13 +10,24 @@
 #include <elf/elf++.hh>
 
 #include "./config.h"
+#include "./threadpool.h"
+#include "./indexcache.h"
 
 
+/*
+    Symbols of the executable's symtab/dynsym, read and demangled once when the map is built. Raw and 
+    demangled names live in one string arena, the table is sorted by address for address --> symbol 
+    lookups, and exact (strict) name lookups go through a hash of the demangled and raw names.
+
+    Non-strict (substring) lookups use a trigram index over the distinct demangled names: a query of 3+
+    characters intersects the posting lists of its trigrams and only verifies the surviving names. Shorter
+    queries scan one contiguous, '\0'-separated copy of the names, which is a single memchr-speed pass.
+*/
 class SymbolMap {
 
 public:
     SymbolMap() = default;
-    SymbolMap(const elf::elf& elf, const uint64_t loadAddress, Config::SymbolConfig* config);
+    SymbolMap(const elf::elf& elf, const uint64_t loadAddress, Config::SymbolConfig* config, ThreadPool& pool);
     
     SymbolMap(SymbolMap&&) = default;
     SymbolMap& operator=(SymbolMap&&) = default;
@@ -25,6 +38,12 @@ public:
 
     bool initialized();
 
+    void save(IndexCache::Writer& writer) const;
+    static std::optional<SymbolMap> load(IndexCache::Reader& reader, const elf::elf& elf, uint64_t loadAddress,
+        Config::SymbolConfig* config);     //nullopt if the data is inconsistent
+
+    bool getCacheEnabled();
+    void setCacheEnabled(bool enabled);
     uint8_t getMinCachedStringLength();
     void setMinCachedStringLength(uint8_t length);
     size_t getMaxSymbolCacheSize();
@@ -52,17 +71,50 @@ public:
     Sym getSymFromElf(elf::stt s) const;
 
     std::vector<Symbol> getSymbolListFromName(const std::string& name, bool strict = true, bool cache = true);
+    std::optional<Symbol> getSymbolFromAddr(uint64_t addr) const;  //func/object covering addr (file address)
+    size_t size() const;
     static void dumpSymbolList(const std::vector<Symbol>& symbolList, const std::string& name, 
         bool strict = false);
     void dumpSymbolCache(bool strict = false) const;
     void dumpSymbolCache(const std::string& name, bool strict = false) const;
     
 private:
+    struct Name {
+        uint32_t offset = 0;
+        uint32_t length = 0;
+    };
+
+    struct Entry {
+        uint64_t addr;
+        uint64_t size;
+        Name raw;
+        Name demangled;     //same as raw if the name is not mangled
+        Sym s;
+    };
+
     elf::elf elf_;
     uint64_t loadAddress_ = 0;
+    std::string names_;
+    std::vector<Entry> symbols_;                //sorted by address
+    std::vector<uint32_t> addrIndex_;           //defined func/object symbols with a size, by address
+    std::unordered_map<std::string, std::vector<uint32_t>> byName_;
+    std::string searchText_;                    //distinct demangled names, '\0' separated, sorted
+    std::vector<uint32_t> searchOffsets_;       //start of every name in searchText_, plus an end sentinel
+    std::vector<uint32_t> trigramKeys_;         //sorted distinct trigrams
+    std::vector<uint32_t> trigramOffsets_;      //postings_ range of every trigram, plus an end sentinel
+    std::vector<uint32_t> postings_;            //name indices containing each trigram, sorted
     std::unordered_map<std::string, std::vector<Symbol>> nonStrictSymbolCache_;
     Config::SymbolConfig* config_ = nullptr;
     void configure();
+    void build(ThreadPool& pool);
+    void indexNames();
+    void buildSearchIndex();
+    bool validate() const;
+    std::vector<uint32_t> searchNames(std::string_view query) const;    //indices of names containing query
+    std::string_view getSearchName(uint32_t index) const;
+    Name intern(std::string_view name);
+    std::string_view getString(Name name) const;
+    Symbol makeSymbol(const Entry& entry) const;
 
 
 };
\ No newline at end of file
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+
+/*
+    Fixed set of worker threads used to fan indexing work out across cores. Work is submitted as a
+    parallelFor() over task indices: every participant (the workers plus the calling thread) owns a deque
+    seeded with one contiguous block of indices, pops from the front of its own deque and, once empty,
+    steals from the back of another's. Contiguous blocks keep neighbouring compilation units on the same
+    thread, stealing evens out the few huge units that would otherwise leave every other core idle.
+
+    Callers write results into per-index slots and merge them afterwards, so task order never changes the
+    outcome. The first exception thrown by a task is rethrown from parallelFor() once every task is done.
+    parallelFor() may be called from any thread, concurrent calls run one after the other. Tasks must not
+    call parallelFor() themselves.
+*/
+class ThreadPool {
+
+public:
+    explicit ThreadPool(unsigned threads = 0);     //total threads including the caller, 0 = one per core
+    ~ThreadPool();
+
+    ThreadPool(ThreadPool&&) = delete;
+    ThreadPool& operator=(ThreadPool&&) = delete;
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void parallelFor(size_t count, const std::function<void(size_t)>& task);
+    unsigned size() const;      //threads taking part in a parallelFor(), caller included
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    std::vector<std::thread> workers_;
+    std::unique_ptr<Queue[]> queues_;       //queues_[0] belongs to the calling thread
+    unsigned queueCount_;
+
+    std::mutex submitMutex_;                //one parallelFor() at a time
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    uint64_t generation_ = 0;
+    bool stopping_ = false;
+
+    const std::function<void(size_t)>* task_ = nullptr;
+    std::atomic<size_t> remaining_ = 0;
+    std::exception_ptr error_;
+
+    void workerLoop(unsigned self);
+    void drain(unsigned self);
+    bool pop(unsigned self, size_t& index);
+    bool steal(unsigned self, size_t& index);
+    void run(size_t index);
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+
+/*
+    Buffered sink for tracepoint output. Lines are formatted straight into the buffer, which is written with
+    a single write(2) once it holds capacity bytes or when the debugger stops at the prompt, so a hit never
+    flushes the terminal. Output goes to stdout unless a file is opened, std::cout is flushed first so the
+    two streams stay in order.
+*/
+class TraceLog {
+
+public:
+    static inline constexpr size_t capacity = 0x10000;      //64 KiB
+
+    struct Stats {
+        uint64_t lines = 0;
+        uint64_t bytes = 0;
+        uint64_t flushes = 0;       //write(2) batches
+    };
+
+    TraceLog() = default;
+
+    TraceLog(TraceLog&& other) noexcept;
+    TraceLog& operator=(TraceLog&& other) noexcept;
+    ~TraceLog();
+
+    TraceLog(const TraceLog&) = delete;
+    TraceLog& operator=(const TraceLog&) = delete;
+
+    bool open(const std::string& path);     //"-" goes back to stdout
+    const std::string& getPath() const;
+
+    std::string& line();                    //append one line, then commit()
+    void commit();
+    void flush();
+
+    const Stats& getStats() const;
+    void resetStats();
+
+private:
+    int fd_ = 1;
+    std::string path_ = "-";
+    std::string buffer_;
+    Stats stats_;
+
+    void closeFile();
+};
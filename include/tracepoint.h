@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <chrono>
+#include <cstdint>
+#include <sys/user.h>
+
+#include "./condition.h"
+#include "./inferiormemory.h"
+
+
+/*
+    Dynamic printf attached to a breakpoint: every hit formats one line into the trace log and the child
+    is resumed right away. The format is printf-like, %[0][width] followed by d/i (signed), u, x, X, p, c or
+    s (a C string of at most maxString bytes), and %% for a literal %. Each argument is a Condition
+    expression, so registers, constants and loads (*expr) all work and memory comes from the stop's cache.
+
+    hit() applies the ignore count (the next n hits are skipped) and the rate limit (at most n logged
+    lines per second, the rest are dropped and counted) before anything is read from the child.
+*/
+class Tracepoint {
+
+public:
+    static inline constexpr size_t maxString = 256;
+
+    static std::optional<Tracepoint> compile(std::string_view format, const std::vector<std::string_view>& args,
+        std::string& error);
+
+    Tracepoint(Tracepoint&&) = default;
+    Tracepoint& operator=(Tracepoint&&) = default;
+    ~Tracepoint() = default;
+
+    Tracepoint(const Tracepoint&) = delete;
+    Tracepoint& operator=(const Tracepoint&) = delete;
+
+    enum class Verdict : uint8_t {
+        log,
+        ignored,
+        limited
+    };
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t logged = 0;
+        uint64_t ignored = 0;
+        uint64_t limited = 0;
+    };
+
+    Verdict hit(std::chrono::steady_clock::time_point now);
+    void format(const user_regs_struct& regs, const InferiorMemory& mem, std::string& out) const;
+
+    void setIgnoreCount(uint64_t count);
+    void setRateLimit(uint64_t perSecond);      //0 is unlimited
+    uint64_t getIgnoreCount() const;
+    uint64_t getRateLimit() const;
+    const std::string& getSource() const;
+    const Stats& getStats() const;
+
+private:
+    struct Segment {
+        std::string text;           //literal text before the conversion
+        char conversion = 0;        //0 for trailing text only
+        bool zeroPad = false;
+        uint8_t width = 0;
+    };
+
+    std::string source_;
+    std::vector<Segment> segments_;
+    std::vector<Condition> args_;
+    uint64_t ignoreCount_ = 0;
+    uint64_t rateLimit_ = 0;
+    std::chrono::steady_clock::time_point window_{};
+    uint64_t windowCount_ = 0;
+    Stats stats_;
+
+    Tracepoint() = default;
+};
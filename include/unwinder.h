@@ -0,0 +1,119 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <optional>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+#include <sys/user.h>
+
+#include <elf/elf++.hh>
+
+#include "./inferiormemory.h"
+
+
+/*
+    Call frame information (CFI) unwinder for the debuggee's own code. Every FDE of .eh_frame and
+    .debug_frame is recorded once (its address range and where its CIE and instructions are) in a table
+    sorted by address. Unwinding a frame finds the FDE covering its PC, runs the CIE's initial instructions
+    and the FDE's instructions up to that PC, and applies the resulting rule: the CFA is a register plus an
+    offset, and every register (the return address included) is unchanged, saved at CFA + n, equal to
+    CFA + n or copied from another register.
+
+    Evaluated rules are cached per PC, so the frames of a deep or repeated backtrace are only evaluated once.
+    Saved registers are read through InferiorMemory, whose page cache turns a whole backtrace into one bulk
+    read per stack page. Code without CFI (or with DWARF expression rules, ex: PLT stubs) falls back to the
+    rbp chain. Only the executable's sections are read, frames inside shared libraries rely on the fallback.
+*/
+class Unwinder {
+
+public:
+    static inline constexpr size_t registerCount = 17;      //DWARF x86-64 numbers 0-15 plus the RA column
+    static inline constexpr size_t maxFrames = 1024;
+    static inline constexpr size_t maxCachedRules = 4096;
+
+    struct Frame {
+        uint64_t pc = 0;
+        uint64_t cfa = 0;                                   //0 for the innermost frame
+        std::array<uint64_t, registerCount> regs{};         //indexed by DWARF register number
+        uint32_t known = 0;                                 //bit per register whose value is known
+        bool innermost = true;                              //pc is not a return address
+    };
+
+    struct CacheStats {
+        uint64_t ruleHits = 0;
+        uint64_t ruleMisses = 0;
+        uint64_t fallbacks = 0;                             //frames unwound through rbp instead of CFI
+    };
+
+    Unwinder() = default;
+    Unwinder(const elf::elf& elf, uint64_t loadAddress);
+
+    Unwinder(Unwinder&&) = default;
+    Unwinder& operator=(Unwinder&&) = default;
+    ~Unwinder() = default;
+
+    Unwinder(const Unwinder&) = delete;
+    Unwinder& operator=(const Unwinder&) = delete;
+
+    static Frame makeFrame(const user_regs_struct& regs);
+    std::optional<Frame> unwind(const Frame& frame, const InferiorMemory& mem);    //nullopt at the outermost
+    std::vector<Frame> backtrace(const user_regs_struct& regs, const InferiorMemory& mem);
+
+    size_t size() const;                                    //FDEs read
+    const CacheStats& getStats() const;
+    void resetStats();
+
+private:
+    struct RegisterRule {
+        enum Kind : uint8_t {
+            sameValue,
+            undefined,
+            offset,         //saved at CFA + value
+            valOffset,      //is CFA + value
+            reg,            //held in register value
+            unsupported     //DWARF expression
+        };
+        Kind kind = sameValue;
+        int64_t value = 0;
+    };
+
+    struct Rule {
+        uint8_t cfaRegister = 0;
+        int64_t cfaOffset = 0;
+        bool cfaSupported = true;
+        uint8_t returnRegister = registerCount - 1;
+        std::array<RegisterRule, registerCount> registers{};
+    };
+
+    struct Cie {
+        uint64_t codeAlign = 1;
+        int64_t dataAlign = 1;
+        uint8_t returnRegister = registerCount - 1;
+        uint8_t pointerEncoding = 0;
+        bool augmented = false;                 //'z', FDEs carry augmentation data
+        const uint8_t* instructions = nullptr;
+        const uint8_t* end = nullptr;
+    };
+
+    struct Fde {
+        uint64_t low;
+        uint64_t high;
+        uint32_t cie;                           //index into cies_
+        const uint8_t* instructions;
+        const uint8_t* end;
+    };
+
+    elf::elf elf_;
+    uint64_t loadAddress_ = 0;
+    std::vector<Cie> cies_;
+    std::vector<Fde> fdes_;                     //sorted by low, .eh_frame first on ties
+    std::unordered_map<uint64_t, std::optional<Rule>> rules_;      //file address --> rule, nullopt if none
+    CacheStats stats_;
+
+    void readSection(const std::string& name, bool ehFrame);
+    const std::optional<Rule>& findRule(uint64_t pc);
+    std::optional<Rule> evaluate(const Fde& fde, uint64_t pc) const;
+    std::optional<Frame> unwindFramePointer(const Frame& frame, const InferiorMemory& mem) const;
+};
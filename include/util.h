@@ -7,6 +7,7 @@
 #include <string_view>
 #include <optional>
 #include <utility>
+#include <cstdint>
 
 
 namespace util {
@@ -18,6 +19,7 @@ namespace util {
 
     bool validHexStol(uint64_t& num, std::string_view addr);
     bool validDecStol(uint64_t& num, std::string_view dec);
+    bool validHexBytes(std::vector<uint8_t>& bytes, std::string_view hex);
     
     std::vector<std::string> splitLine(const std::string &line, char delimiter);
     bool hasWhiteSpace(const std::string_view s);
@@ -27,4 +29,5 @@ namespace util {
     bool promptYesOrNo();
 
     std::optional<std::string> demangleSymbol(const std::string& symbol, bool makeReadable = true);
+    std::string demangledToReadable(const std::string& demangled);     //throws std::logic_error
 }
\ No newline at end of file
@@ -0,0 +1,241 @@
+#include "../include/debugger.h"
+#include "../include/lineindex.h"
+#include "../include/memorymap.h"
+#include "../include/util.h"
+#include "../include/breakpoint.h"
+#include "../include/patchbatch.h"
+
+#include <dwarf/dwarf++.hh>
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <chrono>
+#include <random>
+#include <cstdint>
+#include <algorithm>
+#include <optional>
+#include <string_view>
+#include <fstream>
+#include <filesystem>
+#include <bit>
+#include <cstring>
+#include <cerrno>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+/*
+    In-debugger benchmarks, so the lookup structures can be measured against the binary actually being
+    debugged instead of a synthetic one. Every benchmark draws its sample addresses from a fixed seed so
+    runs are comparable, and a checksum of the results is printed so the compiler cannot drop the loops.
+*/
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    double secondsSince(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    void printRate(const std::string& label, uint64_t lookups, double seconds, uint64_t checksum) {
+        std::cout << std::left << std::setw(28) << label << std::right << std::setw(14) << std::fixed
+            << std::setprecision(0) << (seconds > 0 ? lookups / seconds : 0.0) << " lookups/sec  ("
+            << lookups << " in " << std::setprecision(4) << seconds << "s, checksum " << checksum << ")\n";
+    }
+
+    //Original PC --> line lookup: range check every CU then search that CU's line table
+    std::optional<dwarf::line_table::iterator> legacyLineLookup(const dwarf::dwarf& dw, uint64_t pc) {
+        for(const auto& cu : dw.compilation_units()) {
+            if(dwarf::die_pc_range(cu.root()).contains(pc)) {
+                const auto& lineTable = cu.get_line_table();
+                auto lineEntryItr = lineTable.find_address(pc);
+                if(lineEntryItr != lineTable.end()) return lineEntryItr;
+            }
+        }
+        return std::nullopt;
+    }
+
+    struct LegacyChunk {
+        uint64_t addrLow;
+        uint64_t addrHigh;
+        bool read, write, execute, shared;
+        std::string pathname;
+    };
+
+    //Original /proc/pid/maps parser: getline per line, string per pathname, offset/device/inode dropped
+    std::vector<LegacyChunk> legacyParseMaps(pid_t pid) {
+        std::vector<LegacyChunk> chunks;
+        std::ifstream file("/proc/" + std::to_string(pid) + "/maps");
+        std::string line;
+        while(std::getline(file, line, '\n')) {
+            uint64_t low = 0, high = 0;
+            std::string_view view(line);
+            auto dashPos = view.find_first_of('-');
+            auto spacePos = view.find_first_of(' ');
+            util::validHexStol(low, view.substr(0, dashPos));
+            util::validHexStol(high, view.substr(dashPos + 1, spacePos - (dashPos + 1)));
+            view = view.substr(spacePos + 1);
+            LegacyChunk c{low, high, view[0] == 'r', view[1] == 'w', view[2] == 'x', view[3] == 's', ""};
+            c.pathname = std::string(view.substr(view.find_last_of(" \t") + 1));
+            chunks.push_back(std::move(c));
+        }
+        return chunks;
+    }
+}
+
+
+void Debugger::runBenchmark(const std::string& name, uint64_t iterations) {
+    if(name == "lines") {
+        indexes_.finish();      //the legacy scan reads line tables, background indexing must be done with them
+        loadDwarfSections();
+        auto buildStart = Clock::now();
+        LineIndex index(dwarf_, pool_);
+        double buildTime = secondsSince(buildStart);
+
+        if(!index.initialized()) {
+            std::cout << "[warning] No line table rows to benchmark.\n";
+            return;
+        }
+
+        std::vector<uint64_t> samples(iterations);
+        std::mt19937_64 rng(0x5eed);
+        std::uniform_int_distribution<size_t> pickRow(0, index.size() - 1);
+        for(auto& pc : samples) pc = LineIndex::iterator(&index, pickRow(rng))->address;
+
+        std::cout << std::dec << "\n--------------------------------------------------------\n"
+            << "Compilation units: " << dwarf_.compilation_units().size() << "\n"
+            << "Line rows / files: " << index.size() << " / " << index.fileCount() << "\n"
+            << "Index build time: " << std::fixed << std::setprecision(4) << buildTime << "s\n";
+
+        uint64_t checksum = 0;
+        auto start = Clock::now();
+        for(auto pc : samples) {
+            auto it = index.find(pc);
+            if(it) checksum += it.value()->line;
+        }
+        printRate("Flat index:", samples.size(), secondsSince(start), checksum);
+
+        //The per-CU scan is orders of magnitude slower, cap it so large binaries finish
+        size_t legacyCount = std::min<size_t>(samples.size(), 20000);
+        checksum = 0;
+        start = Clock::now();
+        for(size_t i = 0; i < legacyCount; ++i) {
+            auto it = legacyLineLookup(dwarf_, samples[i]);
+            if(it) checksum += it.value()->line;
+        }
+        printRate("Per-CU scan:", legacyCount, secondsSince(start), checksum);
+        std::cout << "--------------------------------------------------------\n";
+    }
+    else if(name == "maps") {
+        /*
+            Give the debugger itself ~10k mappings: one large region where every other page is made 
+            read-only, so no two neighbouring pages can be merged into one VMA.
+        */
+        static constexpr size_t pages = 10000;
+        static constexpr size_t parses = 50;
+        const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        void* region = mmap(nullptr, pages * pageSize, PROT_READ | PROT_WRITE, 
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(region == MAP_FAILED) {
+            std::cout << "[error] Could not map benchmark region: " << strerror(errno) << "\n";
+            return;
+        }
+        auto base = std::bit_cast<uint64_t>(region);
+        for(size_t i = 0; i < pages; i += 2) {
+            mprotect(std::bit_cast<void*>(base + i * pageSize), pageSize, PROT_READ);
+        }
+
+        pid_t self = getpid();
+        auto start = Clock::now();
+        std::vector<LegacyChunk> legacy;
+        for(size_t i = 0; i < parses; ++i) legacy = legacyParseMaps(self);
+        double legacyParse = secondsSince(start);
+
+        MemoryMap map(self, std::filesystem::read_symlink("/proc/self/exe").string());
+        start = Clock::now();
+        for(size_t i = 0; i < parses; ++i) map.reload();
+        double fastParse = secondsSince(start);
+
+        std::vector<uint64_t> samples(iterations);
+        std::mt19937_64 rng(0x5eed);
+        std::uniform_int_distribution<uint64_t> pickAddr(base, base + pages * pageSize - 1);
+        for(auto& addr : samples) addr = pickAddr(rng);
+
+        std::cout << std::dec << "\n--------------------------------------------------------\n"
+            << "Mappings: " << map.getChunks().size() << " (legacy parser saw " << legacy.size() << ")\n"
+            << "Parse x" << parses << " (getline/fast): " << std::fixed << std::setprecision(4) 
+            << legacyParse << "s / " << fastParse << "s\n";
+
+        uint64_t checksum = 0;
+        start = Clock::now();
+        for(auto addr : samples) {
+            auto chunk = map.getChunkFromAddr(addr);
+            if(chunk) checksum += chunk.value().addrLow;
+        }
+        printRate("Sorted chunks:", samples.size(), secondsSince(start), checksum);
+
+        //Linear scan is O(mappings) per lookup, cap it so it finishes
+        size_t legacyCount = std::min<size_t>(samples.size(), 20000);
+        checksum = 0;
+        start = Clock::now();
+        for(size_t i = 0; i < legacyCount; ++i) {
+            for(const auto& c : legacy) {
+                if(c.addrLow <= samples[i] && samples[i] < c.addrHigh) {
+                    checksum += c.addrLow;
+                    break;
+                }
+            }
+        }
+        printRate("Linear scan:", legacyCount, secondsSince(start), checksum);
+        std::cout << "--------------------------------------------------------\n";
+        munmap(region, pages * pageSize);
+    }
+    else if(name == "breakpoints") {
+        //Every distinct statement address without a breakpoint, up to iterations, patched in and out again
+        const auto& lines = indexes_.getLineIndex();
+        std::vector<Breakpoint> bps;
+        std::unordered_set<intptr_t> seen;
+        for(auto row = lines.begin(); row != lines.end() && bps.size() < iterations; ++row) {
+            auto addr = std::bit_cast<intptr_t>(addLoadAddress(row->address));
+            if(!row->isStmt || row->endSequence || addrToBp_.contains(addr) || !seen.insert(addr).second) continue;
+            bps.emplace_back(&mem_, addr);
+        }
+        if(bps.empty()) {
+            std::cout << "[warning] No statement addresses to benchmark.\n";
+            return;
+        }
+
+        auto syscalls = [this]() { return mem_.getStats().readSyscalls + mem_.getStats().writeSyscalls; };
+        mem_.invalidate();      //both runs start from a cold page cache
+        auto calls = syscalls();
+        auto start = Clock::now();
+        size_t single = 0;
+        for(auto& bp : bps) single += bp.enable();
+        for(auto& bp : bps) bp.disable();
+        double singleTime = secondsSince(start);
+        auto singleCalls = syscalls() - calls;
+
+        mem_.invalidate();
+        calls = syscalls();
+        start = Clock::now();
+        PatchBatch batch(&mem_);
+        for(auto& bp : bps) batch.enable(bp);
+        size_t batched = batch.apply();
+        for(auto& bp : bps) batch.disable(bp);
+        batch.apply();
+        double batchTime = secondsSince(start);
+        auto batchCalls = syscalls() - calls;
+
+        std::cout << std::dec << "\n--------------------------------------------------------\n"
+            << "Breakpoints (enabled one at a time/batched): " << single << " / " << batched << "\n"
+            << "One at a time: " << std::fixed << std::setprecision(4) << singleTime << "s, " 
+            << singleCalls << " syscalls\n"
+            << "Batched by page: " << batchTime << "s, " << batchCalls << " syscalls\n"
+            << "--------------------------------------------------------\n";
+    }
+    else {
+        std::cout << "[error] Unknown benchmark! Available: lines, maps, breakpoints\n";
+    }
+}
@@ -1,16 +1,17 @@
 #include "../include/breakpoint.h"
+#include "../include/inferiormemory.h"
 
-#include <sys/ptrace.h>
 #include <sys/types.h>
 #include <cstdint>
 #include <cstring> 
 #include <cerrno>
 #include <iostream>
+#include <bit>
 
 
 //Breakpoint Methods
 // Breakpoint::Breakpoint() = default;
-Breakpoint::Breakpoint(pid_t pid, std::intptr_t addr) : pid_(pid), addr_(addr), enabled_(false), data_(0) {}
+Breakpoint::Breakpoint(InferiorMemory* mem, std::intptr_t addr) : mem_(mem), addr_(addr), enabled_(false), data_(0) {}
 
 // Breakpoint::Breakpoint(Breakpoint&&) = default;
 // Breakpoint& Breakpoint::operator=(Breakpoint&&) = default;
@@ -22,41 +23,38 @@ Breakpoint::Breakpoint(pid_t pid, std::intptr_t addr) : pid_(pid), addr_(addr),
 bool Breakpoint::isEnabled() const {return enabled_;}     
 std::uint8_t Breakpoint::getData() const {return data_;} 
 std::intptr_t Breakpoint::getAddr() const {return addr_;}; 
+void Breakpoint::setData(std::uint8_t data) {data_ = data;}
+void Breakpoint::setEnabled(bool enabled) {enabled_ = enabled;}
 
 
 
-bool Breakpoint::enable() { //Optimize?  
-    constexpr std::uint64_t int3 = 0xcc;
-    auto word = ptrace(PTRACE_PEEKDATA, pid_, addr_, nullptr);
-    
-    //Linux is little endian, LSB is first. 0xFF --> 0000 ...00 1111 1111
-    data_ = static_cast<std::uint8_t>(word & mask_);
-    word = (word & ~mask_) | int3;
-
+/*
+    Both functions patch a single byte through InferiorMemory rather than a PEEKDATA/POKEDATA word pair. 
+    The original byte is usually already in the stop's page cache, and the write goes straight to 
+    /proc/pid/mem since text pages are not writable. Writing through the cache also keeps cached pages 
+    coherent with the int3s in memory.
+*/
+bool Breakpoint::enable() {
+    std::uint8_t original;
     errno = 0;
-    long res = ptrace(PTRACE_POKEDATA, pid_, addr_, word);
-
-    if(res == -1) {
+    if(mem_->read(std::bit_cast<std::uint64_t>(addr_), &original, 1) != 1 || 
+            mem_->write(std::bit_cast<std::uint64_t>(addr_), &int3, 1, false) != 1) {
         std::cerr << "[critical] Enable Breakpoint has failed: " << strerror(errno) << "\n";
         return false;
     }
 
+    data_ = original;
     enabled_ = true;
     return true;
 }
 
 bool Breakpoint::disable() { 
-    auto word = ptrace(PTRACE_PEEKDATA, pid_, addr_, nullptr);  
-    word = ((word & ~mask_) | data_);
-
     errno = 0;
-    long res = ptrace(PTRACE_POKEDATA, pid_, addr_, word);
-
-    if(res == -1) {
+    if(mem_->write(std::bit_cast<std::uint64_t>(addr_), &data_, 1, false) != 1) {
         std::cerr << "[critical] Disable Breakpoint has failed: " << strerror(errno) << "\n";
         return false;
     }
 
     enabled_ = false;
     return true;
-}
\ No newline at end of file
+}
@@ -1,6 +1,9 @@
 #include "../include/debugger.h"
 #include "../include/breakpoint.h"
 #include "../include/memorymap.h"
+#include "../include/debugregisters.h"
+#include "../include/pagewatchpoints.h"
+#include "../include/tracepoint.h"
 #include "../include/util.h"
 
 #include <dwarf/dwarf++.hh>
@@ -16,6 +19,7 @@
 #include <vector>
 #include <cstdint>
 #include <filesystem>
+#include <sys/mman.h>
 
 
 using util::validDecStol;
@@ -28,11 +32,11 @@ using util::promptYesOrNo;
 */
 
 std::pair<std::unordered_map<intptr_t, Breakpoint>::iterator, bool>
-     Debugger::setBreakpointAtAddress(std::intptr_t address/*, bool skipLineTableCheck*/) {
+     Debugger::setBreakpointAtAddress(std::intptr_t address, PatchBatch* batch) {
     
     //First check if it is within an executable memory region or in main process memory space
     auto chunk = memMap_.getChunkFromAddr(address);
-    if(!chunk || !((chunk.value().get().canExecute()) || chunk.value().get().isPathtypeExec())) {
+    if(!chunk || !((chunk.value().canExecute()) || chunk.value().isPathtypeExec())) {
         std::cerr << "[error] Invalid Memory Address!";
         return {addrToBp_.end(), false};
     }
@@ -47,8 +51,10 @@ std::pair<std::unordered_map<intptr_t, Breakpoint>::iterator, bool>
         return {addrToBp_.end(), false};
     } */
 
-    auto [it, inserted] = addrToBp_.emplace(address, Breakpoint(pid_, address));
-    if(inserted) {
+    //With a batch the new breakpoint is only queued, the caller erases it if the batch fails to enable it
+    auto [it, inserted] = addrToBp_.emplace(address, Breakpoint(&mem_, address));
+    if(inserted && batch) batch->enable(it->second);
+    else if(inserted) {
         if(!it->second.enable()) {  //checks for success of breakpoint::enable()
             std::cerr << "[error] Invalid Memory Address!";
             addrToBp_.erase(it);
@@ -62,71 +68,44 @@ std::pair<std::unordered_map<intptr_t, Breakpoint>::iterator, bool>
 
 std::pair<std::unordered_map<intptr_t, Breakpoint>::iterator, bool> 
      Debugger::setBreakpointAtFunctionName(const std::string_view name) {
-    std::vector<dwarf::die> matching;
     //std::cout << "NAME = |" << name << "| " << std::dec << name.length() << std::endl;
-    for(const auto& [cu, offset] : functionDies_) {
-        int count = 0;
-        for(const auto& die : cu->root()) {
-            if(die.get_unit_offset() == offset[count] && die.has(dwarf::DW_AT::name)) {
-                if(dwarf::at_name(die) == name)
-                    matching.push_back(die);
-                ++count;
-            }
-        }
-    }
-    auto optionalAddr = handleDuplicateFunctionNames(name, matching);
+    const auto partial = indexes_.loadUnitsForName(name);
+    const auto& functionIndex = (partial ? partial.value().functions : indexes_.getFunctionIndex());
+    auto matching = functionIndex.findByName(name);
+    auto optionalAddr = handleDuplicateFunctionNames(name, functionIndex, matching);
     if(optionalAddr)
         return setBreakpointAtAddress(optionalAddr.value());
     return {addrToBp_.end(), false};    
 }
 
-/* Handle Duplicate function names. Takes in a const ref to a vector of dies. */
+/* 
+    Handle Duplicate function names. Takes in the index that found them and a const ref to a vector of its
+    function records. The breakpoint goes on the function's prologue-end address so arguments are already in
+    place when it is hit.
+*/
 std::optional<intptr_t>Debugger::handleDuplicateFunctionNames(const std::string_view name, 
-     const std::vector<dwarf::die>& functions) {
+     const FunctionIndex& functionIndex, const std::vector<FunctionIndex::FunctionRef>& functions) {
        
     if(functions.empty()) return std::nullopt;
     else if(functions.size() == 1) {
-        auto low = dwarf::at_low_pc(functions[0]);
-        auto lineEntryItr = getLineEntryFromPC(low);
-        if(!lineEntryItr) {
-            throw std::logic_error("[fatal] In Debugger::setBreakpointAtFunctionName() - "
-                "function definition with low pc does not have valid line entry\n");
-        }
-        auto entry = lineEntryItr.value();
-        auto addr = (++entry)->address;
-        return std::bit_cast<intptr_t>(addLoadAddress(addr));
+        return std::bit_cast<intptr_t>(addLoadAddress(functions[0].get().prologueEnd));
     }
 
-    auto funcLocation = [] (dwarf::line_table::iterator& it) {
-        std::filesystem::path path(it->file->path);
+    auto funcLocation = [] (LineIndex::iterator& it) {
+        std::filesystem::path path(it.getFilePath());
         std::string location = path.filename().string() + ":" + std::to_string(it->line);
         return location;
     };
 
     std::cout << "\n[info] Multiple matches found for '" << name << "':\n";
     int count = 0;
-    auto symbols = symMap_.getSymbolListFromName(std::string(name), false);
-    for(const auto& die : functions) {
-        // auto& die = dieRef.get();
-        auto low = dwarf::at_low_pc(die);
-        auto lineEntryItr = getLineEntryFromPC(low);
-        std::string fullName = "";
-        for(auto symbol : symbols) {    //resolve the symbol name of the function (with parameters)
-            if(symbol.addr == low && symbol.s == SymbolMap::Sym::func) {
-                fullName = symbol.name;
-                break;
-            }
-        }
-        if(!lineEntryItr) {
-            throw std::logic_error("[fatal] In Debugger::setBreakpointAtFunctionName() - "
-                "function definition with low pc does not have valid line entry\n");
-        }
-        auto entry = lineEntryItr.value();
-        //if symbol name could not be found, just use die's name
-        if(fullName.length() == 0) fullName = dwarf::at_name(die);
-
-        std::cout << std::dec << "\t[" << count++ << "] " << fullName
-            << " at " << funcLocation(entry) << "\n";
+    for(const auto& funcRef : functions) {
+        const auto& func = funcRef.get();
+        auto lineEntryItr = getLineEntryFromPC(func.entry);
+        std::string location = (lineEntryItr ? funcLocation(lineEntryItr.value()) 
+            : std::string(functionIndex.getUnitName(func.unit)));
+        std::cout << std::dec << "\t[" << count++ << "] " << functionIndex.getDisplayName(func) 
+            << " at " << location << "\n";
     }
 
     std::cout << "\n[info] Select one to set a breakpoint (or abort): ";
@@ -136,11 +115,7 @@ std::optional<intptr_t>Debugger::handleDuplicateFunctionNames(const std::string_
     uint64_t index;
 
     if(validDecStol(index, selection) && index < functions.size()) {
-        auto& die = functions[index];
-        auto lineEntry = getLineEntryFromPC(dwarf::at_low_pc(die));
-        auto addr = (++(lineEntry.value()))->address;
-        //std::cout << "\n";
-        return std::bit_cast<intptr_t>(addLoadAddress(addr));
+        return std::bit_cast<intptr_t>(addLoadAddress(functions[index].get().prologueEnd));
     }
     return std::nullopt;
 }
@@ -149,56 +124,76 @@ std::optional<intptr_t>Debugger::handleDuplicateFunctionNames(const std::string_
 
 
 
-std::pair<std::unordered_map<intptr_t, Breakpoint>::iterator, bool> 
+/*
+    Every file whose path ends with the given path is a candidate, if several have code on the line the user
+    picks one. Each code location of the line in that file gets a breakpoint: separate functions (template
+    instances, inlined copies) and separate fragments of one function (hot/cold splits) all count. Within a 
+    single fragment only the lowest address is used, otherwise a loop header would stop on every iteration.
+
+    While indexing is still running, only the units compiled from file are read (or waited for) and the
+    lookup runs on indexes merged from those alone. Lines of headers need every unit, so a file that is not
+    the main file of any unit waits for the global indexes (in lazy mode, for the units that list it).
+*/
+std::vector<std::pair<std::unordered_map<intptr_t, Breakpoint>::iterator, bool>> 
      Debugger::setBreakpointAtSourceLine(const std::string_view file, const unsigned line) {
-    std::vector<std::pair<std::string, intptr_t>> filepathAndAddr;
-    std::filesystem::path filePath(file);
-
-    for(auto& cu : dwarf_.compilation_units()) {
-        auto& root = cu.root();
-        if(root.has(dwarf::DW_AT::name)) {      //check conflicting filepaths
-            std::filesystem::path diePath(dwarf::at_name(root));  
-            if(diePath.filename() == filePath.filename()) {
-                auto& lt = cu.get_line_table();
-                for(auto entry : lt) {
-                    if(entry.line == line && entry.is_stmt ) {
-                        auto addr = std::bit_cast<intptr_t>(entry.address);
-                        //return setBreakpointAtAddress(addr);
-                        filepathAndAddr.push_back({dwarf::at_name(root), addr});
-                        break;
-                    }
-                }
+    const auto partial = indexes_.loadUnitsForFile(file);
+    const auto& lineIndex = (partial ? partial.value().lines : indexes_.getLineIndex());
+    const auto& functionIndex = (partial ? partial.value().functions : indexes_.getFunctionIndex());
+
+    std::vector<std::pair<uint32_t, std::vector<uint64_t>>> fileAndAddrs;
+    for(auto fileId : lineIndex.findFiles(file)) {
+        auto addrs = lineIndex.getLineAddresses(fileId, line);
+        if(!addrs.empty()) fileAndAddrs.push_back({fileId, std::move(addrs)});
+    }
+
+    std::vector<std::pair<std::unordered_map<intptr_t, Breakpoint>::iterator, bool>> result;
+    auto optionalIndex = handleDuplicateFilenames(file, lineIndex, fileAndAddrs);
+    if(!optionalIndex) return result;
+
+    std::unordered_map<uint64_t, uint64_t> fragmentToAddr;      //fragment low --> lowest address in it
+    std::vector<uint64_t> locations;
+    for(auto addr : fileAndAddrs[optionalIndex.value()].second) {   //sorted, so first per fragment is lowest
+        auto func = functionIndex.find(addr);
+        if(!func) {
+            locations.push_back(addr);
+            continue;
+        }
+        for(const auto& range : functionIndex.getRanges(func.value())) {
+            if(range.low <= addr && addr < range.high && fragmentToAddr.emplace(range.low, addr).second) {
+                locations.push_back(addr);
+                break;
             }
         }
     }
-    auto optionalAddr = handleDuplicateFilenames(file, filepathAndAddr);
-    if(optionalAddr)
-        return setBreakpointAtAddress(optionalAddr.value());
-    return {addrToBp_.end(), false};
-}
 
-std::optional<intptr_t>Debugger::handleDuplicateFilenames( const std::string_view filepath, const std::vector<std::pair<std::string, intptr_t>>& fpAndAddr)  {
-    if(fpAndAddr.empty()) return std::nullopt;
-    else if(fpAndAddr.size() == 1) {     //comment this else-if block out when testing
-        auto addr = fpAndAddr[0].second;
-        return std::bit_cast<intptr_t>(addLoadAddress(addr));
+    for(auto addr : locations) {
+        auto [it, inserted] = setBreakpointAtAddress(std::bit_cast<intptr_t>(addLoadAddress(addr)));
+        if(it != addrToBp_.end()) result.push_back({it, inserted});
     }
+    return result;
+}
+
+//Returns the index of the selected file
+std::optional<size_t> Debugger::handleDuplicateFilenames(const std::string_view filepath, 
+    const LineIndex& lineIndex, const std::vector<std::pair<uint32_t, std::vector<uint64_t>>>& fileAndAddrs) {
+    if(fileAndAddrs.empty()) return std::nullopt;
+    else if(fileAndAddrs.size() == 1) return 0;     //comment this else-if block out when testing
+
     std::cout << "\n[info] Multiple matches found for '" << filepath << "':\n";
     int count = 0;
-    for(const auto&[fp, addr] : fpAndAddr) {
-        std::cout << std::dec << "\t[" << count++ << "] " << fp
-            << " at 0x" << std::hex << std::uppercase << addr 
-            << " (0x" << addLoadAddress(addr) << ")\n";
+    for(const auto& [fileId, addrs] : fileAndAddrs) {
+        std::cout << std::dec << "\t[" << count++ << "] " << lineIndex.getFilePath(fileId)
+            << " at 0x" << std::hex << std::uppercase << addrs.front() 
+            << " (0x" << addLoadAddress(addrs.front()) << ")"
+            << (addrs.size() > 1 ? " +" + std::to_string(addrs.size() - 1) + " more" : "") << "\n";
     }
  
     std::cout << "\n[info] Select one to set a breakpoint (or abort): ";
     std::string selection;
     std::cin >> selection;
-    count = 0;
     uint64_t index;
-    if(validDecStol(index, selection) && index < fpAndAddr.size()) {
-        auto addr = std::bit_cast<uint64_t>(fpAndAddr[index].second);
-        return std::bit_cast<intptr_t>(addLoadAddress(addr));
+    if(validDecStol(index, selection) && index < fileAndAddrs.size()) {
+        return index;
     }
     return std::nullopt;
 }
@@ -229,6 +224,8 @@ void Debugger::removeBreakpoint(intptr_t address) {
             it->second.disable();
         }
         addrToBp_.erase(address);
+        conditions_.erase(address);
+        tracepoints_.erase(address);
     }
 }
 
@@ -252,6 +249,8 @@ void Debugger::removeBreakpoint(std::unordered_map<intptr_t, Breakpoint>::iterat
         if(it->second.isEnabled()) {
             it->second.disable();
         }
+        conditions_.erase(it->first);
+        tracepoints_.erase(it->first);
         addrToBp_.erase(it);
     }
 }
@@ -273,6 +272,132 @@ void Debugger::dumpBreakpoints() const {
             << " 0x" << std::hex << std::uppercase << addr 
             << " (0x" << offsetLoadAddress(addr) << ")"
             " [" << ((it.second.isEnabled()) ? "enabled" : "disabled") << "]";
+        if(auto cond = conditions_.find(it.first); cond != conditions_.end()) {
+            std::cout << " if " << cond->second.getSource();
+        }
+        if(auto tp = tracepoints_.find(it.first); tp != tracepoints_.end()) {
+            std::cout << " trace " << tp->second.getSource();
+        }
     }
     std::cout << std::endl;
-}
\ No newline at end of file
+}
+
+
+/*
+    Execute breakpoints need an executable address like software ones, watchpoints any mapped address.
+    Slots are not merged, watching the same address twice takes two of the four slots.
+*/
+std::optional<size_t> Debugger::setHardwareBreakpoint(uint64_t addr, DebugRegisters::Kind kind, uint8_t length) {
+    auto chunk = memMap_.getChunkFromAddr(addr);
+    if(!chunk || (kind == DebugRegisters::Kind::execute && !chunk.value().canExecute() 
+            && !chunk.value().isPathtypeExec())) {
+        std::cerr << "[error] Invalid Memory Address!";
+        return std::nullopt;
+    }
+    if(debugRegs_.find(addr, kind)) {
+        std::cerr << "[error] Hardware " << DebugRegisters::getKindName(kind) << " breakpoint already exists!";
+        return std::nullopt;
+    }
+    auto slot = debugRegs_.set(addr, kind, length);
+    if(!slot) {
+        std::cerr << "[error] No free debug register, or the address is not aligned to the length!";
+    }
+    return slot;
+}
+
+bool Debugger::removeHardwareBreakpoint(size_t slot) {
+    if(!debugRegs_.clear(slot)) {
+        std::cerr << "[error] No hardware breakpoint in slot " << std::dec << slot << "!";
+        return false;
+    }
+    return true;
+}
+
+void Debugger::dumpHardwareBreakpoints() const {
+    if(!debugRegs_.active()) {
+        std::cout << "[error] No hardware breakpoints set!";
+        return;
+    }
+    const auto& slots = debugRegs_.getSlots();
+    for(size_t i = 0; i < slots.size(); ++i) {
+        if(!slots[i].used) continue;
+        std::cout << "\n" << std::dec << "DR" << i << ") 0x" << std::hex << std::uppercase << slots[i].addr 
+            << " (0x" << offsetLoadAddress(slots[i].addr) << ") [" << DebugRegisters::getKindName(slots[i].kind)
+            << ", " << std::dec << static_cast<unsigned>(slots[i].length) << " byte" 
+            << (slots[i].length > 1 ? "s" : "") << "]";
+    }
+    std::cout << std::endl;
+}
+
+//Every page of the range must be writable or already watched, pages keep whatever else they allow
+std::optional<uint64_t> Debugger::setPageWatchpoint(uint64_t addr, uint64_t length) {
+    static constexpr uint64_t pageSize = PageWatchpoints::pageSize;
+    if(length == 0 || addr > UINT64_MAX - length) {
+        std::cerr << "[error] Invalid watch range!";
+        return std::nullopt;
+    }
+    for(uint64_t page = addr & ~(pageSize - 1); page < addr + length; page += pageSize) {
+        if(pageWatch_.getPage(page)) continue;
+        auto chunk = memMap_.getChunkFromAddr(page);
+        if(!chunk || !chunk.value().canWrite()) {
+            std::cerr << "[error] Page 0x" << std::hex << std::uppercase << page << " is not writable memory!";
+            return std::nullopt;
+        }
+    }
+
+    auto [id, runs] = pageWatch_.add(addr, length, [this](uint64_t page) {
+        auto perms = memMap_.getChunkFromAddr(page).value().perms;
+        return (perms.read ? PROT_READ : 0) | (perms.write ? PROT_WRITE : 0) | (perms.execute ? PROT_EXEC : 0);
+    });
+    if(!protectPages(runs, true)) {
+        protectPages(pageWatch_.remove(id).value(), false);
+        std::cerr << "[error] Could not write protect the watched pages!";
+        return std::nullopt;
+    }
+    return id;
+}
+
+bool Debugger::removePageWatchpoint(uint64_t id) {
+    auto runs = pageWatch_.remove(id);
+    if(!runs) {
+        std::cerr << "[error] No page watchpoint #" << std::dec << id << "!";
+        return false;
+    }
+    if(!protectPages(runs.value(), false)) {
+        std::cerr << "[warning] Some unwatched pages could not get their protection back!";
+    }
+    return true;
+}
+
+void Debugger::dumpPageWatchpoints() const {
+    if(pageWatch_.empty()) {
+        std::cout << "[error] No page watchpoints set!";
+        return;
+    }
+    static constexpr uint64_t pageSize = PageWatchpoints::pageSize;
+    for(const auto& [id, wp] : pageWatch_.getWatchpoints()) {
+        uint64_t pages = ((wp.addr + wp.length + pageSize - 1) & ~(pageSize - 1)) / pageSize 
+            - (wp.addr & ~(pageSize - 1)) / pageSize;
+        std::cout << "\n#" << std::dec << id << ") 0x" << std::hex << std::uppercase << wp.addr << " - 0x" 
+            << wp.addr + wp.length << std::dec << " [" << wp.length << " bytes, " << pages << " page" 
+            << (pages > 1 ? "s" : "") << "] hits: " << wp.hits << ", false hits: " << wp.falseHits;
+    }
+    std::cout << std::endl;
+}
+
+void Debugger::dumpTracepoints() const {
+    if(tracepoints_.empty()) {
+        std::cout << "[error] No tracepoints set!";
+        return;
+    }
+    for(const auto& [addr, tp] : tracepoints_) {
+        const auto& stats = tp.getStats();
+        std::cout << "\n0x" << std::hex << std::uppercase << addr << " (0x" 
+            << offsetLoadAddress(std::bit_cast<uint64_t>(addr)) << ") " << tp.getSource() << std::dec
+            << "\n    hits: " << stats.hits << ", logged: " << stats.logged << ", ignored: " << stats.ignored 
+            << ", rate limited: " << stats.limited;
+        if(tp.getIgnoreCount()) std::cout << ", ignoring next " << tp.getIgnoreCount();
+        if(tp.getRateLimit()) std::cout << ", limit " << tp.getRateLimit() << "/s";
+    }
+    std::cout << "\n[info] Trace output: " << traceLog_.getPath() << std::endl;
+}
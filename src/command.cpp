@@ -4,6 +4,9 @@
 #include "../include/state.h"
 #include "../include/register.h"
 #include "../include/breakpoint.h"
+#include "../include/debugregisters.h"
+#include "../include/condition.h"
+#include "../include/tracepoint.h"
 
 #include <linenoise.h>
 #include <dwarf/dwarf++.hh>
@@ -16,6 +19,10 @@
 #include <unordered_map>
 #include <bit>
 #include <algorithm>
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <cerrno>
 //#include 
 
 
@@ -24,6 +31,20 @@ using namespace util;
 using namespace reg;
 using namespace state;
 
+namespace {
+    //Commands that neither resume the child nor touch breakpoints or memory keep the resident step plan
+    bool keepsStepPlan(const std::string& cmd) {
+        if(isPrefix(cmd, "continue_execution") || isPrefix(cmd, "breakpoint") || isPrefix(cmd, "step_in") 
+            || isPrefix(cmd, "finish")) return false;
+        return isPrefix(cmd, "next") || isPrefix(cmd, "pid") || isPrefix(cmd, "symbol_lookup") 
+            || isPrefix(cmd, "backtrace") || cmd == "register_read" || cmd == "rr" || cmd == "dump_registers" 
+            || cmd == "dr" || cmd == "program_counter" || cmd == "pc" || cmd == "sl" || cmd == "stats" 
+            || cmd == "dump_hardware" || cmd == "dh" 
+            || cmd == "dump_page_watchpoints" || cmd == "dpw" || cmd == "dump_tracepoints" || cmd == "dt" 
+            || cmd == "help";
+    }
+}
+
 //Debugger function: run()
 void Debugger::run() {
     //debugger has control after ptrace TRACE_ME
@@ -36,6 +57,8 @@ void Debugger::run() {
         if(handleCommand(line, prevArgs)) {std::cout << std::endl;} //bool return for spacing/flushing
         linenoiseHistoryAdd(line);  //may need to initialize history
         linenoiseFree(line);
+        indexes_.trimUnits();       //nothing from a lazily read unit outlives the command
+        if(config_->timings_ && !startupTimesShown_ && indexes_.isFinished()) dumpStartupTimes();
     }
 
     handleChildState();
@@ -51,6 +74,7 @@ bool Debugger::handleCommand(const std::string& args, std::string& prevArgs) {
     argv = splitLine(input, ' ');
     if(argv.empty()) return false;
     prevArgs = input;
+    if(!keepsStepPlan(argv[0])) retireStepPlan();
 
     if(isPrefix(argv[0], "continue_execution")) {
         std::cout << "[debug] Continue Execution...\n" << std::endl;
@@ -62,11 +86,11 @@ bool Debugger::handleCommand(const std::string& args, std::string& prevArgs) {
     else if(argv[0] == "debug") {   //Change size of symbolCache
         uint64_t num;
         if(argv.size() > 1 && argv[1].length() > 0 && validDecStol(num, argv[1])) {
-            std::cout << "prev cache size: " << std::dec << symMap_.getMaxSymbolCacheSize() << "\n";
+            std::cout << "prev cache size: " << std::dec << indexes_.getSymbolMap().getMaxSymbolCacheSize() << "\n";
             std::string random;
             handleCommand("ds", random);
-            symMap_.setMaxSymbolCacheSize(static_cast<size_t>(num));
-            std::cout << "curr cache size: " << std::dec << symMap_.getMaxSymbolCacheSize() << "\n";
+            indexes_.getSymbolMap().setMaxSymbolCacheSize(static_cast<size_t>(num));
+            std::cout << "curr cache size: " << std::dec << indexes_.getSymbolMap().getMaxSymbolCacheSize() << "\n";
             handleCommand("ds", random);
         }
         else std::cout << "[error] Cache size is invalid!";
@@ -79,22 +103,47 @@ bool Debugger::handleCommand(const std::string& args, std::string& prevArgs) {
                 return true;
             }
             std::cout << "prev str length: " << std::dec 
-                << static_cast<size_t>(symMap_.getMinCachedStringLength()) << "\n";
+                << static_cast<size_t>(indexes_.getSymbolMap().getMinCachedStringLength()) << "\n";
             std::string random;
             handleCommand("ds", random);
-            symMap_.setMinCachedStringLength(static_cast<uint8_t>(num));
+            indexes_.getSymbolMap().setMinCachedStringLength(static_cast<uint8_t>(num));
             std::cout << "curr str length: " << std::dec 
-                << static_cast<size_t>(symMap_.getMinCachedStringLength()) << "\n";
+                << static_cast<size_t>(indexes_.getSymbolMap().getMinCachedStringLength()) << "\n";
             handleCommand("ds", random);
         }
         else std::cout << "[error] Key length is invalid!";
     }
     else if(isPrefix(argv[0], "breakpoint")) {
         //std::cout << "Placing breakpoint\n";
+        //breakpoint <location> if <expr> --> validated before any breakpoint is set, then compiled per location
+        std::optional<std::string> condition;
+        if(auto ifPos = std::find(argv.begin(), argv.end(), "if"); argv.size() > 1 && ifPos > argv.begin() + 1) {
+            std::string expr, error;
+            for(auto word = ifPos + 1; word != argv.end(); ++word) expr += (expr.empty() ? "" : " ") + *word;
+            if(!Condition::compile(expr, error)) {
+                std::cout << "[error] Invalid condition: " << error << "!\n[info] Conditions use C operators over "
+                    "registers (rdi), constants and loads (*expr), ex: rdi == 0x2A && *rsi != 0\n";
+                return true;
+            }
+            condition = std::move(expr);
+            argv.erase(ifPos, argv.end());
+        }
+        //An existing breakpoint only gets the new condition, returns true if that is all that happened
+        auto attachCondition = [&](std::intptr_t addr, bool inserted) {
+            if(!condition) return false;
+            std::string error;
+            conditions_.insert_or_assign(addr, Condition::compile(condition.value(), error).value());
+            if(!inserted) {
+                std::cout << "[debug] Breakpoint at 0x" << std::hex << std::uppercase << addr << " now stops if " 
+                    << condition.value() << "\n";
+            }
+            return !inserted;
+        };
+
         if(argv.size() < 2 || argv[1].length() < 1)
             std::cout << "[error] Please specify address, source line, or function name!";
-        //reordered because source files may begin with a number
-        else if(argv[1].find(':') != std::string::npos) {
+        //reordered because source files may begin with a number, "::" is a qualified function name
+        else if(argv[1].find(':') != std::string::npos && argv[1].find("::") == std::string::npos) {
             std::string_view file = argv[1]; 
             file = file.substr(0, file.find_last_of(':')); 
 
@@ -108,20 +157,25 @@ bool Debugger::handleCommand(const std::string& args, std::string& prevArgs) {
                 std::cout << "[error] Specify valid line number after ':'.";
                 return true;
             }
-            auto[it, inserted] = setBreakpointAtSourceLine(file, num);
+            auto locations = setBreakpointAtSourceLine(file, num);
 
-            if(it == addrToBp_.end()) {
+            if(locations.empty()) {
                 std::cout << "[error] Could not resolve filepath or line number!";
                 return true;
             }
-            else if(!inserted) {
-                std::cout << "[error] Breakpoint already exists!";
-                return true;
+            for(const auto& [it, inserted] : locations) {
+                if(attachCondition(it->first, inserted)) continue;
+                if(!inserted) {
+                    std::cout << "[error] Breakpoint already exists at 0x" << std::hex << std::uppercase 
+                        << it->first << "!\n";
+                    continue;
+                }
+                auto chunk = memMap_.getChunkFromAddr(std::bit_cast<uint64_t>(it->first));
+                auto memSpace = chunk ? MemoryMap::getFileNameFromChunk(chunk.value()) : "Unmapped Memory";
+                std::cout << "[debug] Setting Breakpoint at: " << argv[1] << " (0x" 
+                << std::hex << std::uppercase << it->first << ") --> " << memSpace 
+                << (condition ? " if " + condition.value() : "") << "\n";
             }
-            auto chunk = memMap_.getChunkFromAddr(std::bit_cast<uint64_t>(it->first));
-            auto memSpace = chunk ? MemoryMap::getFileNameFromChunk(chunk.value()) : "Unmapped Memory";
-            std::cout << "[debug] Setting Breakpoint at: " << argv[1] << " (0x" 
-            << std::hex << std::uppercase << it->first << ") --> " << memSpace  << "\n";
         }
         else if(argv[1][0] == '*' || ::isdigit(argv[1][0]))   {  //may change to stoull in future 
             uint64_t addr;
@@ -135,7 +189,7 @@ bool Debugger::handleCommand(const std::string& args, std::string& prevArgs) {
                     addr = addLoadAddress(addr);
                 }
                 auto [it, inserted] = setBreakpointAtAddress(std::bit_cast<intptr_t>(addr));
-                if(it == addrToBp_.end())
+                if(it == addrToBp_.end() || attachCondition(it->first, inserted))
                     return true;
                 else if(!inserted) {
                     std::cout << "[error] Breakpoint already exists!";
@@ -146,7 +200,7 @@ bool Debugger::handleCommand(const std::string& args, std::string& prevArgs) {
                 auto memSpace = chunk ? MemoryMap::getFileNameFromChunk(chunk.value()) : "Unmapped Memory";
                 std::cout << "[debug] Setting Breakpoint at: 0x" << std::hex << addr
                     << (relativeAddr ? " (0x" + std::string(stringViewAddr) + ") " : " ")
-                    << "--> " << memSpace  << "\n";
+                    << "--> " << memSpace << (condition ? " if " + condition.value() : "") << "\n";
             }
             else
                 std::cout << "[error] Invalid address!\n[info] Pass a valid relative address (*0x1234) "
@@ -159,6 +213,9 @@ bool Debugger::handleCommand(const std::string& args, std::string& prevArgs) {
                 std::cout << "[error] Could not resolve function name!";
                 return true;
             }
+            else if(attachCondition(it->first, inserted)) {
+                return true;
+            }
             else if(!inserted) {
                 std::cout << "[error] Breakpoint already exists!";
                 return true;
@@ -166,7 +223,7 @@ bool Debugger::handleCommand(const std::string& args, std::string& prevArgs) {
             auto chunk = memMap_.getChunkFromAddr(std::bit_cast<uint64_t>(it->first));
             auto memSpace = chunk ? MemoryMap::getFileNameFromChunk(chunk.value()) : "Unmapped Memory";
             std::cout << "[debug] Setting Breakpoint at: " << func << " (" << std::hex << it->first
-                    << ") --> " << memSpace  << "\n";
+                    << ") --> " << memSpace << (condition ? " if " + condition.value() : "") << "\n";
         }
 
     }
@@ -248,6 +305,210 @@ bool Debugger::handleCommand(const std::string& args, std::string& prevArgs) {
             std::cout << "[error] Please specify address!";
         
     }
+    else if(argv[0] == "trace" || argv[0] == "tp") {
+        //trace <location> "<format>" arg, arg... --> arguments are expressions, split at the commas
+        size_t open = input.find('"'), close = std::string::npos;
+        for(size_t i = open + 1; open != std::string::npos && i < input.length(); ++i) {
+            if(input[i] == '\\') ++i;
+            else if(input[i] == '"') {
+                close = i;
+                break;
+            }
+        }
+        if(argv.size() < 3 || close == std::string::npos || argv[1].find('"') != std::string::npos) {
+            std::cout << "[error] Usage: trace <location> \"<format>\" [arg, arg...]\n[info] Ex: trace foo "
+                "\"x = %d, name = %s\" rdi, *(rsp + 8)";
+            return true;
+        }
+        std::string_view format = std::string_view(input).substr(open + 1, close - open - 1);
+        std::vector<std::string_view> args;
+        auto rest = std::string_view(input).substr(close + 1);
+        while(!rest.empty() && rest.front() == ' ') rest.remove_prefix(1);
+        if(!rest.empty() && rest.front() == ',') rest.remove_prefix(1);      //gdb style "<format>", arg
+        while(!rest.empty()) {
+            auto arg = rest.substr(0, rest.find(','));
+            rest.remove_prefix(std::min(rest.length(), arg.length() + 1));
+            while(!arg.empty() && arg.front() == ' ') arg.remove_prefix(1);
+            while(!arg.empty() && arg.back() == ' ') arg.remove_suffix(1);
+            args.push_back(arg);
+        }
+        std::string error;
+        if(!Tracepoint::compile(format, args, error)) {
+            std::cout << "[error] Invalid tracepoint: " << error << "!";
+            return true;
+        }
+
+        //Same locations as breakpoint, an existing breakpoint becomes a tracepoint
+        std::vector<std::pair<std::unordered_map<intptr_t, Breakpoint>::iterator, bool>> locations;
+        auto colon = argv[1].find_last_of(':');
+        uint64_t num;
+        if(colon != std::string::npos && argv[1].find("::") == std::string::npos) {
+            if(validDecStol(num, std::string_view(argv[1]).substr(colon + 1)) && num <= UINT32_MAX) {
+                locations = setBreakpointAtSourceLine(std::string_view(argv[1]).substr(0, colon), num);
+            }
+        }
+        else if(argv[1][0] == '*' || ::isdigit(argv[1][0])) {
+            if(validHexStol(num, stripAddrPrefix(argv[1])) && num < UINT64_MAX - loadAddress_) {
+                if(argv[1][0] == '*') num = addLoadAddress(num);
+                locations.push_back(setBreakpointAtAddress(std::bit_cast<intptr_t>(num)));
+            }
+        }
+        else {
+            locations.push_back(setBreakpointAtFunctionName(argv[1]));
+        }
+        std::erase_if(locations, [this](auto& location) { return location.first == addrToBp_.end(); });
+        if(locations.empty()) {
+            std::cout << "[error] Could not resolve " << argv[1] << "!";
+            return true;
+        }
+
+        for(const auto& [it, inserted] : locations) {
+            tracepoints_.insert_or_assign(it->first, Tracepoint::compile(format, args, error).value());
+            std::cout << "[debug] " << (inserted ? "Setting tracepoint" : "Tracing breakpoint") << " at: " << argv[1] 
+                << " (0x" << std::hex << std::uppercase << it->first << ")\n";
+        }
+    }
+    else if(argv[0] == "trace_ignore" || argv[0] == "ti" || argv[0] == "trace_limit" || argv[0] == "tl" 
+            || argv[0] == "trace_delete" || argv[0] == "td") {
+        //trace_ignore <address> <hits>, trace_limit <address> <lines per second>, trace_delete <address>
+        bool remove = (argv[0] == "trace_delete" || argv[0] == "td");
+        uint64_t addr, count = 0;
+        if(argv.size() < (remove ? 2 : 3) || argv[1].empty() || !validHexStol(addr, stripAddrPrefix(argv[1])) 
+                || addr >= UINT64_MAX - loadAddress_ || (!remove && !validDecStol(count, argv[2]))) {
+            std::cout << "[error] Usage: " << argv[0] << " <address>" << (remove ? "" : " <count>");
+            return true;
+        }
+        if(argv[1][0] == '*') addr = addLoadAddress(addr);
+        auto it = tracepoints_.find(std::bit_cast<intptr_t>(addr));
+        if(it == tracepoints_.end()) {
+            std::cout << "[error] No tracepoint found at address: 0x" << std::hex << std::uppercase << addr;
+            return true;
+        }
+
+        if(remove) {
+            removeBreakpoint(it->first);
+            std::cout << "[debug] Tracepoint at 0x" << std::hex << std::uppercase << addr << " removed!";
+        }
+        else if(argv[0] == "trace_ignore" || argv[0] == "ti") {
+            it->second.setIgnoreCount(count);
+            std::cout << "[debug] Ignoring the next " << std::dec << count << " hits";
+        }
+        else {
+            it->second.setRateLimit(count);
+            std::cout << "[debug] Logging " << (count ? "at most " + std::to_string(count) + " lines per second" 
+                : "every hit");
+        }
+    }
+    else if(argv[0] == "trace_output" || argv[0] == "to") {
+        if(argv.size() < 2) {
+            std::cout << "[error] Please specify a file, or - for stdout!";
+            return true;
+        }
+        if(!traceLog_.open(argv[1])) {
+            std::cout << "[error] Could not open " << argv[1] << ": " << strerror(errno);
+            return true;
+        }
+        std::cout << "[debug] Trace output goes to " << (argv[1] == "-" ? "stdout" : argv[1]);
+    }
+    else if(argv[0] == "dump_tracepoints" || argv[0] == "dt") {
+        std::cout << "[debug] Dumping tracepoints...\n";
+        dumpTracepoints();
+    }
+    else if(argv[0] == "hardware_breakpoint" || argv[0] == "hb" || argv[0] == "watchpoint" || argv[0] == "wp") {
+        bool watch = (argv[0] == "watchpoint" || argv[0] == "wp");
+        uint64_t addr, length = 0;
+        if(argv.size() < 2 || argv[1].length() < 1) {
+            std::cout << "[error] Please specify address!";
+            return true;
+        }
+        bool relativeAddr = (argv[1][0] == '*');
+        if(!validHexStol(addr, stripAddrPrefix(argv[1])) || addr >= UINT64_MAX - loadAddress_) {
+            std::cout << "[error] Invalid address!\n[info] Pass a valid relative address (*0x1234) "
+                "or a valid absolute address (0xFFFFFFFF).";
+            return true;
+        }
+        if(relativeAddr) addr = addLoadAddress(addr);
+
+        //watchpoint <address> [1|2|4|8] [write|rw], the length defaults to the widest the alignment allows
+        auto kind = DebugRegisters::Kind::execute;
+        if(watch) {
+            kind = DebugRegisters::Kind::write;
+            size_t next = 2;
+            if(argv.size() > next && validDecStol(length, argv[next])) ++next;
+            else length = (addr % 8 == 0 ? 8 : addr % 4 == 0 ? 4 : addr % 2 == 0 ? 2 : 1);
+            if(argv.size() > next && argv[next] == "rw") kind = DebugRegisters::Kind::readWrite;
+            else if(argv.size() > next && argv[next] != "write") {
+                std::cout << "[error] Watchpoint kind must be write or rw!";
+                return true;
+            }
+            if(length > 8 || !DebugRegisters::validLength(static_cast<uint8_t>(length))) {
+                std::cout << "[error] Watchpoint length must be 1, 2, 4 or 8 bytes!";
+                return true;
+            }
+        }
+
+        auto slot = setHardwareBreakpoint(addr, kind, static_cast<uint8_t>(watch ? length : 1));
+        if(!slot) return true;
+        std::cout << "[debug] Setting hardware " << (watch ? "watchpoint" : "breakpoint") << " DR" << std::dec 
+            << slot.value() << " at: 0x" << std::hex << std::uppercase << addr << " (0x" 
+            << offsetLoadAddress(addr) << ")";
+    }
+    else if(argv[0] == "hardware_delete" || argv[0] == "hd") {
+        uint64_t slot;
+        if(argv.size() < 2 || !validDecStol(slot, argv[1]) || slot >= DebugRegisters::slotCount) {
+            std::cout << "[error] Please specify a debug register slot (0-3)!";
+            return true;
+        }
+        if(removeHardwareBreakpoint(static_cast<size_t>(slot))) {
+            std::cout << "[debug] Hardware breakpoint DR" << std::dec << slot << " removed!";
+        }
+    }
+    else if(argv[0] == "dump_hardware" || argv[0] == "dh") {
+        std::cout << "[debug] Dumping hardware breakpoints...\n";
+        dumpHardwareBreakpoints();
+    }
+    else if(argv[0] == "page_watchpoint" || argv[0] == "pw") {
+        //page_watchpoint <address> <length>, length is decimal or 0x prefixed hex
+        uint64_t addr, length;
+        if(argv.size() < 3 || argv[1].length() < 1) {
+            std::cout << "[error] Please specify address and length!";
+            return true;
+        }
+        bool relativeAddr = (argv[1][0] == '*');
+        if(!validHexStol(addr, stripAddrPrefix(argv[1])) || addr >= UINT64_MAX - loadAddress_) {
+            std::cout << "[error] Invalid address!\n[info] Pass a valid relative address (*0x1234) "
+                "or a valid absolute address (0xFFFFFFFF).";
+            return true;
+        }
+        if(relativeAddr) addr = addLoadAddress(addr);
+
+        auto stringViewLen = stripAddrPrefix(argv[2]);
+        bool hexLen = (stringViewLen.length() != argv[2].length());
+        if(!(hexLen ? validHexStol(length, stringViewLen) : validDecStol(length, stringViewLen)) || length == 0) {
+            std::cout << "[error] Please specify a valid length!";
+            return true;
+        }
+
+        auto id = setPageWatchpoint(addr, length);
+        if(!id) return true;
+        std::cout << "[debug] Setting page watchpoint #" << std::dec << id.value() << " at: 0x" << std::hex 
+            << std::uppercase << addr << " (0x" << offsetLoadAddress(addr) << "), " << std::dec << length 
+            << " bytes";
+    }
+    else if(argv[0] == "page_watchpoint_delete" || argv[0] == "pwd") {
+        uint64_t id;
+        if(argv.size() < 2 || !validDecStol(id, argv[1])) {
+            std::cout << "[error] Please specify a page watchpoint number!";
+            return true;
+        }
+        if(removePageWatchpoint(id)) {
+            std::cout << "[debug] Page watchpoint #" << std::dec << id << " removed!";
+        }
+    }
+    else if(argv[0] == "dump_page_watchpoints" || argv[0] == "dpw") {
+        std::cout << "[debug] Dumping page watchpoints...\n";
+        dumpPageWatchpoints();
+    }
     else if(argv[0] == "dump_breakpoints" || argv[0] == "db") {
         std::cout << "[debug] Dumping breakpoints...\n";
         dumpBreakpoints();
@@ -345,7 +606,7 @@ bool Debugger::handleCommand(const std::string& args, std::string& prevArgs) {
                 return true;
             }
             std::cout << "[debug] " << std::hex << std::uppercase
-                << argv[1] << ": 0x" << getRegisterValue(pid_, r);
+                << argv[1] << ": 0x" << getRegisterValue(regs_, r);
         } 
         else
             std::cout << "[error] Please specify register!";
@@ -361,7 +622,7 @@ bool Debugger::handleCommand(const std::string& args, std::string& prevArgs) {
                 return true;
             }
 
-            auto oldVal = getRegisterValue(pid_, r);
+            auto oldVal = getRegisterValue(regs_, r);
             uint64_t data; 
             if(!validHexStol(data, stringViewData)) {
                 std::cout << "[error] Please specify valid data!";
@@ -374,8 +635,8 @@ bool Debugger::handleCommand(const std::string& args, std::string& prevArgs) {
                 }
                 data = addLoadAddress(data);
             }
-            setRegisterValue(pid_, r, data); 
-            auto newReadData = getRegisterValue(pid_, r);
+            setRegisterValue(regs_, r, data); 
+            auto newReadData = getRegisterValue(regs_, r);
 
             std::cout << "[debug] " << std::hex << std::uppercase 
                 << argv[1] << ": " << oldVal << " --> " << newReadData
@@ -412,10 +673,49 @@ bool Debugger::handleCommand(const std::string& args, std::string& prevArgs) {
                 addr = addLoadAddress(addr);
             }
             
-            readMemory(addr, data);
             auto chunk = memMap_.getChunkFromAddr(addr);
             auto mappedSpace = (chunk ? MemoryMap::getFileNameFromChunk(chunk.value()) : "unmapped memory");
 
+            //read_memory <addr> <len> [fmt] --> ranged read, printed as a hexdump or in typed units
+            if(argv.size() > 2) {
+                uint64_t len;
+                auto stringViewLen = stripAddrPrefix(argv[2]);
+                bool hexLen = (stringViewLen.length() != argv[2].length());
+                if(!(hexLen ? validHexStol(len, stringViewLen) : validDecStol(len, stringViewLen)) 
+                        || len == 0 || len > maxMemoryDumpLength_) {
+                    std::cout << "[error] Please specify a valid length!\n[info] Length must be from 1-"
+                        << std::dec << maxMemoryDumpLength_ << " bytes inclusive.";
+                    return true;
+                }
+                char format = 'x';
+                if(argv.size() > 3) {
+                    if(argv[3].length() != 1 || std::string_view("xbhwg").find(argv[3][0]) == std::string_view::npos) {
+                        std::cout << "[error] Invalid format!\n[info] Use x (hexdump), b, h, w or g "
+                            "(1, 2, 4 or 8 byte units).";
+                        return true;
+                    }
+                    format = argv[3][0];
+                }
+
+                std::vector<uint8_t> bytes(len);
+                bytes.resize(readMemoryBlock(addr, bytes.data(), bytes.size()));
+                if(bytes.empty()) {
+                    std::cout << "[error] Could not read memory at 0x" << std::hex << std::uppercase << addr;
+                    return true;
+                }
+
+                std::cout << std::dec << "[debug] Read " << bytes.size() << " bytes from memory space " 
+                    << mappedSpace << " at 0x" << std::hex << std::uppercase << addr
+                    << (relativeAddr ? " (0x" + std::string(stringViewAddr) + ")" : "") << ":\n";
+                dumpMemory(addr, bytes, format);
+                if(bytes.size() < len) {
+                    std::cerr << std::dec << "[warning] Only " << bytes.size() << " of " << len 
+                        << " bytes could be read";
+                }
+                return true;
+            }
+
+            readMemory(addr, data);
             std::cout << std::hex << std::uppercase << "[debug] Read from memory space "
                 << mappedSpace << " at 0x" << addr 
                 << (relativeAddr ? " (0x" + std::string(stringViewAddr) + ") " : " ") 
@@ -430,10 +730,9 @@ bool Debugger::handleCommand(const std::string& args, std::string& prevArgs) {
             uint64_t data;
             bool relativeAddr = (!argv[1].empty() && argv[1][0] == '*');
             auto stringViewAddr = stripAddrPrefix(argv[1]);
-            auto stringData = stripAddrPrefix(argv[2]);
 
-            if(!validHexStol(addr, stringViewAddr) || !validHexStol(data, stringData)) {
-                std::cout << "[error] Please specify valid memory address and data!";
+            if(!validHexStol(addr, stringViewAddr)) {
+                std::cout << "[error] Please specify valid memory address!";
                 return true;
             }
         
@@ -444,22 +743,99 @@ bool Debugger::handleCommand(const std::string& args, std::string& prevArgs) {
                 }
                 addr = addLoadAddress(addr);
             }
+            auto chunk = memMap_.getChunkFromAddr(addr);
+            auto mappedSpace = (chunk ? MemoryMap::getFileNameFromChunk(chunk.value()) : "unmapped memory");
+
+            /*
+                Bulk sources, each written with a single writeMemoryBlock() call:
+                    wm <addr> bytes <hex> [hex...]      --> byte string in memory order (ex: DEADBEEF)
+                    wm <addr> fill <hex> <len>          --> byte pattern repeated over len bytes
+                    wm <addr> file <path> [offset] [len] --> contents of a local file
+            */
+            if(argv[2] == "bytes" || argv[2] == "fill" || argv[2] == "file") {
+                std::vector<uint8_t> bytes;
+                auto validLength = [](uint64_t& len, std::string_view s) {
+                    auto stripped = stripAddrPrefix(s);
+                    return (stripped.length() != s.length() ? validHexStol(len, stripped) : validDecStol(len, s));
+                };
+
+                if(argv[2] == "bytes") {
+                    for(size_t i = 3; i < argv.size(); i++) {
+                        if(!validHexBytes(bytes, argv[i])) {
+                            std::cout << "[error] Invalid byte string '" << argv[i] << "'!\n[info] Use pairs "
+                                "of hex digits (ex: DEADBEEF or DE AD BE EF).";
+                            return true;
+                        }
+                    }
+                }
+                else if(argv[2] == "fill") {
+                    std::vector<uint8_t> pattern;
+                    uint64_t len;
+                    if(argv.size() < 5 || !validHexBytes(pattern, argv[3]) || !validLength(len, argv[4])) {
+                        std::cout << "[error] Please specify a hex pattern and length! (ex: fill 90 0x40)";
+                        return true;
+                    }
+                    if(len > maxMemoryWriteLength_) {
+                        std::cout << "[error] Length exceeds the maximum of 0x" << std::hex << std::uppercase 
+                            << maxMemoryWriteLength_ << " bytes!";
+                        return true;
+                    }
+                    bytes.resize(len);
+                    for(size_t i = 0; i < len; i++) bytes[i] = pattern[i % pattern.size()];
+                }
+                else {
+                    uint64_t offset = 0;
+                    uint64_t len = maxMemoryWriteLength_;
+                    if(argv.size() < 4 || (argv.size() > 4 && !validLength(offset, argv[4])) 
+                            || (argv.size() > 5 && !validLength(len, argv[5]))) {
+                        std::cout << "[error] Please specify a file and an optional offset and length!";
+                        return true;
+                    }
+                    std::ifstream file(argv[3], std::ios::in | std::ios::binary);
+                    if(!file.is_open() || !file.seekg(static_cast<std::streamoff>(offset))) {
+                        std::cout << "[error] File '" << argv[3] << "' could not be opened at the given offset!";
+                        return true;
+                    }
+                    bytes.resize(std::min<uint64_t>(len, maxMemoryWriteLength_));
+                    file.read(std::bit_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+                    bytes.resize(static_cast<size_t>(file.gcount()));
+                }
+
+                if(bytes.empty()) {
+                    std::cout << "[error] Nothing to write!";
+                    return true;
+                }
+                auto written = writeMemoryBlock(addr, bytes.data(), bytes.size());
+                std::cout << std::dec << "[debug] Wrote " << written << " bytes to memory space " 
+                    << mappedSpace << " at 0x" << std::hex << std::uppercase << addr
+                    << (relativeAddr ? " (0x" + std::string(stringViewAddr) + ")" : "");
+                if(written < bytes.size()) {
+                    std::cerr << std::dec << "\n[warning] Only " << written << " of " << bytes.size() 
+                        << " bytes could be written";
+                }
+                return true;
+            }
 
+            auto stringData = stripAddrPrefix(argv[2]);
+            if(!validHexStol(data, stringData)) {
+                std::cout << "[error] Please specify valid memory address and data!";
+                return true;
+            }
+
+            //The write is only re-read on failure, a complete write is trusted as-is
             uint64_t oldData;
             readMemory(addr, oldData);
-            uint64_t newReadData;
-            writeMemory(addr, data);
-            readMemory(addr, newReadData);
-            auto chunk = memMap_.getChunkFromAddr(addr);
-            auto mappedSpace = (chunk ? MemoryMap::getFileNameFromChunk(chunk.value()) : "unmapped memory");
+            auto written = writeMemoryBlock(addr, std::bit_cast<const uint8_t*>(&data), sizeof(data));
 
             std::cout << std::hex << std::uppercase << "[debug] Wrote to memory space "
                 << mappedSpace << " at 0x" << addr
                 << (relativeAddr ? " (0x" + std::string(stringViewAddr) + ")" : "") 
-                << ": " << oldData << " --> " << newReadData;
+                << ": " << oldData << " --> " << data;
 
-            if(newReadData != data) {
-                std::cerr << "\n[warning] Read memory value differs from written value";
+            if(written != sizeof(data)) {
+                uint64_t newReadData;
+                readMemory(addr, newReadData);
+                std::cerr << "\n[warning] Read memory value differs from written value: " << newReadData;
             }
             
         } 
@@ -469,7 +845,7 @@ bool Debugger::handleCommand(const std::string& args, std::string& prevArgs) {
     else if(isPrefix(argv[0], "symbol_lookup") || argv[0] == "sl") {
         if(argv.size() > 1 && argv[1].length() > 0 && !hasWhiteSpace(argv[1])) {
             bool strict = argv.size() > 2 && argv[2] == "strict";
-            auto list = symMap_.getSymbolListFromName(argv[1], strict);
+            auto list = indexes_.getSymbolMap().getSymbolListFromName(argv[1], strict);
 
             std::cout << "\n[debug] Symbols with name '" << argv[1] 
                 << "':\n--------------------------------------------------------\n";
@@ -498,16 +874,16 @@ bool Debugger::handleCommand(const std::string& args, std::string& prevArgs) {
         uint64_t num;
         if(argv.size() > 1 && argv[1].length() > 0 && validDecStol(num, argv[1]) && num != 0) {
 
-            auto prevSize = symMap_.getMaxSymbolCacheSize();
-            symMap_.setMaxSymbolCacheSize(static_cast<size_t>(num));
-            auto currSize = symMap_.getMaxSymbolCacheSize();
+            auto prevSize = indexes_.getSymbolMap().getMaxSymbolCacheSize();
+            indexes_.getSymbolMap().setMaxSymbolCacheSize(static_cast<size_t>(num));
+            auto currSize = indexes_.getSymbolMap().getMaxSymbolCacheSize();
 
             std::cout << "[debug] Max cache size: " << std::dec 
                 << prevSize << " --> " << currSize;
         }
         else if(argv.size() == 1) {
             std::cout << "[debug] Max cache size is currently: " 
-                << std::dec << symMap_.getMaxSymbolCacheSize();
+                << std::dec << indexes_.getSymbolMap().getMaxSymbolCacheSize();
         }
         else std::cout << "[error] Cache size is invalid!";
     }
@@ -519,22 +895,34 @@ bool Debugger::handleCommand(const std::string& args, std::string& prevArgs) {
                 return true;
             }
 
-            auto prevLength = static_cast<size_t>(symMap_.getMinCachedStringLength());
-            symMap_.setMinCachedStringLength(static_cast<uint8_t>(num));
-            auto currLength = static_cast<size_t>(symMap_.getMinCachedStringLength());
+            auto prevLength = static_cast<size_t>(indexes_.getSymbolMap().getMinCachedStringLength());
+            indexes_.getSymbolMap().setMinCachedStringLength(static_cast<uint8_t>(num));
+            auto currLength = static_cast<size_t>(indexes_.getSymbolMap().getMinCachedStringLength());
 
             std::cout << "[debug] Min symbol length: " << std::dec 
                 << prevLength << " --> " << currLength;
         }
         else if(argv.size() == 1) {
             std::cout << "[debug] Min symbol length is currently: " 
-                << std::dec << static_cast<size_t>(symMap_.getMinCachedStringLength());
+                << std::dec << static_cast<size_t>(indexes_.getSymbolMap().getMinCachedStringLength());
         }
         else std::cout << "[error] Key length is invalid!";
     }
+    else if(argv[0] == "set_symbol_cache" || argv[0] == "ssc") {    //Toggle the non-strict query cache
+        if(argv.size() > 1 && (argv[1] == "on" || argv[1] == "off")) {
+            bool prev = indexes_.getSymbolMap().getCacheEnabled();
+            indexes_.getSymbolMap().setCacheEnabled(argv[1] == "on");
+            std::cout << "[debug] Symbol cache: " << (prev ? "on" : "off") << " --> " 
+                << (indexes_.getSymbolMap().getCacheEnabled() ? "on" : "off");
+        }
+        else if(argv.size() == 1) {
+            std::cout << "[debug] Symbol cache is currently: " << (indexes_.getSymbolMap().getCacheEnabled() ? "on" : "off");
+        }
+        else std::cout << "[error] Specify 'on' or 'off'!";
+    }
     else if(argv[0] == "clear_symbol_cache" || argv[0] == "csc") {
         std::cout << "[debug] Clearing symbol cache...";
-        symMap_.clearCache();
+        indexes_.getSymbolMap().clearCache();
     }
     else if(argv[0] == "program_counter" || argv[0] == "pc") {
         printSourceAtPC();
@@ -554,37 +942,58 @@ bool Debugger::handleCommand(const std::string& args, std::string& prevArgs) {
 
         if(argv.size() > 1 && argv[1].length() > 0 && !hasWhiteSpace(argv[1])) {
             std::cout << "[debug] Dumping symbol cache for " << argv[1] << " ...";
-            symMap_.dumpSymbolCache(argv[1]);
+            indexes_.getSymbolMap().dumpSymbolCache(argv[1]);
             return true;
         }
         std::cout << "[debug] Dumping all symbol caches...";
-        symMap_.dumpSymbolCache();
+        indexes_.getSymbolMap().dumpSymbolCache();
 
     }
     else if(argv[0] == "dump_symbols_strict" || argv[0] == "dss") {
 
         if(argv.size() > 1 && argv[1].length() > 0 && !hasWhiteSpace(argv[1])) {
             std::cout << "[debug] Dumping symbol cache for " << argv[1] << " ...";
-            symMap_.dumpSymbolCache(argv[1], true);
+            indexes_.getSymbolMap().dumpSymbolCache(argv[1], true);
             return true;
         }
         std::cout << "[debug] Dumping all symbol caches...";
-        symMap_.dumpSymbolCache(true);
+        indexes_.getSymbolMap().dumpSymbolCache(true);
 
     }
     else if(argv[0] == "dump_functions" || argv[0] == "df") {
         std::cout << "[debug] Dumping all function DIEs...\n";
         if(argv.size() > 1 && argv[1] == "init") {
             std::cout << "[debug] Re-initializing...\n";
-            initializeFunctionDies();
-
+            initializeFunctionIndex();
         }
-        dumpFunctionDies();
+        dumpFunctions();
     }
     else if(isPrefix(argv[0], "backtrace")) {
         std::cout << "[debug] Printing backtrace...\n";
         printBacktrace();
     }
+    else if(argv[0] == "benchmark") {
+        if(argv.size() < 2) {
+            std::cout << "[error] Usage: benchmark <lines|maps|breakpoints> [iterations]";
+            return true;
+        }
+        uint64_t iterations = 1000000;
+        if(argv.size() > 2 && !validDecStol(iterations, argv[2])) {
+            std::cout << "[error] Invalid iteration count!";
+            return true;
+        }
+        std::cout << "[debug] Running " << argv[1] << " benchmark...\n";
+        runBenchmark(argv[1], iterations);
+    }
+    else if(argv[0] == "stats") {
+        if(argv.size() > 1 && argv[1] == "reset") {
+            std::cout << "[debug] Resetting stats...";
+            resetStats();
+            return true;
+        }
+        std::cout << "[debug] Dumping stats...\n";
+        dumpStats();
+    }
     else if(argv[0] == "help") {
         std::cout << "[info] Welcome to Peek!";
     }
@@ -0,0 +1,329 @@
+#include "../include/condition.h"
+#include "../include/register.h"
+#include "../include/inferiormemory.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <optional>
+#include <charconv>
+#include <cstring>
+#include <cstddef>
+#include <cctype>
+#include <cstdint>
+#include <sys/user.h>
+
+
+namespace {
+    enum Op : uint8_t {
+        pushByte,       //1 byte immediate
+        pushWord,       //8 byte immediate
+        pushRegister,   //1 byte index into user_regs_struct
+        load,
+        negate,
+        complement,
+        logicalNot,
+        toBool,
+        jumpIfFalse,    //2 byte offset from the end of the instruction, pops the operand unless it jumps
+        jumpIfTrue,
+        add,
+        subtract,
+        multiply,
+        divide,
+        modulo,
+        shiftLeft,
+        shiftRight,
+        less,
+        lessEqual,
+        greater,
+        greaterEqual,
+        equal,
+        notEqual,
+        bitAnd,
+        bitXor,
+        bitOr
+    };
+
+    struct BinaryOperator {
+        std::string_view token;
+        Op op;
+    };
+
+    //Binary operators from the loosest to the tightest binding level, && and || are handled separately
+    const std::array<std::vector<BinaryOperator>, 8> binaryLevels = {{
+        {{"|", bitOr}},
+        {{"^", bitXor}},
+        {{"&", bitAnd}},
+        {{"==", equal}, {"!=", notEqual}},
+        {{"<=", lessEqual}, {">=", greaterEqual}, {"<", less}, {">", greater}},
+        {{"<<", shiftLeft}, {">>", shiftRight}},
+        {{"+", add}, {"-", subtract}},
+        {{"*", multiply}, {"/", divide}, {"%", modulo}}
+    }};
+
+    //Longest first, so "&&" is never read as "&"
+    constexpr std::array<std::string_view, 22> operatorTokens = {
+        "||", "&&", "==", "!=", "<=", ">=", "<<", ">>",
+        "|", "^", "&", "<", ">", "+", "-", "*", "/", "%", "!", "~", "(", ")"
+    };
+
+    static_assert(sizeof(user_regs_struct) == reg::registerCount_ * sizeof(uint64_t));
+}
+
+
+
+/*
+    Recursive descent over the binding levels, emitting bytecode as it goes. The depth of the evaluation
+    stack is tracked along, so evaluate() can run on a fixed size array without bounds checks.
+    Parentheses and unary operators are the only unbounded recursion, their nesting is capped by maxNesting.
+*/
+class ConditionCompiler {
+
+public:
+    ConditionCompiler(std::string_view source, Condition& condition) : source_(source), code_(condition.code_) {}
+
+    bool compile() {
+        if(!parseLogical(false) || !error_.empty()) return false;
+        skipSpace();
+        if(pos_ != source_.length()) return fail("unexpected '" + std::string(source_.substr(pos_)) + "'");
+        return true;
+    }
+
+    const std::string& getError() const { return error_; }
+
+private:
+    std::string_view source_;
+    std::vector<uint8_t>& code_;
+    size_t pos_ = 0;
+    size_t depth_ = 0;
+    size_t nesting_ = 0;
+    std::string error_;
+
+    bool fail(const std::string& error) {
+        if(error_.empty()) error_ = error;
+        return false;
+    }
+
+    void skipSpace() {
+        while(pos_ < source_.length() && std::isspace(static_cast<unsigned char>(source_[pos_]))) ++pos_;
+    }
+
+    std::string_view peekOperator() {
+        skipSpace();
+        for(auto token : operatorTokens) {
+            if(source_.substr(pos_, token.length()) == token) return token;
+        }
+        return {};
+    }
+
+    bool push() {
+        if(++depth_ > Condition::maxDepth) return fail("expression is nested too deeply");
+        return true;
+    }
+
+    bool nest() {
+        if(++nesting_ > Condition::maxNesting) return fail("too many nested parentheses or unary operators");
+        return true;
+    }
+
+    void emit(Op op) { code_.push_back(op); }
+
+    //level 0 is ||, level 1 is &&, then binaryLevels
+    bool parseLogical(bool andLevel) {
+        if(!(andLevel ? parseBinary(0) : parseLogical(true))) return false;
+        std::string_view token = (andLevel ? "&&" : "||");
+
+        while(peekOperator() == token) {
+            pos_ += token.length();
+            emit(andLevel ? jumpIfFalse : jumpIfTrue);
+            size_t patch = code_.size();
+            code_.insert(code_.end(), 2, 0);
+            --depth_;
+            if(!(andLevel ? parseBinary(0) : parseLogical(true))) return false;
+
+            size_t offset = code_.size() - (patch + 2);
+            if(offset > UINT16_MAX) return fail("expression is too long");
+            code_[patch] = static_cast<uint8_t>(offset);
+            code_[patch + 1] = static_cast<uint8_t>(offset >> 8);
+            emit(toBool);
+        }
+        return true;
+    }
+
+    bool parseBinary(size_t level) {
+        if(level == binaryLevels.size()) return parseUnary();
+        if(!parseBinary(level + 1)) return false;
+
+        while(true) {
+            auto token = peekOperator();
+            const auto& ops = binaryLevels[level];
+            auto it = std::find_if(ops.begin(), ops.end(), [token](auto& bo) { return bo.token == token; });
+            if(token.empty() || it == ops.end()) return true;
+
+            pos_ += token.length();
+            if(!parseBinary(level + 1)) return false;
+            emit(it->op);
+            --depth_;
+        }
+    }
+
+    bool parseUnary() {
+        auto token = peekOperator();
+        Op op;
+        if(token == "-") op = negate;
+        else if(token == "~") op = complement;
+        else if(token == "!") op = logicalNot;
+        else if(token == "*") op = load;
+        else return parsePrimary();
+
+        pos_ += token.length();
+        if(!nest() || !parseUnary()) return false;
+        --nesting_;
+        emit(op);
+        return true;
+    }
+
+    bool parsePrimary() {
+        skipSpace();
+        if(pos_ == source_.length()) return fail("expression ends early");
+
+        if(source_[pos_] == '(') {
+            ++pos_;
+            if(!nest() || !parseLogical(false)) return false;
+            if(peekOperator() != ")") return fail("missing ')'");
+            ++pos_;
+            --nesting_;
+            return true;
+        }
+
+        if(std::isdigit(static_cast<unsigned char>(source_[pos_]))) {
+            uint64_t value;
+            bool hex = (source_.substr(pos_, 2) == "0x" || source_.substr(pos_, 2) == "0X");
+            const char* first = source_.data() + pos_ + (hex ? 2 : 0);
+            auto [last, ec] = std::from_chars(first, source_.data() + source_.length(), value, hex ? 16 : 10);
+            if(ec != std::errc() || (last < source_.data() + source_.length()
+                    && std::isalnum(static_cast<unsigned char>(*last)))) {
+                return fail("invalid number at '" + std::string(source_.substr(pos_)) + "'");
+            }
+            pos_ = static_cast<size_t>(last - source_.data());
+            if(!push()) return false;
+            if(value <= UINT8_MAX) {
+                emit(pushByte);
+                code_.push_back(static_cast<uint8_t>(value));
+            }
+            else {
+                emit(pushWord);
+                code_.insert(code_.end(), sizeof(value), 0);
+                std::memcpy(code_.data() + code_.size() - sizeof(value), &value, sizeof(value));
+            }
+            return true;
+        }
+
+        if(source_[pos_] == '$') ++pos_;
+        size_t start = pos_;
+        while(pos_ < source_.length() && (std::isalnum(static_cast<unsigned char>(source_[pos_]))
+            || source_[pos_] == '_')) ++pos_;
+        auto name = source_.substr(start, pos_ - start);
+        if(name.empty()) return fail("expected a register, number or '(' at '" + std::string(source_.substr(pos_)) + "'");
+
+        auto r = reg::getRegFromName(name);
+        if(r == reg::Reg::INVALID_REG) return fail("unknown register '" + std::string(name) + "'");
+        if(!push()) return false;
+        emit(pushRegister);
+        code_.push_back(static_cast<uint8_t>(r));
+        return true;
+    }
+};
+
+
+
+//Condition Methods
+std::optional<Condition> Condition::compile(std::string_view source, std::string& error) {
+    Condition condition;
+    condition.source_ = std::string(source);
+    ConditionCompiler compiler(condition.source_, condition);
+    if(!compiler.compile()) {
+        error = compiler.getError();
+        return std::nullopt;
+    }
+    condition.code_.shrink_to_fit();
+    return condition;
+}
+
+std::optional<uint64_t> Condition::evaluate(const user_regs_struct& regs, const InferiorMemory& mem) const {
+    std::array<uint64_t, maxDepth> stack;
+    size_t top = 0;         //number of values on the stack
+    const uint8_t* ip = code_.data();
+    const uint8_t* end = ip + code_.size();
+
+    while(ip < end) {
+        auto op = static_cast<Op>(*ip++);
+        switch(op) {
+            case pushByte:
+                stack[top++] = *ip++;
+                continue;
+            case pushWord:
+                std::memcpy(&stack[top++], ip, sizeof(uint64_t));
+                ip += sizeof(uint64_t);
+                continue;
+            case pushRegister:
+                std::memcpy(&stack[top++], reinterpret_cast<const uint8_t*>(&regs) + *ip++ * sizeof(uint64_t),
+                    sizeof(uint64_t));
+                continue;
+            case load: {
+                uint64_t value;
+                if(mem.read(stack[top - 1], &value, sizeof(value)) != sizeof(value)) return std::nullopt;
+                stack[top - 1] = value;
+                continue;
+            }
+            case negate: stack[top - 1] = -stack[top - 1]; continue;
+            case complement: stack[top - 1] = ~stack[top - 1]; continue;
+            case logicalNot: stack[top - 1] = !stack[top - 1]; continue;
+            case toBool: stack[top - 1] = (stack[top - 1] != 0); continue;
+            case jumpIfFalse:
+            case jumpIfTrue: {
+                size_t offset = ip[0] | (ip[1] << 8);
+                ip += 2;
+                if((stack[top - 1] != 0) == (op == jumpIfTrue)) ip += offset;
+                else --top;
+                continue;
+            }
+            default:
+                break;
+        }
+
+        uint64_t rhs = stack[--top];
+        uint64_t& lhs = stack[top - 1];
+        switch(op) {
+            case add: lhs += rhs; break;
+            case subtract: lhs -= rhs; break;
+            case multiply: lhs *= rhs; break;
+            case divide:
+                if(!rhs) return std::nullopt;
+                lhs /= rhs;
+                break;
+            case modulo:
+                if(!rhs) return std::nullopt;
+                lhs %= rhs;
+                break;
+            case shiftLeft: lhs <<= (rhs & 63); break;
+            case shiftRight: lhs >>= (rhs & 63); break;
+            case less: lhs = (lhs < rhs); break;
+            case lessEqual: lhs = (lhs <= rhs); break;
+            case greater: lhs = (lhs > rhs); break;
+            case greaterEqual: lhs = (lhs >= rhs); break;
+            case equal: lhs = (lhs == rhs); break;
+            case notEqual: lhs = (lhs != rhs); break;
+            case bitAnd: lhs &= rhs; break;
+            case bitXor: lhs ^= rhs; break;
+            case bitOr: lhs |= rhs; break;
+            default: return std::nullopt;
+        }
+    }
+    return stack[0];
+}
+
+const std::string& Condition::getSource() const { return source_; }
+size_t Condition::getCodeSize() const { return code_.size(); }
@@ -4,14 +4,22 @@
 #include "../include/register.h"
 #include "../include/breakpoint.h"
 #include "../include/memorymap.h"
+#include "../include/debugregisters.h"
+#include "../include/pagewatchpoints.h"
+#include "../include/condition.h"
+#include "../include/tracepoint.h"
+#include "../include/tracelog.h"
 #include "../include/config.h"
 #include "../include/symbolmap.h"
+#include "../include/indexcache.h"
 
 #include <dwarf/dwarf++.hh>
 #include <elf/elf++.hh>
 
 #include <iostream>
 #include <unordered_map>
+#include <array>
+#include <algorithm>
 #include <fstream>
 #include <filesystem>
 #include <sys/ptrace.h>
@@ -20,6 +28,7 @@
 #include <signal.h>
 #include <sys/wait.h>
 #include <sys/user.h>
+#include <sys/mman.h>
 #include <string>
 #include <cstring>
 #include <bit>
@@ -30,6 +39,8 @@
 #include <cmath>
 #include <optional>
 #include <cctype>
+#include <chrono>
+#include <iomanip>
 
 
 
@@ -41,14 +52,18 @@ using util::promptYesOrNo;
 // using util::validDecStol;
 
 //Debugger Member Functions
-Debugger::Debugger(pid_t pid, std::string progName) : pid_(pid), progName_(std::move(progName)), 
-    loadAddress_(0), state_(Child::running), globalConfig_(), config_(&globalConfig_.debugger_), retAddrFromMain_(nullptr) {
+Debugger::Debugger(pid_t pid, std::string progName, Config config) : pid_(pid), progName_(std::move(progName)), 
+    loadAddress_(0), state_(Child::running), globalConfig_(std::move(config)), config_(&globalConfig_.debugger_), 
+    retAddrFromMain_(nullptr), pool_(globalConfig_.debugger_.jobs_), regs_(pid), debugRegs_(pid) {
+    auto start = std::chrono::steady_clock::now();
     auto fd = open(progName_.c_str(), O_RDONLY);
     
     elf_ = elf::elf(elf::create_mmap_loader(fd));
     dwarf_ = dwarf::dwarf(dwarf::elf::create_loader(elf_));
     
     close(fd);
+    startupTimes_.emplace_back("ELF/DWARF headers", 
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
 
     //Assertions
     static_assert(sizeof(size_t) == sizeof(uint64_t));
@@ -57,11 +72,42 @@ Debugger::Debugger(pid_t pid, std::string progName) : pid_(pid), progName_(std::
 }
 
 void Debugger::initialize() {
-    initializeMapsAndLoadAddress(); //initialize mem map, sym map and load addr from /proc/pid/maps
-    initializeFunctionDies();       //initialize user function DIEs from dwarf info
+    auto start = std::chrono::steady_clock::now();
+    auto endPhase = [&](std::string phase) {
+        auto now = std::chrono::steady_clock::now();
+        startupTimes_.emplace_back(std::move(phase), std::chrono::duration<double>(now - start).count());
+        start = now;
+    };
+
+    initializeMapsAndLoadAddress(); //initialize mem map and load addr from /proc/pid/maps
+    endPhase("Memory map");
+    unwinder_ = Unwinder(elf_, loadAddress_);
+    endPhase("Call frame info");
+
+    //a cache hit makes every index ready at once, main then comes straight from the function index
+    auto cacheKey = (config_->indexCache_ ? IndexCache::makeKey(elf_, progName_) : std::nullopt);
+    std::optional<uint64_t> mainAddr;
+    if(!cacheKey || !indexes_.loadCache(cacheKey.value(), elf_, loadAddress_, &globalConfig_.symbol_)) {
+        loadDwarfSections();            //must happen before any index is built on the pool
+        mainAddr = findMainSymbol();    //reads the symbol tables before the background thread does
+        endPhase("DWARF sections + main symbol");
+
+        //line, function and symbol indexes are built in the background from here on, or per unit on demand
+        if(config_->lazy_) {
+            indexes_.startLazy(dwarf_, elf_, loadAddress_, &globalConfig_.symbol_, pool_, config_->unitCacheSize_, 
+                std::move(cacheKey));
+        }
+        else indexes_.start(dwarf_, elf_, loadAddress_, &globalConfig_.symbol_, pool_, std::move(cacheKey));
+    }
 
-    //sets a breakpoint on the first valid entry of int main(), skips lineTable check in setBreakpoint()
-    auto [mainBp, success] = setBreakpointAtFunctionName("main");
+    /*
+        Sets a breakpoint on the first valid entry of int main(), skips lineTable check in setBreakpoint().
+        Only main's unit is read for this, the full function index is a fallback (ex: no ELF symbol).
+    */
+    auto mainEntry = (mainAddr ? findMainEntry(mainAddr.value()) : std::nullopt);
+    auto [mainBp, success] = (mainEntry ? setBreakpointAtAddress(std::bit_cast<intptr_t>(addLoadAddress(
+        mainEntry.value()))) : setBreakpointAtFunctionName("main"));
+    endPhase("Resolve main");
     if(!success) {
         std::cerr << "\n[critical] Could not set a breakpoint on first valid line in main().\n"
             "[critical] Could not set a breakpoint on the return address of main().\n";
@@ -71,19 +117,50 @@ void Debugger::initialize() {
     removeBreakpoint(mainBp);
 
     //sets a breakpoint on the return address of int main(), skips lineTable check in setBreakpoint()
-    auto fp = getRegisterValue(pid_, Reg::rbp); 
-    uint64_t retAddr;
-    readMemory(fp + 8, retAddr); 
-    auto[it, inserted] = setBreakpointAtAddress(std::bit_cast<intptr_t>(retAddr));
+    auto retAddr = getReturnAddress();
+    auto[it, inserted] = (retAddr ? setBreakpointAtAddress(std::bit_cast<intptr_t>(retAddr.value())) 
+        : std::make_pair(addrToBp_.end(), false));
 
     if(!inserted || it == addrToBp_.end()) {
         std::cerr << "\n[critical] Could not set a breakpoint on the return address of main().\n";
         retAddrFromMain_ = nullptr;        //redundant, but for safety
     }
     else retAddrFromMain_ = &it->second;
+    indexes_.trimUnits();
+    if(config_->timings_ && (indexes_.isFinished() || config_->lazy_)) dumpStartupTimes();
+}
+
+/*
+    main's ELF symbol gives its entry without demangling or reading any DWARF. Only defined function 
+    symbols count, the address is a file address.
+*/
+std::optional<uint64_t> Debugger::findMainSymbol() const {
+    for(auto& section : elf_.sections()) {
+        auto type = section.get_hdr().type;
+        if(type != elf::sht::symtab && type != elf::sht::dynsym) continue;
+        for(auto symbol : section.as_symtab()) {
+            const auto& data = symbol.get_data();
+            if(data.type() == elf::stt::func && data.shnxd != 0 && data.value != 0 && symbol.get_name() == "main") {
+                return data.value;
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+//Prologue end of the main() starting at mainAddr, from an index of just the unit holding it
+std::optional<uint64_t> Debugger::findMainEntry(uint64_t mainAddr) {
+    auto partial = indexes_.loadUnitForAddress(mainAddr);
+    const auto& functions = (partial ? partial.value().functions : indexes_.getFunctionIndex());
+    for(const auto& func : functions.findByName("main")) {
+        if(func.get().entry == mainAddr) return func.get().prologueEnd;
+    }
+    return std::nullopt;
 }
 
 void Debugger::initializeMapsAndLoadAddress() {
+    mem_ = InferiorMemory(pid_);    //child has exec'd by now, /proc/pid/mem refers to the debuggee
+
     if(elf_.get_hdr().type == elf::et::dyn) {
         std::unique_ptr<char, decltype(&free)> ptr(realpath(progName_.c_str(), nullptr), free);
         if(!ptr) {
@@ -107,8 +184,53 @@ void Debugger::initializeMapsAndLoadAddress() {
         loadAddress_ = foundLoadAddress;
 
     }
-    symMap_ = SymbolMap(elf_, loadAddress_, &globalConfig_.symbol_);
+}
 
+/*
+    libelfin loads a section, and a unit's abbreviation table and root DIE, the first time they are used,
+    without any locking. Sections are cached in a map shared by every unit, so filling it from several
+    indexing threads at once would race. Every section type libelfin knows is loaded here on the main
+    thread instead, not only the ones the indexes read today: an attribute form can reach any of them
+    (ex: DW_FORM_sec_offset into .debug_loc). Each unit's root DIE is read too, which loads its abbreviations.
+    After this, the only lazily filled state left is a unit's line table, and a unit is only ever read by
+    one thread (see IndexLoader::loadUnit()). DIEs of other units reached through DW_AT_specification or
+    DW_AT_abstract_origin are only read. Sections missing from the binary are simply skipped.
+*/
+void Debugger::loadDwarfSections() {
+    if(dwarfLoaded_) return;
+    dwarfLoaded_ = true;
+    using dwarf::section_type;
+    for(auto type : {section_type::abbrev, section_type::aranges, section_type::frame, section_type::info,
+        section_type::line, section_type::loc, section_type::macinfo, section_type::pubnames, 
+        section_type::pubtypes, section_type::ranges, section_type::str, section_type::types}) {
+        try {
+            dwarf_.get_section(type);
+        }
+        catch(const std::runtime_error&) {}
+    }
+    for(const auto& cu : dwarf_.compilation_units()) cu.root();
+}
+
+void Debugger::dumpStartupTimes() {
+    indexes_.finish();
+    double total = 0;
+    std::cout << "\n--------------------------------------------------------\n" << std::dec
+        << "Startup (" << pool_.size() << " indexing threads, " << dwarf_.compilation_units().size() 
+        << " compilation units):\n";
+    auto printPhase = [&](const std::string& phase, double seconds) {
+        std::cout << "  " << std::left << std::setw(28) << phase << std::right << std::fixed 
+            << std::setprecision(4) << seconds << "s\n";
+    };
+    for(const auto& [phase, seconds] : startupTimes_) {
+        printPhase(phase, seconds);
+        total += seconds;
+    }
+    std::cout << "Background indexing:\n";
+    for(const auto& [phase, seconds] : indexes_.getTimes()) printPhase(phase, seconds);
+    std::cout << "Main thread total: " << total << "s\n"
+        << "--------------------------------------------------------\n";
+    std::cout.unsetf(std::ios::floatfield);
+    startupTimesShown_ = true;
 }
 
 void Debugger::handleChildState() {
@@ -146,6 +268,7 @@ void Debugger::handleChildState() {
     cleanup();
     if(state_ == Child::force_detach) {
         std::cerr << "[debug] Cleanup complete! Forcefully detaching...\n\n";
+        prepareToResume();
         ptrace(PTRACE_DETACH, pid_, nullptr, SIGCONT);
         return;
     }
@@ -157,10 +280,16 @@ void Debugger::cleanup() {
     //handle breakpoint cleanup
     retAddrFromMain_ = nullptr;
 
+    PatchBatch batch(&mem_);
     for(auto& it : addrToBp_) {
         //std::cerr << "DEBUG: disabling bp!\n";
-        if(it.second.isEnabled()) it.second.disable();
+        if(it.second.isEnabled()) batch.disable(it.second);
     }
+    batch.apply();
+    debugRegs_.clearAll();
+    protectPages(pageWatch_.clear(), false);    //the child keeps running after a detach
+    unmapScratchArea();
+    traceLog_.flush();
 
     std::cout << "[info] Cleanup has been completed. Press [Enter] to exit the debugger. ";
     std::string debugString;
@@ -169,19 +298,77 @@ void Debugger::cleanup() {
    // ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
 }
 
-void Debugger::continueExecution() {
-    stepOverBreakpoint();
-    ptrace(PTRACE_CONT, pid_, nullptr, nullptr);
-    waitForSignal();
+/*
+    Must be called right before every ptrace request that lets the child run. Register writes made during 
+    the stop are flushed with a single PTRACE_SETREGS, then the register and memory caches are dropped 
+    since the child is about to change both. If the flush fails nothing is dropped, the registers stay dirty
+    and false is returned: the caller must not resume the child, it would run with the old registers. The memory map is only marked stale if the child can change
+    its address space before the next stop: always when it runs freely, but for a single step only when
+    the instruction is an address-space syscall. Stepping through a loop never reparses /proc/pid/maps.
+*/
+bool Debugger::prepareToResume(bool singleStepping) {
+    if(!regs_.flush()) {
+        std::cerr << "[critical] Register values could not be written back: " << strerror(errno) << "\n";
+        return false;
+    }
+    if(!singleStepping || stepMayChangeAddressSpace()) memMap_.invalidate();
+    regs_.invalidate();
+    mem_.invalidate();
+    return true;
+}
 
+/*
+    Checked with the registers and text page already cached for this stop. int 0x80 uses the 32-bit syscall
+    numbers, so any int 0x80 is treated as remapping. An unreadable pc is treated the same way. The bytes are
+    read raw, as the CPU will execute them: readMemoryBlock() would put a breakpoint's saved byte back over
+    the int3, and hide a syscall injectSyscall() wrote over it.
+*/
+bool Debugger::stepMayChangeAddressSpace() const {
+    static constexpr auto mmSyscalls = std::to_array<uint64_t>({
+        9,      //mmap
+        10,     //mprotect
+        11,     //munmap
+        12,     //brk
+        25,     //mremap
+        30,     //shmat
+        59,     //execve
+        67,     //shmdt
+        216,    //remap_file_pages
+        322,    //execveat
+        329     //pkey_mprotect
+    });
+
+    std::array<uint8_t, 2> insn;
+    if(mem_.read(getPC(), insn.data(), insn.size()) != insn.size()) return true;
+    if(insn[0] == 0xCD && insn[1] == 0x80) return true;
+    if(insn[0] != 0x0F || (insn[1] != 0x05 && insn[1] != 0x34)) return false;     //not syscall/sysenter
+
+    auto nr = getRegisterValue(regs_, Reg::rax);
+    return std::find(mmSyscalls.begin(), mmSyscalls.end(), nr) != mmSyscalls.end();
+}
+
+/*
+    Hits of internal breakpoints whose frame predicate fails (see FramePredicate) are resumed right here,
+    so finishing out of a deep recursion is a single command however often the return address is hit.
+    False hits of page watchpoints, hits of breakpoints whose condition is false and tracepoint hits are
+    resumed the same way, without printing anything or reloading the memory map. Trace output is flushed
+    once the child really stops.
+*/
+void Debugger::continueExecution() {
+    do {
+        if(!stepOverBreakpoint() || !prepareToResume()) break;
+        ptrace(PTRACE_CONT, pid_, nullptr, nullptr);
+        waitForSignal();
+    } while((frameMismatch_ || conditionMiss_ || traceHit_ || watchFalseHit_) && isExecuting(state_));
+    traceLog_.flush();
 }
 
 uint64_t Debugger::offsetLoadAddress(uint64_t addr) const { return addr - loadAddress_;}
 uint64_t Debugger::addLoadAddress(uint64_t addr) const { return addr + loadAddress_;}
 uint64_t Debugger::getPCOffsetAddress() const {return offsetLoadAddress(getPC());}
 pid_t Debugger::getPID() const {return pid_;}
-uint64_t Debugger::getPC() const { return getRegisterValue(pid_, Reg::rip); }
-bool Debugger::setPC(uint64_t val) { return setRegisterValue(pid_, Reg::rip, val); }
+uint64_t Debugger::getPC() const { return getRegisterValue(regs_, Reg::rip); }
+bool Debugger::setPC(uint64_t val) { return setRegisterValue(regs_, Reg::rip, val); }
 uint8_t Debugger::getContext() const {return config_->context_;}
 void Debugger::setContext(uint8_t context) {config_->context_ = context;}
 
@@ -194,15 +381,10 @@ void Debugger::printBacktrace() {
         // First, check if it is valid user-written function (default to address if not)
         std::string funcName = ""; 
         if(func) {
-            funcName = dwarf::at_name(func.value());
-            auto symbols = symMap_.getSymbolListFromName(funcName, false, false);
-            uint64_t low = dwarf::at_low_pc(func.value());
-            for(auto& s : symbols) {
-                if(s.addr == low) {
-                    funcName = s.name;
-                    break;
-                }
-            }
+            funcName = indexes_.getFunctionIndex(func.value()).getDisplayName(func.value());
+        }
+        else if(auto symbol = indexes_.getSymbolMap().getSymbolFromAddr(offsetLoadAddress(pc))) {
+            funcName = symbol.value().name;     //no DWARF info, fall back to the ELF symbol covering pc
         }
 
         // Second, check if there is valid line entry (default to no line number if there isn't)
@@ -223,11 +405,11 @@ void Debugger::printBacktrace() {
         auto chunk = memMap_.getChunkFromAddr(pc);
         std::string memRegion = "unknown";
         if(chunk) {
-            if(chunk.value().get().isPathtypeExec() && lineEntry) {
-                memRegion = lineEntry.value()->file->path;
+            if(chunk.value().isPathtypeExec() && lineEntry) {
+                memRegion = lineEntry.value().getFilePath();
             }
             else {
-                memRegion = chunk.value().get().pathname;
+                memRegion = chunk.value().pathname;
             }
         }
 
@@ -253,122 +435,119 @@ void Debugger::printBacktrace() {
         std::cout << filename << line << "\n";
     };
     
-    auto isValidFramePointer = [this](uint64_t fp) -> bool {
-        if(fp == 0 || fp % 8 != 0) {
-            return false;
-        }
-        auto chunk = memMap_.getChunkFromAddr(fp);
-        return chunk && chunk.value().get().canRead();
-    };
-
     /* 
-        1) Print current frame.
-        2) Iterate while frame pointer to caller is valid:
-            3) Read memory address of return address to caller
-            4) Update frame pointer of caller to previous frame
-            5) Subtract one byte from return address to land at caller instruction
-            6) Retrieve function (if it exists) at return address
-            7) Print frame at return address
+        Frames come from the unwinder (CFI, or the rbp chain where there is none). Every frame but the
+        current one is printed at its return address - 1, which lands on the call instruction and keeps
+        calls at the very end of a function attributed to it.
     */
-
     std::cout << "\n[info] Frames: "
         "\n--------------------------------------------------------\n";
-    auto fp = getRegisterValue(pid_, Reg::rbp);
-    auto retAddr = getPC();
-    auto func = getFunctionFromPCOffset(offsetLoadAddress(retAddr));
-    printFrame(func, retAddr);
-    
-    while(isValidFramePointer(fp)) {
-        readMemory(fp + 8, retAddr);
-        readMemory(fp, fp);
-        func = getFunctionFromPCOffset(offsetLoadAddress(--retAddr)); 
-        printFrame(func, retAddr);
+    for(const auto& frame : unwinder_.backtrace(regs_.get(), mem_)) {
+        auto pc = (frame.innermost ? frame.pc : frame.pc - 1);
+        auto func = getFunctionFromPCOffset(offsetLoadAddress(pc));
+        printFrame(func, pc);
     }
     std::cout << "--------------------------------------------------------\n";
 
 }
 
 
-
 /*
-    Dies cannot be stored by references as they are results of temporary objects from the iterators.
-    Storing them as references causes UB in dangling references (reference to pointer from temp itr).
-    Solution --> Store them as copies (even though they are a bit expensive)
-        or store them as compilation unit pointers and offset (what i'm doing here)
+    Counters for the caches that live for a single stop. A backtrace should cost one page miss per stack 
+    page it walks, every further frame on that page is a hit.
 */
-void Debugger::initializeFunctionDies() {
-    for(const auto& cu : dwarf_.compilation_units()) {
-        std::vector<dwarf::section_offset> offset;
-        for(auto& die : cu.root()) {
-            if(die.tag == dwarf::DW_TAG::subprogram && die.has(dwarf::DW_AT::name) && 
-                (die.has(dwarf::DW_AT::low_pc) || die.has(dwarf::DW_AT::ranges))) {
-                std::string name = dwarf::at_name(die);
-                if(name.length() > 1 && name[0] == '_' && (name[1] == '_' || std::isupper(name[1]))) continue;
-                offset.push_back(die.get_unit_offset());
-            }
-        }
-        if(!offset.empty()) functionDies_[&cu] = std::move(offset);
-    }
-    if(functionDies_.empty())
-        throw std::out_of_range("\n[fatal] In Debugger::initializeFunctionDies() - " 
+void Debugger::dumpStats() const {
+    const auto& memStats = mem_.getStats();
+    const auto& regStats = regs_.getStats();
+    std::cout << "\n--------------------------------------------------------\n" << std::dec
+        << "Stop generation: " << mem_.getGeneration() << "\n"
+        "Memory cache (page hits/misses): " << memStats.pageHits << " / " << memStats.pageMisses << "\n"
+        "Uncached reads: " << memStats.uncachedReads << "\n"
+        "Memory syscalls (read/write): " << memStats.readSyscalls << " / " << memStats.writeSyscalls << "\n"
+        "Cache invalidations: " << memStats.invalidations << "\n"
+        "Register cache (hits/GETREGS/SETREGS): " << regStats.hits << " / " << regStats.fetches 
+            << " / " << regStats.flushes << "\n"
+        "Memory map generation: " << memMap_.getGeneration() << (memMap_.isStale() ? " (stale)" : "") << "\n"
+        "Unwind rules (hits/misses/frame pointer): " << unwinder_.getStats().ruleHits << " / " 
+            << unwinder_.getStats().ruleMisses << " / " << unwinder_.getStats().fallbacks << "\n"
+        "Breakpoint hits resumed (frame mismatch): " << frameMismatches_ << "\n"
+        "Breakpoint conditions (true/false): " << conditionHits_ << " / " << conditionMisses_ << "\n"
+        "Trace log (lines/bytes/writes): " << traceLog_.getStats().lines << " / " << traceLog_.getStats().bytes 
+            << " / " << traceLog_.getStats().flushes << "\n"
+        "Breakpoint step overs (displaced/in place): " << displacedSteps_ << " / " << inPlaceSteps_ << "\n"
+        "Step over plans (cached/resident stops): " << stepPlans_.size() << " / " << residentStops_.size() << "\n"
+        "Page watchpoint hits (real/false): " << watchHits_ << " / " << watchFalseHits_ << "\n"
+        "--------------------------------------------------------\n";
+}
+
+void Debugger::resetStats() {
+    mem_.resetStats();
+    regs_.resetStats();
+    unwinder_.resetStats();
+    frameMismatches_ = 0;
+    conditionHits_ = 0;
+    conditionMisses_ = 0;
+    traceLog_.resetStats();
+    displacedSteps_ = 0;
+    inPlaceSteps_ = 0;
+    watchHits_ = 0;
+    watchFalseHits_ = 0;
+}
+
+
+
+//Rebuilds the function index from scratch, once the background indexing is done with the pool
+void Debugger::initializeFunctionIndex() {
+    const auto& lines = indexes_.getLineIndex();     //starts the full build in lazy mode
+    indexes_.finish();
+    loadDwarfSections();        //skipped at startup when the indexes came from the cache
+    FunctionIndex index(dwarf_, lines, pool_);
+    if(!index.initialized())
+        throw std::out_of_range("\n[fatal] In Debugger::initializeFunctionIndex() - " 
             "No functions found. Something is definitely wrong!\n");
+    indexes_.setFunctionIndex(std::move(index));
 }
 
 
-void Debugger::dumpFunctionDies() {
+void Debugger::dumpFunctions() {
     int cuCount = 0;
-    int totalFunctionCount = 0;
+    int functionCount = 0;
+    uint32_t unit = UINT32_MAX;
+    const auto& functionIndex = indexes_.getFunctionIndex();
     std::cout << "--------------------------------------------------------\n";
-    for(const auto&[cu, offset] : functionDies_) {
-        ++cuCount;
-        std::string unit = "";
-        auto& root = cu->root();
-        if(root.has(dwarf::DW_AT::name)) {
-            unit = dwarf::at_name(root);
-        }
-        int offsetCount = 0;
-        for(auto& die : root) {
-            if(offset[offsetCount] == die.get_unit_offset()) {
-                ++totalFunctionCount;
-                std::cout << std::dec << "(" << cuCount << ") "
-                    << unit << " --> " << ++offsetCount << ") "
-                    << (die.has(dwarf::DW_AT::name) ? dwarf::at_name(die) : "unnamed die")
-                    << "\n";
-            }
+    for(const auto& func : functionIndex.getFunctions()) {
+        if(func.unit != unit) {     //functions are stored grouped by unit
+            unit = func.unit;
+            ++cuCount;
+            functionCount = 0;
         }
+        std::cout << std::dec << "(" << cuCount << ") "
+            << functionIndex.getUnitName(unit) << " --> " << ++functionCount << ") "
+            << functionIndex.getQualifiedName(func) << " [0x" << std::hex << std::uppercase << func.low
+            << ", 0x" << func.high << ")" << (func.rangeCount > 1 ? " (fragmented)" : "") << "\n";
     }
     std::cout << "--------------------------------------------------------\n"
-         "[debug] Total functions: " << totalFunctionCount << "\n";
+         "[debug] Total functions: " << std::dec << functionIndex.size() << "\n";
 }
 
 
-std::optional<dwarf::die> Debugger::getFunctionFromPCOffset(uint64_t pc) const {
-    for(auto& [cu, offset] : functionDies_) {
-        if(dwarf::die_pc_range(cu->root()).contains(pc)) {
-            int count = 0;
-            for(const auto& die : cu->root()) {
-                if(offset[count] == die.get_unit_offset()) {
-                    ++count;
-                    if(dwarf::die_pc_range(die).contains(pc)) return die;
-                }
-            }
-        }
-    }
-    return std::nullopt;
-    // throw std::out_of_range(std::string("\n[fatal] In Debugger::getFunctionFromPCOffset() - ") 
-    //     + "Function not found for pc. Something is definitely wrong!\n");
+std::optional<FunctionIndex::FunctionRef> Debugger::getFunctionFromPCOffset(uint64_t pc) {
+    return indexes_.getFunctionIndex(pc).find(pc);
 }
 
-std::optional<dwarf::line_table::iterator> Debugger::getLineEntryFromPC(uint64_t pc) const {
-    for(const auto& cu : dwarf_.compilation_units()) {
-        if(dwarf::die_pc_range(cu.root()).contains(pc)) {
-            const auto& lineTable = cu.get_line_table();
-            auto lineEntryItr = lineTable.find_address(pc);
-            if(lineEntryItr != lineTable.end()) return lineEntryItr;
-            //else throw std::out_of_range("Line Entry not found in table!\n");
-        } 
-    }
-    return std::nullopt;
+std::optional<LineIndex::iterator> Debugger::getLineEntryFromPC(uint64_t pc) {
+    return indexes_.getLineIndex(pc).find(pc);
+}
+
+//Return address of the current frame, from its CFI rule or else the frame pointer
+std::optional<uint64_t> Debugger::getReturnAddress() {
+    auto caller = getCallerFrame();
+    return (caller ? std::optional<uint64_t>(caller.value().pc) : std::nullopt);
+}
+
+//Caller of the current frame, its cfa is the current frame's CFA (rsp once the current frame returns)
+std::optional<Unwinder::Frame> Debugger::getCallerFrame() {
+    return unwinder_.unwind(Unwinder::makeFrame(regs_.get()), mem_);
 }
 
 
@@ -409,7 +588,7 @@ void Debugger::printSourceAtPC() {
     if(!validMemoryRegionShouldStep(itr, false)) return;
     
     auto lineEntryItr = itr.value();
-    printSource(lineEntryItr->file->path, lineEntryItr->line, config_->context_);
+    printSource(lineEntryItr.getFilePath(), lineEntryItr->line, config_->context_);
 }
 
 void Debugger::printMemoryLocationAtPC() const {
@@ -440,6 +619,10 @@ void Debugger::waitForSignal() {
 
     int options = 0;
     int wait_status;
+    frameMismatch_ = false;
+    conditionMiss_ = false;
+    traceHit_ = false;
+    watchFalseHit_ = false;
     errno = 0;
 
     if(waitpid(pid_, &wait_status, options) == -1) {
@@ -459,26 +642,21 @@ void Debugger::waitForSignal() {
         return;
     }
 
-    if(memMap_.initialized() && isExecuting(state_)) memMap_.reload();
     auto signal = getSignalInfo();
     // if(signal.si_signo != SIGSEGV && state_ == Child::faulting) state_ = Child::running;
     
     switch(signal.si_signo) {
         case SIGTRAP:
             handleSIGTRAP(signal);
-
-            if(retAddrFromMain_ && isExecuting(state_) && 
-                    getPC() == std::bit_cast<uint64_t>(retAddrFromMain_->getAddr())) {
-                std::cout << "[debug] In Debugger::waitForSignal() - Main return Breakpoint hit!\n";
-
-                if(state_ == Child::running) state_ = Child::finish;
-                else if(state_ == Child::faulting) state_ = Child::force_detach;
-            }
+            checkMainReturn();
 
             if(state_ == Child::faulting) state_ = Child::running;
             return;
         case SIGSEGV:
            // std::cerr << "DEBUG : Handling SIGSEGV\n";
+            if(signal.si_code == SEGV_ACCERR && handlePageWatchFault(std::bit_cast<uint64_t>(signal.si_addr))) {
+                return;     //a write to a page protected for page watchpoints
+            }
             std::cerr << "[critical] Segmentation Error at " << std::hex << std::uppercase
                 << signal.si_addr << ", Reason: " << signal.si_code << "\n";
             state_= Child::faulting;
@@ -506,16 +684,226 @@ siginfo_t Debugger::getSignalInfo() const {
     return data;
 }
 
+void Debugger::checkMainReturn() {
+    if(retAddrFromMain_ && isExecuting(state_) && 
+            getPC() == std::bit_cast<uint64_t>(retAddrFromMain_->getAddr())) {
+        std::cout << "[debug] In Debugger::checkMainReturn() - Main return Breakpoint hit!\n";
+
+        if(state_ == Child::running) state_ = Child::finish;
+        else if(state_ == Child::faulting) state_ = Child::force_detach;
+    }
+}
+
+/*
+    Runs one system call in the child: a syscall instruction is written over the current pc and executed
+    with a single step, then the original bytes and registers are put back. Returns the result, nullopt if
+    the step did not complete or the call failed (-4095..-1). When the registers can't be written the
+    step never happens, the bytes and the cached registers are put back right away.
+*/
+std::optional<uint64_t> Debugger::injectSyscall(uint64_t number, const std::array<uint64_t, 6>& args) {
+    static constexpr std::array<uint8_t, 2> syscallInstruction = {0x0F, 0x05};
+    user_regs_struct saved;
+    std::array<uint8_t, 2> original;
+    if(!getAllRegisterValues(regs_, saved) || mem_.read(saved.rip, original.data(), original.size()) != 2 
+        || mem_.write(saved.rip, syscallInstruction.data(), syscallInstruction.size(), false) != 2) {
+        return std::nullopt;
+    }
+
+    user_regs_struct regs = saved;
+    regs.rax = number;
+    regs.rdi = args[0];
+    regs.rsi = args[1];
+    regs.rdx = args[2];
+    regs.r10 = args[3];
+    regs.r8 = args[4];
+    regs.r9 = args[5];
+    setAllRegisterValues(regs_, regs);
+    if(!singleStep()) {
+        mem_.write(saved.rip, original.data(), original.size(), false);
+        setAllRegisterValues(regs_, saved);
+        return std::nullopt;
+    }
+    if(isTerminated(state_)) return std::nullopt;
+
+    uint64_t result = getRegisterValue(regs_, Reg::rax);
+    mem_.write(saved.rip, original.data(), original.size(), false);
+    setAllRegisterValues(regs_, saved);
+    if(result >= static_cast<uint64_t>(-4095)) return std::nullopt;
+    return result;
+}
+
+//Watchpoints trap after the access, so the value shown is the one the instruction before pc left behind
+void Debugger::reportHardwareHits() {
+    auto hits = debugRegs_.takeHits();
+    const auto& slots = debugRegs_.getSlots();
+    for(size_t i = 0; i < slots.size(); ++i) {
+        if(!(hits & (1 << i))) continue;
+        const auto& slot = slots[i];
+        if(slot.kind == DebugRegisters::Kind::execute) {
+            std::cout << "[info] Hardware breakpoint DR" << std::dec << i << " hit at 0x" << std::hex 
+                << std::uppercase << slot.addr << " (0x" << offsetLoadAddress(slot.addr) << ")\n";
+            continue;
+        }
+        uint64_t value = 0;
+        readMemoryBlock(slot.addr, std::bit_cast<uint8_t*>(&value), slot.length);
+        std::cout << "[info] Watchpoint DR" << std::dec << i << " (" << DebugRegisters::getKindName(slot.kind) 
+            << ") hit at 0x" << std::hex << std::uppercase << slot.addr << ", value = 0x" << value 
+            << ", pc = 0x" << getPC() << "\n";
+    }
+}
+
+//Each run is one mprotect, watched pages lose write permission and unwatched ones get back what they had
+bool Debugger::protectPages(const std::vector<PageWatchpoints::Run>& runs, bool watched) {
+    for(const auto& run : runs) {
+        uint64_t prot = static_cast<uint64_t>(watched ? run.prot & ~PROT_WRITE : run.prot);
+        if(!injectSyscall(10, {run.addr, run.length, prot, 0, 0, 0})) return false;
+    }
+    return true;
+}
+
+/*
+    A write to a watched page. The page gets its protection back for a single step of the faulting
+    instruction and is protected again right after. It is a hit when si_addr lies in a watched range or
+    the step changed watched bytes on the page (si_addr is only where the access starts, a wide write can
+    begin before a range). Anything else is a false hit, resumed by continueExecution(). A write crossing
+    into a second watched page faults again during the step and is handled one level down.
+
+    Writes by the kernel on the child's behalf (ex: read(2) into a watched buffer) fail with EFAULT instead
+    of faulting, and the child changing the protection of a watched page itself ends its watching.
+*/
+bool Debugger::handlePageWatchFault(uint64_t addr) {
+    auto page = pageWatch_.getPage(addr);
+    if(!page) return false;
+
+    static constexpr size_t pageSize = PageWatchpoints::pageSize;
+    std::vector<uint8_t> before(pageSize), after(pageSize);
+    bool compare = (readMemoryBlock(page->addr, before.data(), pageSize) == pageSize);
+    uint64_t pc = getPC();
+    uint64_t hits = watchHits_;
+
+    if(!protectPages({page.value()}, false)) return false;
+    if(!singleStep()) {
+        protectPages({page.value()}, true);
+        return true;
+    }
+    if(!isExecuting(state_)) return true;
+    if(!protectPages({page.value()}, true)) {
+        std::cerr << "[warning] Page 0x" << std::hex << std::uppercase << page->addr 
+            << " could not be protected again, writes to it are no longer watched\n";
+    }
+    if(state_ == Child::faulting) return true;      //the step faulted for another reason
+
+    auto hit = pageWatch_.find(addr);
+    uint64_t written = addr;
+    compare = compare && readMemoryBlock(page->addr, after.data(), pageSize) == pageSize;
+    for(const auto& [id, wp] : pageWatch_.getWatchpoints()) {
+        if(hit || !compare) break;
+        uint64_t low = std::max(wp.addr, page->addr), high = std::min(wp.addr + wp.length, page->addr + pageSize);
+        if(low >= high) continue;
+        auto diff = std::mismatch(before.begin() + (low - page->addr), before.begin() + (high - page->addr), 
+            after.begin() + (low - page->addr));
+        if(diff.first == before.begin() + (high - page->addr)) continue;
+        hit = id;
+        written = page->addr + (diff.first - before.begin());
+    }
+
+    if(!hit) {
+        pageWatch_.countFalseHit(page->addr);
+        ++watchFalseHits_;
+        watchFalseHit_ = (watchHits_ == hits);      //unless the write was a hit on the next page
+        return true;
+    }
+
+    auto& wp = pageWatch_.get(hit.value());
+    ++wp.hits;
+    ++watchHits_;
+    watchFalseHit_ = false;
+    std::cout << "[info] Page watchpoint #" << std::dec << hit.value() << " hit: write to 0x" << std::hex 
+        << std::uppercase << written << " by pc = 0x" << pc;
+    if(compare && written >= page->addr && written < page->addr + pageSize) {
+        size_t length = std::min({uint64_t(8), wp.addr + wp.length - written, page->addr + pageSize - written});
+        uint64_t oldValue = 0, newValue = 0;
+        std::memcpy(&oldValue, before.data() + (written - page->addr), length);
+        std::memcpy(&newValue, after.data() + (written - page->addr), length);
+        std::cout << ", value = 0x" << newValue << " (was 0x" << oldValue << ")";
+    }
+    std::cout << "\n";
+    return true;
+}
+
+//Breakpoints without a predicate always hold, as do frames the unwinder cannot place
+bool Debugger::framePredicateHolds(uint64_t pc) {
+    if(framePredicates_.empty()) return true;
+    auto it = framePredicates_.find(std::bit_cast<intptr_t>(pc));
+    if(it == framePredicates_.end()) return true;
+
+    uint64_t value = getRegisterValue(regs_, Reg::rsp);
+    if(it->second.kind == FramePredicate::frameAddress) {
+        auto caller = getCallerFrame();
+        if(!caller) return true;
+        value = caller.value().cfa;
+    }
+    if(value >= it->second.value) return true;
+    ++frameMismatches_;
+    return false;
+}
+
+/*
+    Evaluated against the registers fetched for this stop (the pc rewind already needed them) and the stop's
+    memory cache. Internal stops of finish/next at the same address are not subject to the condition, and a
+    condition that cannot be evaluated stops like a true one.
+*/
+bool Debugger::conditionHolds(uint64_t pc) {
+    if(conditions_.empty()) return true;
+    auto addr = std::bit_cast<intptr_t>(pc);
+    auto it = conditions_.find(addr);
+    if(it == conditions_.end() || framePredicates_.contains(addr)) return true;
+
+    auto value = it->second.evaluate(regs_.get(), mem_);
+    if(!value) {
+        std::cerr << "[warning] Condition \"" << it->second.getSource() << "\" of the breakpoint at 0x" << std::hex 
+            << std::uppercase << pc << " could not be evaluated (bad load or division by zero), stopping\n";
+        return true;
+    }
+    if(value.value()) {
+        ++conditionHits_;
+        return true;
+    }
+    ++conditionMisses_;
+    return false;
+}
+
+//Internal stops of finish/next are not traced, like conditions. Only logged hits read the child.
+bool Debugger::traceHit(uint64_t pc) {
+    if(tracepoints_.empty()) return false;
+    auto addr = std::bit_cast<intptr_t>(pc);
+    auto it = tracepoints_.find(addr);
+    if(it == tracepoints_.end() || framePredicates_.contains(addr)) return false;
+
+    if(it->second.hit(std::chrono::steady_clock::now()) == Tracepoint::Verdict::log) {
+        it->second.format(regs_.get(), mem_, traceLog_.line());
+        traceLog_.commit();
+    }
+    return true;
+}
+
 void Debugger::handleSIGTRAP(siginfo_t signal) {
     switch(signal.si_code) {
         case SI_KERNEL:
         case TRAP_BRKPT: {
             setPC(getPC() - 1); //pc is being decremented for stepOverBreakpoint()
+            frameMismatch_ = !framePredicateHolds(getPC());
+            conditionMiss_ = !frameMismatch_ && !conditionHolds(getPC());
+            traceHit_ = !frameMismatch_ && !conditionMiss_ && traceHit(getPC());
             return;
         }
+        case TRAP_HWBKPT:
+            reportHardwareHits();
+            return;
         case 0:
             return;
-        case TRAP_TRACE:    //single-step
+        case TRAP_TRACE:    //single-step, a watched access may have happened during the step
+            if(debugRegs_.active()) reportHardwareHits();
             return;
     
         default:
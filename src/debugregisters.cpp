@@ -0,0 +1,123 @@
+#include "../include/debugregisters.h"
+
+#include <sys/ptrace.h>
+#include <sys/user.h>
+#include <sys/types.h>
+#include <cstddef>
+#include <cstdint>
+#include <cerrno>
+#include <optional>
+
+
+namespace {
+    constexpr size_t dr6 = 6;
+    constexpr size_t dr7 = 7;
+
+    //DR7 LEN field: 00 = 1 byte, 01 = 2, 11 = 4, 10 = 8
+    constexpr uint64_t encodeLength(uint8_t length) {
+        switch(length) {
+            case 2: return 0b01;
+            case 4: return 0b11;
+            case 8: return 0b10;
+            default: return 0b00;
+        }
+    }
+
+    //Local enable bit, then R/W and LEN nibble of the slot
+    constexpr uint64_t slotBits(size_t slot, DebugRegisters::Kind kind, uint8_t length) {
+        uint64_t control = static_cast<uint64_t>(kind) | (encodeLength(length) << 2);
+        return (uint64_t(1) << (slot * 2)) | (control << (16 + slot * 4));
+    }
+
+    constexpr uint64_t slotMask(size_t slot) {
+        return (uint64_t(0b11) << (slot * 2)) | (uint64_t(0xF) << (16 + slot * 4));
+    }
+}
+
+
+
+//DebugRegisters Methods
+DebugRegisters::DebugRegisters(pid_t pid) : pid_(pid) {}
+
+bool DebugRegisters::validLength(uint8_t length) {
+    return length == 1 || length == 2 || length == 4 || length == 8;
+}
+
+//Execute breakpoints must be 1 byte long, watchpoints must be aligned to their length
+std::optional<size_t> DebugRegisters::set(uint64_t addr, Kind kind, uint8_t length) {
+    if(!validLength(length) || (kind == Kind::execute && length != 1) || addr % length != 0) return std::nullopt;
+
+    for(size_t slot = 0; slot < slotCount; ++slot) {
+        if(slots_[slot].used) continue;
+        uint64_t control = (dr7_ & ~slotMask(slot)) | slotBits(slot, kind, length);
+        if(!poke(slot, addr) || !poke(dr7, control)) return std::nullopt;
+
+        dr7_ = control;
+        slots_[slot] = {true, addr, kind, length};
+        return slot;
+    }
+    return std::nullopt;
+}
+
+bool DebugRegisters::clear(size_t slot) {
+    if(slot >= slotCount || !slots_[slot].used) return false;
+    uint64_t control = dr7_ & ~slotMask(slot);
+    if(!poke(dr7, control)) return false;
+
+    dr7_ = control;
+    slots_[slot] = Slot{};
+    return true;
+}
+
+void DebugRegisters::clearAll() {
+    for(size_t slot = 0; slot < slotCount; ++slot) clear(slot);
+}
+
+std::optional<size_t> DebugRegisters::find(uint64_t addr, Kind kind) const {
+    for(size_t slot = 0; slot < slotCount; ++slot) {
+        if(slots_[slot].used && slots_[slot].addr == addr && slots_[slot].kind == kind) return slot;
+    }
+    return std::nullopt;
+}
+
+bool DebugRegisters::active() const { return dr7_ != 0; }
+
+uint8_t DebugRegisters::takeHits() {
+    if(!active()) return 0;
+    auto status = peek(dr6);
+    if(!status) return 0;
+    if(status.value() & 0xF) poke(dr6, 0);
+
+    uint8_t hits = 0;
+    for(size_t slot = 0; slot < slotCount; ++slot) {
+        if(slots_[slot].used && (status.value() & (uint64_t(1) << slot))) hits |= static_cast<uint8_t>(1 << slot);
+    }
+    return hits;
+}
+
+const std::array<DebugRegisters::Slot, DebugRegisters::slotCount>& DebugRegisters::getSlots() const {
+    return slots_;
+}
+
+const char* DebugRegisters::getKindName(Kind kind) {
+    switch(kind) {
+        case Kind::execute: return "execute";
+        case Kind::write: return "write";
+        case Kind::readWrite: return "read/write";
+    }
+    return "unknown";
+}
+
+bool DebugRegisters::poke(size_t reg, uint64_t value) {
+    errno = 0;
+    auto offset = offsetof(struct user, u_debugreg) + reg * sizeof(uint64_t);
+    return ptrace(PTRACE_POKEUSER, pid_, offset, value) != -1;
+}
+
+std::optional<uint64_t> DebugRegisters::peek(size_t reg) const {
+    errno = 0;
+    auto offset = offsetof(struct user, u_debugreg) + reg * sizeof(uint64_t);
+    long value = ptrace(PTRACE_PEEKUSER, pid_, offset, nullptr);
+    if(value == -1 && errno) return std::nullopt;
+    return static_cast<uint64_t>(value);
+}
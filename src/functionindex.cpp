@@ -0,0 +1,380 @@
+#include "../include/functionindex.h"
+#include "../include/lineindex.h"
+#include "../include/util.h"
+
+#include <dwarf/dwarf++.hh>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <optional>
+#include <functional>
+#include <span>
+#include <algorithm>
+#include <stdexcept>
+#include <cctype>
+#include <cstdint>
+
+
+namespace {
+    struct Definition {
+        dwarf::die die;
+        std::string scope;      //lexical scope the definition appears in, ex: "ns::"
+    };
+
+    bool isScope(dwarf::DW_TAG tag) {
+        return tag == dwarf::DW_TAG::namespace_ || tag == dwarf::DW_TAG::class_type || 
+            tag == dwarf::DW_TAG::structure_type || tag == dwarf::DW_TAG::union_type;
+    }
+
+    /*
+        Walk namespaces and classes below parent. Subprograms with code are definitions, every other
+        subprogram is a declaration (ex: a member function inside its class) whose scope is recorded so
+        out-of-line definitions pointing to it through DW_AT_specification get their qualified name.
+    */
+    void collectDefinitions(const dwarf::die& parent, const std::string& scope, std::vector<Definition>& defs,
+        std::unordered_map<dwarf::section_offset, std::string>& declScopes) {
+        for(const auto& die : parent) {
+            if(die.tag == dwarf::DW_TAG::subprogram) {
+                if(die.has(dwarf::DW_AT::low_pc) || die.has(dwarf::DW_AT::ranges)) defs.push_back({die, scope});
+                else declScopes.emplace(die.get_section_offset(), scope);
+            }
+            else if(isScope(die.tag)) {
+                std::string name = (die.has(dwarf::DW_AT::name) ? dwarf::at_name(die) : 
+                    (die.tag == dwarf::DW_TAG::namespace_ ? "(anonymous namespace)" : ""));
+                if(!name.empty()) collectDefinitions(die, scope + name + "::", defs, declScopes);
+            }
+        }
+    }
+
+    //Scope of a declaration in whichever unit holds it, units are sorted by section offset
+    const std::string* findDeclScope(const std::vector<FunctionIndex::UnitFunctions>& units, 
+        dwarf::section_offset offset) {
+        auto owner = std::upper_bound(units.begin(), units.end(), offset, 
+            [](dwarf::section_offset off, const FunctionIndex::UnitFunctions& unit) { return off < unit.offset; });
+        if(owner == units.begin()) return nullptr;
+        --owner;
+        auto it = owner->declScopes.find(offset);
+        return (it != owner->declScopes.end() ? &it->second : nullptr);
+    }
+
+    std::string linkageNameOf(const dwarf::die& die) {
+        if(die.has(dwarf::DW_AT::linkage_name)) return die[dwarf::DW_AT::linkage_name].as_string();
+        if(die.has(dwarf::DW_AT::MIPS_linkage_name)) return die[dwarf::DW_AT::MIPS_linkage_name].as_string();
+        return "";
+    }
+
+    //The readable rewrite can reject unusual names, the plain demangled form is kept then (as in SymbolMap)
+    std::optional<std::string> demangleLinkageName(const std::string& linkage) {
+        if(linkage.empty()) return std::nullopt;
+        try {
+            return util::demangleSymbol(linkage);
+        }
+        catch(const std::logic_error&) {
+            return util::demangleSymbol(linkage, false);
+        }
+    }
+}
+
+
+/*
+    Subprograms with code are collected from the unit, including those nested in namespaces and classes.
+    A definition often carries only its code ranges and points to the DIE holding its name through
+    DW_AT_specification (out-of-line members) or DW_AT_abstract_origin (out-of-line copies of inline
+    functions), so those links are followed for the name, linkage name and scope. Names reserved for the
+    implementation (__x, _X) are skipped so that libc/runtime helpers compiled with debug info do not show
+    up as user functions. Fragments starting at address 0 belong to code the linker discarded.
+
+    A link into another unit can't be resolved here since that unit may not be read yet. The function
+    keeps its lexical scope and the declaration is recorded, the merge fixes its name up.
+*/
+FunctionIndex::UnitFunctions FunctionIndex::readUnit(const dwarf::compilation_unit& cu, 
+    std::span<const LineIndex::Entry> rows) {
+    UnitFunctions part;
+    const auto& root = cu.root();
+    part.offset = cu.get_section_offset();
+    if(root.has(dwarf::DW_AT::name)) part.unitName = dwarf::at_name(root);
+
+    std::vector<Definition> defs;
+    collectDefinitions(root, "", defs, part.declScopes);
+    for(const auto& def : defs) {
+        std::string name, linkage;
+        const std::string* scope = nullptr;
+        std::optional<dwarf::section_offset> pending;
+        auto die = def.die;
+        for(int depth = 0; depth < 4; ++depth) {    //specification/abstract_origin chains are short
+            if(name.empty() && die.has(dwarf::DW_AT::name)) name = dwarf::at_name(die);
+            if(linkage.empty()) linkage = linkageNameOf(die);
+            if(!scope && !pending) {
+                auto it = part.declScopes.find(die.get_section_offset());
+                if(it != part.declScopes.end()) scope = &it->second;
+                else if(&die.get_unit() != &cu) pending = die.get_section_offset();
+            }
+
+            if(die.has(dwarf::DW_AT::specification)) die = die[dwarf::DW_AT::specification].as_reference();
+            else if(die.has(dwarf::DW_AT::abstract_origin)) 
+                die = die[dwarf::DW_AT::abstract_origin].as_reference();
+            else break;
+        }
+        if(name.empty()) continue;
+        if(name.length() > 1 && name[0] == '_' && (name[1] == '_' || std::isupper(name[1]))) continue;
+
+        Function func{};
+        func.rangeBegin = static_cast<uint32_t>(part.ranges.size());
+        func.low = UINT64_MAX;
+        for(const auto& range : dwarf::die_pc_range(def.die)) {
+            if(range.low == 0 || range.low >= range.high) continue;
+            part.ranges.push_back({range.low, range.high});
+            func.low = std::min(func.low, range.low);
+            func.high = std::max(func.high, range.high);
+        }
+        func.rangeCount = static_cast<uint32_t>(part.ranges.size() - func.rangeBegin);
+        if(func.rangeCount == 0) continue;
+
+        std::string qualified = (scope ? *scope : def.scope) + name;
+        auto demangled = demangleLinkageName(linkage);
+
+        const auto& first = part.ranges[func.rangeBegin];
+        func.name = intern(part.names, name);
+        func.qualifiedName = intern(part.names, qualified);
+        func.linkageName = intern(part.names, linkage);
+        func.displayName = (demangled ? intern(part.names, demangled.value()) : func.qualifiedName);
+        func.entry = first.low;
+        func.prologueEnd = findPrologueEnd(rows, first.low, first.high);
+        if(pending) part.pendingScopes.push_back({static_cast<uint32_t>(part.functions.size()), pending.value()});
+        part.functions.push_back(func);
+    }
+    return part;
+}
+
+std::vector<FunctionIndex::UnitFunctions> FunctionIndex::readUnits(const dwarf::dwarf& dwarf, 
+    const LineIndex& lines, ThreadPool& pool) {
+    const auto& cus = dwarf.compilation_units();
+    std::vector<UnitFunctions> units(cus.size());
+    //One task per unit, every section was loaded by Debugger::loadDwarfSections() beforehand
+    pool.parallelFor(cus.size(), [&](size_t unit) { units[unit] = readUnit(cus[unit], lines.getEntries()); });
+    return units;
+}
+
+FunctionIndex::FunctionIndex(const dwarf::dwarf& dwarf, const LineIndex& lines, ThreadPool& pool) : 
+    FunctionIndex(readUnits(dwarf, lines, pool)) {}
+
+/*
+    Units are appended in order, so function ids (and the unit of every function) are positions in units.
+    Declarations recorded as pending are looked up in the unit that holds them now that every unit given
+    is read, a function whose declaration is found gets its qualified name rebuilt from that scope.
+
+    Once every function is collected, its fragments are sorted by low address (longest first on ties) and
+    clipped against everything before them. This leaves a table of disjoint intervals where the first
+    function to claim an address keeps it, which only matters for identical-code-folded functions.
+*/
+FunctionIndex::FunctionIndex(std::vector<UnitFunctions> units) {
+    for(uint32_t unit = 0; unit < units.size(); ++unit) {
+        auto& part = units[unit];
+        unitNames_.push_back(intern(names_, part.unitName));
+        auto nameBase = static_cast<uint32_t>(names_.size());
+        auto rangeBase = static_cast<uint32_t>(ranges_.size());
+        names_.append(part.names);
+        ranges_.insert(ranges_.end(), part.ranges.begin(), part.ranges.end());
+
+        auto pending = part.pendingScopes.begin();
+        for(uint32_t i = 0; i < part.functions.size(); ++i) {
+            auto func = part.functions[i];
+            func.name.offset += nameBase;
+            func.qualifiedName.offset += nameBase;
+            func.linkageName.offset += nameBase;
+            func.displayName.offset += nameBase;
+            func.rangeBegin += rangeBase;
+            func.unit = unit;
+
+            if(pending != part.pendingScopes.end() && pending->function == i) {
+                if(auto scope = findDeclScope(units, (pending++)->declaration)) {
+                    bool demangled = (func.displayName.offset != func.qualifiedName.offset);
+                    func.qualifiedName = intern(names_, *scope + std::string(getString(func.name)));
+                    if(!demangled) func.displayName = func.qualifiedName;
+                }
+            }
+
+            functions_.push_back(func);
+        }
+    }
+    indexNames();
+
+    for(uint32_t i = 0; i < functions_.size(); ++i) {
+        for(const auto& range : getRanges(functions_[i])) intervals_.push_back({range.low, range.high, i});
+    }
+    std::sort(intervals_.begin(), intervals_.end(), [](const Interval& a, const Interval& b) {
+        return a.low < b.low || (a.low == b.low && a.high > b.high);
+    });
+
+    uint64_t covered = 0;
+    size_t kept = 0;
+    for(auto interval : intervals_) {
+        interval.low = std::max(interval.low, covered);
+        if(interval.low >= interval.high) continue;
+        covered = interval.high;
+        intervals_[kept++] = interval;
+    }
+    intervals_.resize(kept);
+}
+
+//Only the records and the arena are stored, the name hash is rebuilt from them
+void FunctionIndex::save(IndexCache::Writer& writer) const {
+    writer.writeRecords(functions_, &Function::name, &Function::qualifiedName, &Function::linkageName,
+        &Function::displayName, &Function::unit, &Function::rangeBegin, &Function::rangeCount, &Function::entry,
+        &Function::prologueEnd, &Function::low, &Function::high);
+    writer.writeArray(ranges_);
+    writer.writeRecords(intervals_, &Interval::low, &Interval::high, &Interval::function);
+    writer.writeArray(unitNames_);
+    writer.writeString(names_);
+}
+
+std::optional<FunctionIndex> FunctionIndex::load(IndexCache::Reader& reader) {
+    FunctionIndex index;
+    if(!reader.readRecords(index.functions_, &Function::name, &Function::qualifiedName, &Function::linkageName,
+            &Function::displayName, &Function::unit, &Function::rangeBegin, &Function::rangeCount,
+            &Function::entry, &Function::prologueEnd, &Function::low, &Function::high)
+        || !reader.readArray(index.ranges_)
+        || !reader.readRecords(index.intervals_, &Interval::low, &Interval::high, &Interval::function)
+        || !reader.readArray(index.unitNames_) || !reader.readString(index.names_)) return std::nullopt;
+
+    for(auto name : index.unitNames_) {
+        if(!index.validName(name)) return std::nullopt;
+    }
+    for(const auto& func : index.functions_) {
+        if(!index.validName(func.name) || !index.validName(func.qualifiedName) || !index.validName(func.linkageName) 
+            || !index.validName(func.displayName) || func.unit >= index.unitNames_.size() 
+            || func.rangeBegin > index.ranges_.size() || func.rangeCount > index.ranges_.size() - func.rangeBegin) {
+            return std::nullopt;
+        }
+    }
+    for(const auto& interval : index.intervals_) {
+        if(interval.function >= index.functions_.size()) return std::nullopt;
+    }
+    index.indexNames();
+    return index;
+}
+
+bool FunctionIndex::validName(Name name) const {
+    return name.offset <= names_.size() && name.length <= names_.size() - name.offset;
+}
+
+//Every function is reachable by its qualified, linkage and demangled names and their scope suffixes
+void FunctionIndex::indexNames() {
+    for(uint32_t id = 0; id < functions_.size(); ++id) {
+        const auto& func = functions_[id];
+        addQualifiedNames(getString(func.qualifiedName), id);
+        if(func.linkageName.length > 0) addName(getString(func.linkageName), id);
+        if(func.displayName.offset != func.qualifiedName.offset) {     //demangled name
+            addQualifiedNames(getString(func.displayName), id);
+        }
+    }
+}
+
+FunctionIndex::Name FunctionIndex::intern(std::string& arena, std::string_view name) {
+    Name result{static_cast<uint32_t>(arena.size()), static_cast<uint32_t>(name.size())};
+    arena.append(name);
+    return result;
+}
+
+std::string_view FunctionIndex::getString(Name name) const {
+    return std::string_view(names_).substr(name.offset, name.length);
+}
+
+void FunctionIndex::addName(std::string_view name, uint32_t function) {
+    auto& ids = byName_[std::string(name)];
+    if(ids.empty() || ids.back() != function) ids.push_back(function);
+}
+
+/*
+    Register a qualified name and every suffix that starts after a "::" separator. Separators inside 
+    template arguments or parameter lists (ex: Foo<std::string>::bar(ns::Type)) are not scope boundaries,
+    so only those at bracket depth 0 split the name.
+*/
+void FunctionIndex::addQualifiedNames(std::string_view qualified, uint32_t function) {
+    addName(qualified, function);
+    int depth = 0;
+    for(size_t i = 0; i + 1 < qualified.length(); ++i) {
+        char c = qualified[i];
+        if(c == '<' || c == '(') ++depth;
+        else if((c == '>' || c == ')') && depth > 0) --depth;
+        else if(depth == 0 && c == ':' && qualified[i + 1] == ':') {
+            addName(qualified.substr(i + 2), function);
+            ++i;
+        }
+    }
+}
+
+/*
+    Prefer the row the compiler flagged as prologue_end (clang emits it, gcc usually does not). Otherwise
+    fall back to the first statement row past the entry address, which is where the body's first line
+    begins. Both searches stop at the end of the entry fragment.
+*/
+uint64_t FunctionIndex::findPrologueEnd(std::span<const LineIndex::Entry> rows, uint64_t entry, uint64_t high) {
+    auto row = std::lower_bound(rows.begin(), rows.end(), entry, 
+        [](const LineIndex::Entry& e, uint64_t addr) { return e.address < addr; });
+    for(; row != rows.end() && row->address < high; ++row) {
+        if(row->endSequence) break;
+        if(row->prologueEnd || (row->address > entry && row->isStmt)) return row->address;
+    }
+    return entry;
+}
+
+
+std::optional<FunctionIndex::FunctionRef> FunctionIndex::find(uint64_t pc) const {
+    auto it = std::upper_bound(intervals_.begin(), intervals_.end(), pc,
+        [](uint64_t addr, const Interval& interval) { return addr < interval.low; });
+    if(it == intervals_.begin() || pc >= (--it)->high) return std::nullopt;
+    return std::cref(functions_[it->function]);
+}
+
+bool FunctionIndex::contains(const Function& func, uint64_t pc) const {
+    for(const auto& range : getRanges(func)) {
+        if(range.low <= pc && pc < range.high) return true;
+    }
+    return false;
+}
+
+//A leading "::" (explicit global scope) is dropped, the rest of the name must match a key exactly
+/*
+    Demangled names are stored after the readable rewrite (ex: "foo(uint32_t)"), so a signature typed the
+    way the demangler spells it (ex: "foo(unsigned int)") is rewritten the same way when it does not match
+    as typed. Names the rewrite rejected were stored unchanged, which the first lookup finds.
+*/
+std::vector<FunctionIndex::FunctionRef> FunctionIndex::findByName(std::string_view name) const {
+    if(name.starts_with("::")) name.remove_prefix(2);
+    std::vector<FunctionRef> matches;
+    auto it = byName_.find(std::string(name));
+    if(it == byName_.end() && name.find('(') != std::string_view::npos) {
+        try {
+            it = byName_.find(util::demangledToReadable(std::string(name)));
+        }
+        catch(const std::logic_error&) {}
+    }
+    if(it == byName_.end()) return matches;
+
+    matches.reserve(it->second.size());
+    for(auto id : it->second) matches.push_back(std::cref(functions_[id]));
+    return matches;
+}
+
+std::string_view FunctionIndex::getName(const Function& func) const { return getString(func.name); }
+std::string_view FunctionIndex::getQualifiedName(const Function& func) const { 
+    return getString(func.qualifiedName); 
+}
+std::string_view FunctionIndex::getLinkageName(const Function& func) const { 
+    return getString(func.linkageName); 
+}
+std::string_view FunctionIndex::getDisplayName(const Function& func) const { 
+    return getString(func.displayName); 
+}
+std::string_view FunctionIndex::getUnitName(uint32_t unit) const { return getString(unitNames_.at(unit)); }
+
+std::span<const FunctionIndex::Range> FunctionIndex::getRanges(const Function& func) const {
+    return std::span<const Range>(ranges_).subspan(func.rangeBegin, func.rangeCount);
+}
+
+const std::vector<FunctionIndex::Function>& FunctionIndex::getFunctions() const { return functions_; }
+size_t FunctionIndex::size() const { return functions_.size(); }
+bool FunctionIndex::initialized() const { return !functions_.empty(); }
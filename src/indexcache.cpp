@@ -0,0 +1,272 @@
+#include "../include/indexcache.h"
+#include "../include/lineindex.h"
+#include "../include/functionindex.h"
+#include "../include/symbolmap.h"
+
+#include <elf/elf++.hh>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+#include <bit>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+namespace {
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t keyLength;
+        uint64_t payloadSize;
+        uint64_t checksum;
+    };
+
+    constexpr char fileMagic[8] = {'P', 'E', 'E', 'K', 'I', 'D', 'X', '\0'};
+    constexpr uint32_t noteGnuBuildId = 3;      //NT_GNU_BUILD_ID
+
+    size_t padded(size_t length) { return (length + 7) & ~size_t(7); }
+
+    //Word-at-a-time hash, only meant to catch truncated or corrupted files
+    uint64_t checksum(const char* data, size_t size) {
+        constexpr uint64_t multiplier = 0x9E3779B97F4A7C15ULL;
+        uint64_t hash = 0xCBF29CE484222325ULL;
+        size_t i = 0;
+        for(; i + 8 <= size; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, data + i, sizeof(word));
+            hash = (std::rotl(hash, 5) ^ word) * multiplier;
+        }
+        for(; i < size; ++i) hash = (std::rotl(hash, 5) ^ static_cast<uint8_t>(data[i])) * multiplier;
+        return hash;
+    }
+
+    std::string toHex(const uint8_t* bytes, size_t length) {
+        static constexpr char digits[] = "0123456789abcdef";
+        std::string hex;
+        for(size_t i = 0; i < length; ++i) {
+            hex.push_back(digits[bytes[i] >> 4]);
+            hex.push_back(digits[bytes[i] & 0xF]);
+        }
+        return hex;
+    }
+
+    std::optional<std::filesystem::path> cacheDirectory() {
+        const char* xdg = std::getenv("XDG_CACHE_HOME");
+        if(xdg && xdg[0] == '/') return std::filesystem::path(xdg) / "peek";
+        const char* home = std::getenv("HOME");
+        if(home && home[0] == '/') return std::filesystem::path(home) / ".cache" / "peek";
+        return std::nullopt;
+    }
+
+    //Walks the notes of .note.gnu.build-id, each is a 12 byte header then a name and a desc padded to 4
+    std::optional<std::string> readBuildId(const elf::elf& elf) {
+        const auto& section = elf.get_section(".note.gnu.build-id");
+        if(!section.valid()) return std::nullopt;
+        const auto* data = static_cast<const uint8_t*>(section.data());
+        size_t size = section.size();
+
+        size_t pos = 0;
+        while(data && pos + 12 <= size) {
+            uint32_t nameSize, descSize, type;
+            std::memcpy(&nameSize, data + pos, 4);
+            std::memcpy(&descSize, data + pos + 4, 4);
+            std::memcpy(&type, data + pos + 8, 4);
+            size_t name = pos + 12, desc = name + ((nameSize + 3) & ~3u);
+            if(desc > size || descSize > size - desc) break;
+            if(type == noteGnuBuildId && nameSize == 4 && std::memcmp(data + name, "GNU", 4) == 0 && descSize > 0) {
+                return toHex(data + desc, descSize);
+            }
+            pos = desc + ((descSize + 3) & ~3u);
+        }
+        return std::nullopt;
+    }
+
+    bool parse(const char* data, size_t size, const IndexCache::Key& key, LineIndex& lines,
+        FunctionIndex& functions, SymbolMap& symbols, const elf::elf& elf, uint64_t loadAddress,
+        Config::SymbolConfig* config) {
+        Header header;
+        std::memcpy(&header, data, sizeof(header));
+        if(std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) != 0 || header.version != IndexCache::version
+            || header.keyLength != key.id.size()) return false;
+
+        size_t payloadOffset = padded(sizeof(Header) + header.keyLength);
+        if(payloadOffset > size || header.payloadSize != size - payloadOffset) return false;
+        if(std::string_view(data + sizeof(Header), header.keyLength) != key.id) return false;
+        const char* payload = data + payloadOffset;
+        if(checksum(payload, header.payloadSize) != header.checksum) return false;
+
+        IndexCache::Reader reader(payload, header.payloadSize);
+        auto lineIndex = LineIndex::load(reader);
+        if(!lineIndex) return false;
+        auto functionIndex = FunctionIndex::load(reader);
+        if(!functionIndex) return false;
+        auto symbolMap = SymbolMap::load(reader, elf, loadAddress, config);
+        if(!symbolMap || !reader.atEnd()) return false;
+
+        lines = std::move(lineIndex.value());
+        functions = std::move(functionIndex.value());
+        symbols = std::move(symbolMap.value());
+        return true;
+    }
+}
+
+
+
+//IndexCache::Writer Methods
+void IndexCache::Writer::append(const void* data, size_t length) {
+    buffer_.append(static_cast<const char*>(data), length);
+    buffer_.append(padded(length) - length, '\0');
+}
+
+char* IndexCache::Writer::extend(size_t length) {
+    size_t start = buffer_.size();
+    buffer_.append(padded(length), '\0');
+    return buffer_.data() + start;
+}
+
+void IndexCache::Writer::writeString(std::string_view str) {
+    writeValue<uint64_t>(str.size());
+    append(str.data(), str.size());
+}
+
+const std::string& IndexCache::Writer::getBuffer() const { return buffer_; }
+
+
+
+//IndexCache::Reader Methods
+IndexCache::Reader::Reader(const char* data, size_t size) : data_(data), size_(size) {}
+
+bool IndexCache::Reader::take(void* out, size_t length) {
+    if(!ok_ || length > remaining()) return fail();
+    if(length > 0) std::memcpy(out, data_ + pos_, length);
+    pos_ = std::min(size_, pos_ + padded(length));
+    return true;
+}
+
+const char* IndexCache::Reader::skip(size_t length) {
+    if(!ok_ || length > remaining()) {
+        fail();
+        return nullptr;
+    }
+    const char* start = data_ + pos_;
+    pos_ = std::min(size_, pos_ + padded(length));
+    return start;
+}
+
+bool IndexCache::Reader::readString(std::string& str) {
+    uint64_t length = 0;
+    if(!readValue(length) || length > remaining()) return fail();
+    str.assign(data_ + pos_, length);
+    pos_ = std::min(size_, pos_ + padded(length));
+    return true;
+}
+
+size_t IndexCache::Reader::remaining() const { return size_ - pos_; }
+bool IndexCache::Reader::atEnd() const { return ok_ && pos_ == size_; }
+
+bool IndexCache::Reader::fail() {
+    ok_ = false;
+    return false;
+}
+
+
+
+//IndexCache Methods
+
+/*
+    The build-id changes whenever the linked output does, but a stripped copy keeps the build-id of the
+    binary it was stripped from. The file size is part of the key so the two never share indexes.
+*/
+std::optional<IndexCache::Key> IndexCache::makeKey(const elf::elf& elf, const std::string& programPath) {
+    auto directory = cacheDirectory();
+    std::error_code error;
+    auto path = std::filesystem::canonical(programPath, error);
+    struct stat st;
+    if(!directory || error || stat(path.c_str(), &st) != 0) return std::nullopt;
+
+    Key key;
+    if(auto buildId = readBuildId(elf)) {
+        key.id = "build-id:" + buildId.value() + ":" + std::to_string(st.st_size);
+        key.file = directory.value() / (buildId.value() + ".pidx");
+    }
+    else {
+        uint64_t mtime = static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000ULL + st.st_mtim.tv_nsec;
+        key.id = "file:" + path.string() + ":" + std::to_string(mtime) + ":" + std::to_string(st.st_size);
+        uint64_t hash = checksum(key.id.data(), key.id.size());
+        key.file = directory.value() / (toHex(reinterpret_cast<const uint8_t*>(&hash), sizeof(hash)) + ".pidx");
+    }
+    return key;
+}
+
+bool IndexCache::store(const Key& key, const LineIndex& lines, const FunctionIndex& functions,
+    const SymbolMap& symbols) {
+    Writer writer;
+    lines.save(writer);
+    functions.save(writer);
+    symbols.save(writer);
+    const auto& payload = writer.getBuffer();
+
+    Header header{};
+    std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+    header.version = version;
+    header.keyLength = static_cast<uint32_t>(key.id.size());
+    header.payloadSize = payload.size();
+    header.checksum = checksum(payload.data(), payload.size());
+
+    std::error_code error;
+    std::filesystem::create_directories(key.file.parent_path(), error);
+    if(error) return false;
+
+    auto temp = key.file;
+    temp += ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        std::string keyBlock = key.id;
+        keyBlock.append(padded(sizeof(Header) + keyBlock.size()) - sizeof(Header) - keyBlock.size(), '\0');
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(keyBlock.data(), static_cast<std::streamsize>(keyBlock.size()));
+        out.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+        out.close();
+        if(!out) {
+            std::filesystem::remove(temp, error);
+            return false;
+        }
+    }
+
+    std::filesystem::rename(temp, key.file, error);
+    if(!error) return true;
+    std::filesystem::remove(temp, error);
+    return false;
+}
+
+bool IndexCache::load(const Key& key, LineIndex& lines, FunctionIndex& functions, SymbolMap& symbols,
+    const elf::elf& elf, uint64_t loadAddress, Config::SymbolConfig* config) {
+    int fd = open(key.file.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) return false;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+        close(fd);
+        return false;
+    }
+
+    size_t size = static_cast<size_t>(st.st_size);
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) return false;
+
+    bool loaded = parse(static_cast<const char*>(map), size, key, lines, functions, symbols, elf, loadAddress,
+        config);
+    munmap(map, size);
+    return loaded;
+}
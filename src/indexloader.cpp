@@ -0,0 +1,601 @@
+#include "../include/indexloader.h"
+#include "../include/lineindex.h"
+#include "../include/functionindex.h"
+#include "../include/symbolmap.h"
+#include "../include/threadpool.h"
+
+#include <dwarf/dwarf++.hh>
+#include <elf/elf++.hh>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <stdexcept>
+#include <memory>
+#include <optional>
+#include <chrono>
+#include <utility>
+#include <functional>
+#include <algorithm>
+#include <list>
+#include <cstring>
+#include <filesystem>
+#include <cstdint>
+
+
+namespace {
+    //path is query, or ends with it at a directory boundary
+    bool pathEndsWith(std::string_view path, std::string_view query) {
+        return path == query || (path.ends_with(query) && path.length() > query.length() &&
+            path[path.length() - query.length() - 1] == '/');
+    }
+
+    bool readULEB128(const char* data, size_t& pos, size_t end, uint64_t& value) {
+        value = 0;
+        for(unsigned shift = 0; pos < end && shift < 64; shift += 7) {
+            auto byte = static_cast<uint8_t>(data[pos++]);
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if(!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+
+    bool readCString(const char* data, size_t& pos, size_t end, std::string_view& str) {
+        if(pos >= end) return false;
+        const auto* nul = static_cast<const char*>(std::memchr(data + pos, '\0', end - pos));
+        if(!nul) return false;
+        str = std::string_view(data + pos, nul - (data + pos));
+        pos = static_cast<size_t>(nul - data) + 1;
+        return true;
+    }
+
+    std::string joinPath(const std::string& dir, std::string_view name) {
+        if(name.starts_with('/') || dir.empty()) return std::string(name);
+        return dir + "/" + std::string(name);
+    }
+}
+
+
+
+IndexLoader::~IndexLoader() { finish(); }
+
+/*
+    Unit main file paths and address ranges are collected here, on the caller's thread, from the root DIEs
+    that were already read by Debugger::loadDwarfSections(). A relative DW_AT_name is joined to
+    DW_AT_comp_dir.
+*/
+void IndexLoader::prepare(const dwarf::dwarf& dwarf, const elf::elf& elf, uint64_t loadAddress,
+    Config::SymbolConfig* config, ThreadPool& pool, std::optional<IndexCache::Key> cacheKey) {
+    dwarf_ = &dwarf;
+    elf_ = &elf;
+    loadAddress_ = loadAddress;
+    config_ = config;
+    pool_ = &pool;
+    started_ = true;
+    cacheKey_ = std::move(cacheKey);
+    const auto& cus = dwarf.compilation_units();
+    unitStates_ = std::make_unique<std::atomic<uint8_t>[]>(cus.size());
+    unitLines_.resize(cus.size());
+    unitFunctions_.resize(cus.size());
+    unitErrors_.resize(cus.size());
+
+    for(const auto& cu : cus) {
+        const auto& root = cu.root();
+        std::string path = (root.has(dwarf::DW_AT::name) ? dwarf::at_name(root) : "");
+        if(!path.empty() && path.front() != '/' && root.has(dwarf::DW_AT::comp_dir)) {
+            path = root[dwarf::DW_AT::comp_dir].as_string() + "/" + path;
+        }
+        unitPaths_.push_back(std::filesystem::path(path).lexically_normal().string());
+    }
+    buildUnitRanges();
+}
+
+void IndexLoader::start(const dwarf::dwarf& dwarf, const elf::elf& elf, uint64_t loadAddress,
+    Config::SymbolConfig* config, ThreadPool& pool, std::optional<IndexCache::Key> cacheKey) {
+    prepare(dwarf, elf, loadAddress, config, pool, std::move(cacheKey));
+    launch();
+}
+
+void IndexLoader::startLazy(const dwarf::dwarf& dwarf, const elf::elf& elf, uint64_t loadAddress,
+    Config::SymbolConfig* config, ThreadPool& pool, size_t unitCacheSize, std::optional<IndexCache::Key> cacheKey) {
+    prepare(dwarf, elf, loadAddress, config, pool, std::move(cacheKey));
+    lazy_ = true;
+    unitCacheSize_ = std::max<size_t>(unitCacheSize, 1);
+}
+
+void IndexLoader::launch() {
+    if(launched_) return;
+    launched_ = true;
+    thread_ = std::thread(&IndexLoader::run, this);
+}
+
+bool IndexLoader::loadCache(const IndexCache::Key& key, const elf::elf& elf, uint64_t loadAddress,
+    Config::SymbolConfig* config) {
+    auto start = std::chrono::steady_clock::now();
+    if(!IndexCache::load(key, lines_, functions_, symbols_, elf, loadAddress, config)) return false;
+    times_.emplace_back("Index cache load", 
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ready_.fill(true);
+    started_ = true;
+    finished_ = true;
+    return true;
+}
+
+void IndexLoader::finish() {
+    if(thread_.joinable()) thread_.join();
+}
+
+/*
+    Symbols come first, as they did before indexing moved to the background: they need no DWARF and are
+    the fallback for every address without a function. Then every unit is read and the global indexes are
+    merged one after the other. A failed unit fails every index built from units, whichever thread read
+    it, symbols are built regardless.
+*/
+void IndexLoader::run() {
+    buildSymbols();
+    auto start = std::chrono::steady_clock::now();
+    std::exception_ptr unitError;
+    try {
+        //Unsynchronized libelfin state is safe to share only after Debugger::loadDwarfSections()
+        pool_->parallelFor(dwarf_->compilation_units().size(), [this](size_t unit) { loadUnit(unit); });
+    }
+    catch(...) {
+        unitError = std::current_exception();
+    }
+
+    std::vector<LineIndex::UnitLines> lines;
+    std::vector<FunctionIndex::UnitFunctions> functions;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        lines = std::move(unitLines_);
+        functions = std::move(unitFunctions_);
+        unitsMerged_ = true;
+    }
+    times_.emplace_back("Units (lines + functions)",
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+    runStage(Index::lines, "Line index merge", [&] {
+        if(unitError) std::rethrow_exception(unitError);
+        lines_ = LineIndex(std::move(lines), pool_);
+    });
+    runStage(Index::functions, "Function index merge", [&] {
+        if(unitError) std::rethrow_exception(unitError);
+        FunctionIndex index(std::move(functions));
+        if(!index.initialized()) {
+            throw std::out_of_range("\n[fatal] In IndexLoader::run() - "
+                "No functions found. Something is definitely wrong!\n");
+        }
+        functions_ = std::move(index);
+    });
+
+    //Only a complete set of indexes is cached, a failed one is rebuilt (and fails again) next time
+    bool complete = std::none_of(errors_.begin(), errors_.end(), [](const auto& error) { return bool(error); });
+    if(cacheKey_ && complete) {
+        auto cacheStart = std::chrono::steady_clock::now();
+        IndexCache::store(cacheKey_.value(), lines_, functions_, symbols_);
+        times_.emplace_back("Index cache write", 
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - cacheStart).count());
+    }
+    finished_ = true;
+}
+
+void IndexLoader::buildSymbols() {
+    if(isReady(Index::symbols)) return;
+    runStage(Index::symbols, "Symbols (read + demangle)", [this] {
+        symbols_ = SymbolMap(*elf_, loadAddress_, config_, *pool_);
+    });
+}
+
+template<typename Build>
+void IndexLoader::runStage(Index index, const std::string& name, Build&& build) {
+    auto start = std::chrono::steady_clock::now();
+    std::exception_ptr error;
+    try {
+        build();
+    }
+    catch(...) {
+        error = std::current_exception();
+    }
+    times_.emplace_back(name, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ready_[static_cast<size_t>(index)] = true;
+        errors_[static_cast<size_t>(index)] = error;
+    }
+    cv_.notify_all();
+}
+
+/*
+    Whoever moves a unit from pending to loading reads it, everyone else waits until it is loaded. A unit
+    that fails to read is still marked loaded (with empty tables) so nobody waits on it forever, and its
+    error is kept with it: every later loadUnit() of it throws again. The pool task of a unit the main
+    thread read first therefore fails the background build the same way as if the pool had read it.
+*/
+void IndexLoader::loadUnit(size_t unit) {
+    uint8_t expected = pending;
+    if(!unitStates_[unit].compare_exchange_strong(expected, loading)) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&]{ return unitStates_[unit].load() == loaded; });
+        if(unitErrors_[unit]) std::rethrow_exception(unitErrors_[unit]);
+        return;
+    }
+
+    LineIndex::UnitLines lines;
+    FunctionIndex::UnitFunctions functions;
+    std::exception_ptr error;
+    try {
+        const auto& cu = dwarf_->compilation_units()[unit];
+        lines = LineIndex::readUnit(cu);
+        functions = FunctionIndex::readUnit(cu, lines.entries);
+    }
+    catch(...) {
+        error = std::current_exception();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        unitLines_[unit] = std::move(lines);
+        unitFunctions_[unit] = std::move(functions);
+        unitErrors_[unit] = error;
+        unitStates_[unit].store(loaded);
+    }
+    cv_.notify_all();
+    if(error) std::rethrow_exception(error);
+}
+
+//Unit tables are copied, not moved, the background merge (or the lazy unit cache) still needs them
+std::optional<IndexLoader::Partial> IndexLoader::mergeUnits(const std::vector<size_t>& units) {
+    if(units.empty()) return std::nullopt;
+    std::vector<LineIndex::UnitLines> lines;
+    std::vector<FunctionIndex::UnitFunctions> functions;
+    if(lazy()) {
+        for(auto unit : units) {
+            const auto& cached = loadLazyUnit(unit);
+            lines.push_back(cached.lines);
+            functions.push_back(cached.functions);
+        }
+        return Partial{LineIndex(std::move(lines)), FunctionIndex(std::move(functions))};
+    }
+
+    for(auto unit : units) loadUnit(unit);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(unitsMerged_) return std::nullopt;
+        for(auto unit : units) {
+            lines.push_back(unitLines_[unit]);
+            functions.push_back(unitFunctions_[unit]);
+        }
+    }
+    return Partial{LineIndex(std::move(lines)), FunctionIndex(std::move(functions))};
+}
+
+/*
+    In lazy mode a file that is not the main file of any unit (a header) is looked up in the file names of
+    every unit's line program header (see buildUnitFiles()), so only the units that list the file have
+    their line table and DIEs read. libelfin keeps a decoded line table for good, decoding every unit's to
+    find one header would hold all of them in memory.
+*/
+std::optional<IndexLoader::Partial> IndexLoader::loadUnitsForFile(std::string_view path) {
+    if(!dwarf_ || isReady(Index::lines)) return std::nullopt;
+    std::string query = std::filesystem::path(path).lexically_normal().string();
+    if(query.empty()) return std::nullopt;
+
+    std::vector<size_t> units;
+    for(size_t unit = 0; unit < unitPaths_.size(); ++unit) {
+        if(pathEndsWith(unitPaths_[unit], query)) units.push_back(unit);
+    }
+    if(!units.empty() || !lazy()) return mergeUnits(units);
+
+    if(!unitFilesBuilt_) buildUnitFiles();
+    for(size_t unit = 0; unit < unitFiles_.size(); ++unit) {
+        const auto& files = unitFiles_[unit];
+        if(!files || std::any_of(files->begin(), files->end(), [&](const std::string& file) {
+            return pathEndsWith(file, query); })) units.push_back(unit);
+    }
+    return (units.empty() ? Partial{} : mergeUnits(units));
+}
+
+std::optional<IndexLoader::Partial> IndexLoader::loadUnitForAddress(uint64_t addr) {
+    if(!dwarf_ || isReady(Index::functions)) return std::nullopt;
+    auto unit = findUnit(addr);
+    return (unit ? mergeUnits({unit.value()}) : std::nullopt);
+}
+
+/*
+    Candidate units come from the ELF symbol table, which is read without demangling anything: a function
+    symbol named exactly name, or a mangled one that holds the name's last identifier in its length-prefixed
+    form (ex: "6method" for ns::Class::method). False positives only cost a unit read, the merged function
+    index does the real matching. Without a .symtab (stripped binary) the global index is needed instead.
+*/
+std::optional<IndexLoader::Partial> IndexLoader::loadUnitsForName(std::string_view name) {
+    if(!lazy()) return std::nullopt;
+    auto identifier = name.substr(0, name.find_first_of("<("));
+    if(auto scope = identifier.rfind("::"); scope != std::string_view::npos) identifier.remove_prefix(scope + 2);
+    if(identifier.empty() || identifier.starts_with("operator")) return std::nullopt;
+    std::string encoded = std::to_string(identifier.length()) + std::string(identifier);
+
+    bool symtab = false;
+    std::vector<size_t> units;
+    for(const auto& section : elf_->sections()) {
+        auto type = section.get_hdr().type;
+        if(type != elf::sht::symtab && type != elf::sht::dynsym) continue;
+        symtab = symtab || (type == elf::sht::symtab);
+
+        for(auto symbol : section.as_symtab()) {
+            const auto& data = symbol.get_data();
+            if(data.type() != elf::stt::func || data.shnxd == 0 || data.value == 0) continue;
+            size_t length = 0;
+            const char* raw = symbol.get_name(&length);
+            std::string_view symName(raw, length);
+            if(symName != name && !(symName.starts_with("_Z") && symName.find(encoded) != std::string_view::npos)) {
+                continue;
+            }
+            if(auto unit = findUnit(data.value)) units.push_back(unit.value());
+        }
+    }
+    if(!symtab) return std::nullopt;
+
+    std::sort(units.begin(), units.end());
+    units.erase(std::unique(units.begin(), units.end()), units.end());
+    return (units.empty() ? Partial{} : mergeUnits(units));
+}
+
+
+
+bool IndexLoader::lazy() const { return lazy_ && !launched_; }
+
+/*
+    .debug_aranges holds one set per unit: a header (length, version, offset of the unit in .debug_info,
+    address and segment size) padded to a multiple of one (address, length) pair, then the pairs up to a
+    (0, 0) terminator. Sets with other than 8 byte addresses or with segments are skipped. Units missing
+    from the section (clang only emits it with -gdwarf-aranges) use the ranges of their root DIE instead.
+    Overlaps are clipped so the first unit to claim an address keeps it.
+*/
+void IndexLoader::buildUnitRanges() {
+    const auto& cus = dwarf_->compilation_units();
+    std::vector<dwarf::section_offset> offsets;
+    for(const auto& cu : cus) offsets.push_back(cu.get_section_offset());
+    std::vector<bool> covered(cus.size(), false);
+
+    const auto& section = elf_->get_section(".debug_aranges");
+    const auto* data = (section.valid() ? static_cast<const char*>(section.data()) : nullptr);
+    size_t size = (data ? section.size() : 0);
+    auto read = [data](size_t pos, size_t bytes) {
+        uint64_t value = 0;
+        std::memcpy(&value, data + pos, bytes);
+        return value;
+    };
+
+    size_t pos = 0;
+    while(pos + 4 <= size) {
+        size_t setStart = pos, offsetSize = 4;
+        uint64_t length = read(pos, 4);
+        pos += 4;
+        if(length == 0xFFFFFFFF) {      //64-bit DWARF
+            if(pos + 8 > size) break;
+            length = read(pos, 8);
+            offsetSize = 8;
+            pos += 8;
+        }
+        if(length > size - pos || length < 4 + offsetSize) break;
+        size_t end = pos + length;
+        uint64_t infoOffset = read(pos + 2, offsetSize);
+        auto addressSize = static_cast<uint8_t>(data[pos + 2 + offsetSize]);
+        auto segmentSize = static_cast<uint8_t>(data[pos + 3 + offsetSize]);
+        size_t tuple = setStart + ((pos + 4 + offsetSize - setStart + 15) & ~size_t(15));
+        pos = end;
+
+        auto unit = std::lower_bound(offsets.begin(), offsets.end(), infoOffset);
+        if(addressSize != 8 || segmentSize != 0 || unit == offsets.end() || *unit != infoOffset) continue;
+        auto index = static_cast<uint32_t>(unit - offsets.begin());
+        for(; tuple + 16 <= end; tuple += 16) {
+            uint64_t low = read(tuple, 8), rangeLength = read(tuple + 8, 8);
+            if(low == 0 && rangeLength == 0) break;
+            if(low == 0 || rangeLength == 0) continue;      //discarded by the linker
+            unitRanges_.push_back({low, low + rangeLength, index});
+            covered[index] = true;
+        }
+    }
+
+    for(uint32_t unit = 0; unit < cus.size(); ++unit) {
+        if(covered[unit]) continue;
+        for(const auto& range : dwarf::die_pc_range(cus[unit].root())) {
+            if(range.low != 0 && range.low < range.high) unitRanges_.push_back({range.low, range.high, unit});
+        }
+    }
+
+    std::sort(unitRanges_.begin(), unitRanges_.end(), [](const UnitRange& a, const UnitRange& b) {
+        return a.low < b.low || (a.low == b.low && a.high > b.high);
+    });
+    uint64_t end = 0;
+    size_t kept = 0;
+    for(auto range : unitRanges_) {
+        range.low = std::max(range.low, end);
+        if(range.low >= range.high) continue;
+        end = range.high;
+        unitRanges_[kept++] = range;
+    }
+    unitRanges_.resize(kept);
+}
+
+/*
+    A DWARF 2 to 4 line program header is: unit length, version, header length, then the state machine
+    parameters up to opcode_base and the standard opcode lengths, then the include directories and the
+    file entries (name, ULEB128 directory index, mtime and length). Both lists end with an empty string.
+    Directory 0 is DW_AT_comp_dir, relative directories and names are joined to it like libelfin joins the
+    paths of line table rows. Units without DW_AT_stmt_list list no files, units whose header is cut short
+    or of another version get nullopt and are read for every file query.
+*/
+void IndexLoader::buildUnitFiles() {
+    unitFilesBuilt_ = true;
+    const auto& cus = dwarf_->compilation_units();
+    const auto& section = elf_->get_section(".debug_line");
+    const auto* data = (section.valid() ? static_cast<const char*>(section.data()) : nullptr);
+    size_t size = (data ? section.size() : 0);
+    auto read = [data](size_t pos, size_t bytes) {
+        uint64_t value = 0;
+        std::memcpy(&value, data + pos, bytes);
+        return value;
+    };
+
+    auto readHeader = [&](const dwarf::die& root, size_t pos) -> std::optional<std::vector<std::string>> {
+        std::string compDir = (root.has(dwarf::DW_AT::comp_dir) ? root[dwarf::DW_AT::comp_dir].as_string() : "");
+        size_t offsetSize = 4;
+        if(pos + 4 > size) return std::nullopt;
+        uint64_t length = read(pos, 4);
+        pos += 4;
+        if(length == 0xFFFFFFFF) {      //64-bit DWARF
+            if(pos + 8 > size) return std::nullopt;
+            length = read(pos, 8);
+            offsetSize = 8;
+            pos += 8;
+        }
+        if(length > size - pos || length < 2 + offsetSize) return std::nullopt;
+        size_t end = pos + length;
+        auto version = static_cast<uint16_t>(read(pos, 2));
+        uint64_t headerLength = read(pos + 2, offsetSize);
+        pos += 2 + offsetSize;
+        if(version < 2 || version > 4 || headerLength > end - pos) return std::nullopt;
+        end = pos + headerLength;
+
+        size_t opcodeBase = pos + (version >= 4 ? 5 : 4);
+        if(opcodeBase >= end || data[opcodeBase] == 0) return std::nullopt;
+        pos = opcodeBase + static_cast<uint8_t>(data[opcodeBase]);     //standard_opcode_lengths has base - 1
+
+        std::vector<std::string> dirs{compDir};
+        std::string_view name;
+        while(true) {
+            if(!readCString(data, pos, end, name)) return std::nullopt;
+            if(name.empty()) break;
+            dirs.push_back(joinPath(compDir, name));
+        }
+
+        std::vector<std::string> files;
+        while(true) {
+            uint64_t dir, ignored;
+            if(!readCString(data, pos, end, name)) return std::nullopt;
+            if(name.empty()) break;
+            if(!readULEB128(data, pos, end, dir) || !readULEB128(data, pos, end, ignored) 
+                || !readULEB128(data, pos, end, ignored)) return std::nullopt;
+            auto path = joinPath(dir < dirs.size() ? dirs[dir] : compDir, name);
+            files.push_back(std::filesystem::path(path).lexically_normal().string());
+        }
+        return files;
+    };
+
+    unitFiles_.clear();
+    for(const auto& cu : cus) {
+        const auto& root = cu.root();
+        if(!root.has(dwarf::DW_AT::stmt_list)) unitFiles_.emplace_back(std::vector<std::string>{});
+        else unitFiles_.push_back(readHeader(root, root[dwarf::DW_AT::stmt_list].as_sec_offset()));
+    }
+}
+
+std::optional<size_t> IndexLoader::findUnit(uint64_t addr) const {
+    auto it = std::upper_bound(unitRanges_.begin(), unitRanges_.end(), addr, 
+        [](uint64_t value, const UnitRange& range) { return value < range.low; });
+    if(it == unitRanges_.begin() || addr >= (--it)->high) return std::nullopt;
+    return it->unit;
+}
+
+IndexLoader::LazyUnit& IndexLoader::loadLazyUnit(size_t unit) {
+    auto it = std::find_if(lazyUnits_.begin(), lazyUnits_.end(), [unit](const LazyUnit& u) { return u.unit == unit; });
+    if(it != lazyUnits_.end()) {
+        lazyUnits_.splice(lazyUnits_.begin(), lazyUnits_, it);
+        return lazyUnits_.front();
+    }
+
+    const auto& cu = dwarf_->compilation_units()[unit];
+    LazyUnit cached{unit, LineIndex::readUnit(cu), {}, std::nullopt};
+    cached.functions = FunctionIndex::readUnit(cu, cached.lines.entries);
+    lazyUnits_.push_front(std::move(cached));
+    return lazyUnits_.front();
+}
+
+IndexLoader::Partial* IndexLoader::findLazyIndex(uint64_t pc) {
+    auto unit = findUnit(pc);
+    if(!unit) return nullptr;
+    auto& cached = loadLazyUnit(unit.value());
+    if(!cached.index) {
+        cached.index = Partial{LineIndex(std::vector<LineIndex::UnitLines>{cached.lines}), 
+            FunctionIndex(std::vector<FunctionIndex::UnitFunctions>{cached.functions})};
+    }
+    return &cached.index.value();
+}
+
+//Units are only dropped here, so nothing returned during a command is freed before it ends
+void IndexLoader::trimUnits() {
+    size_t keep = (launched_ ? 0 : unitCacheSize_);
+    while(lazyUnits_.size() > keep) lazyUnits_.pop_back();
+}
+
+
+
+bool IndexLoader::isReady(Index index) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return ready_[static_cast<size_t>(index)];
+}
+
+bool IndexLoader::isFinished() const { return finished_.load(); }
+
+void IndexLoader::wait(Index index) const {
+    if(!started_) {
+        throw std::logic_error("\n[fatal] In IndexLoader::wait() - Indexing was never started!\n");
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [&]{ return ready_[static_cast<size_t>(index)]; });
+    if(errors_[static_cast<size_t>(index)]) std::rethrow_exception(errors_[static_cast<size_t>(index)]);
+}
+
+const LineIndex& IndexLoader::getLineIndex() {
+    if(lazy_) launch();
+    wait(Index::lines);
+    return lines_;
+}
+
+const FunctionIndex& IndexLoader::getFunctionIndex() {
+    if(lazy_) launch();
+    wait(Index::functions);
+    return functions_;
+}
+
+SymbolMap& IndexLoader::getSymbolMap() {
+    if(lazy()) buildSymbols();      //symbols need no DWARF, build only them
+    wait(Index::symbols);
+    return symbols_;
+}
+
+const LineIndex& IndexLoader::getLineIndex(uint64_t pc) {
+    if(!lazy()) return getLineIndex();
+    auto* index = findLazyIndex(pc);
+    return (index ? index->lines : empty_.lines);
+}
+
+const FunctionIndex& IndexLoader::getFunctionIndex(uint64_t pc) {
+    if(!lazy()) return getFunctionIndex();
+    auto* index = findLazyIndex(pc);
+    return (index ? index->functions : empty_.functions);
+}
+
+const FunctionIndex& IndexLoader::getFunctionIndex(const FunctionIndex::Function& func) {
+    for(const auto& cached : lazyUnits_) {
+        if(!cached.index) continue;
+        const auto& functions = cached.index.value().functions.getFunctions();
+        if(!functions.empty() && !std::less<const FunctionIndex::Function*>()(&func, functions.data()) &&
+            std::less<const FunctionIndex::Function*>()(&func, functions.data() + functions.size())) {
+            return cached.index.value().functions;
+        }
+    }
+    return getFunctionIndex();
+}
+
+void IndexLoader::setFunctionIndex(FunctionIndex index) { functions_ = std::move(index); }
+const std::vector<std::pair<std::string, double>>& IndexLoader::getTimes() const { return times_; }
@@ -0,0 +1,400 @@
+#include "../include/inferiormemory.h"
+#include "../include/debugger.h"
+#include "../include/breakpoint.h"
+
+#include <sys/ptrace.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <algorithm>
+#include <utility>
+#include <bit>
+#include <cctype>
+
+
+//InferiorMemory Methods
+InferiorMemory::InferiorMemory(pid_t pid) : pid_(pid) {
+    std::string path = "/proc/" + std::to_string(pid) + "/mem";
+    memFd_ = open(path.c_str(), O_RDWR | O_CLOEXEC);
+
+    //Not fatal, process_vm_readv() and ptrace() do not need the descriptor
+    if(memFd_ == -1) memFd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+}
+
+InferiorMemory::InferiorMemory(InferiorMemory&& other) noexcept :
+    pid_(std::exchange(other.pid_, 0)), memFd_(std::exchange(other.memFd_, -1)), 
+    generation_(other.generation_), pages_(std::move(other.pages_)), stats_(other.stats_) {}
+
+InferiorMemory& InferiorMemory::operator=(InferiorMemory&& other) noexcept {
+    if(this != &other) {
+        if(memFd_ != -1) close(memFd_);
+        pid_ = std::exchange(other.pid_, 0);
+        memFd_ = std::exchange(other.memFd_, -1);
+        generation_ = other.generation_;
+        pages_ = std::move(other.pages_);
+        stats_ = other.stats_;
+    }
+    return *this;
+}
+
+InferiorMemory::~InferiorMemory() {
+    if(memFd_ != -1) close(memFd_);
+}
+
+bool InferiorMemory::initialized() const { return pid_ != 0; }
+int InferiorMemory::getLastError() const { return lastError_; }
+uint64_t InferiorMemory::getGeneration() const { return generation_; }
+const InferiorMemory::CacheStats& InferiorMemory::getStats() const { return stats_; }
+void InferiorMemory::resetStats() { stats_ = CacheStats(); }
+
+void InferiorMemory::invalidate() {
+    ++generation_;
+    ++stats_.invalidations;
+    if(pages_.size() >= maxCachedPages) pages_.clear();     //stale pages are otherwise reused by fillPages()
+}
+
+const uint8_t* InferiorMemory::getCachedPage(uint64_t pageAddr) const {
+    auto it = pages_.find(pageAddr);
+    if(it == pages_.end() || it->second.generation != generation_) return nullptr;
+    return it->second.data.data();
+}
+
+/*
+    Fills up to count consecutive pages starting at pageAddr with a single bulk read and returns how many
+    were filled. The run stops at the first page that cannot be read in full, pages are never cached 
+    partially.
+*/
+size_t InferiorMemory::fillPages(uint64_t pageAddr, size_t count) const {
+    if(pages_.size() + count > maxCachedPages) pages_.clear();
+
+    scratch_.resize(count * pageSize);
+    size_t filled = readUncached(pageAddr, scratch_.data(), scratch_.size()) / pageSize;
+
+    for(size_t i = 0; i < filled; i++) {
+        auto& page = pages_[pageAddr + i * pageSize];
+        page.generation = generation_;
+        std::memcpy(page.data.data(), scratch_.data() + i * pageSize, pageSize);
+    }
+    return filled;
+}
+
+/*
+    read() copies out of cached pages and fills every run of missing pages with one bulk read. Ranges 
+    larger than a quarter of the cache (ex: big read_memory dumps) bypass it completely, as do pages that
+    cannot be read in full.
+*/
+size_t InferiorMemory::read(uint64_t addr, void* buffer, size_t len) const {
+    auto out = static_cast<uint8_t*>(buffer);
+    if(len == 0) return 0;
+    if(len > maxCachedPages * pageSize / 4) {
+        ++stats_.uncachedReads;
+        return readUncached(addr, out, len);
+    }
+
+    const uint64_t lastPage = (addr + len - 1) & ~(pageSize - 1);
+    uint64_t filledEnd = 0;     //pages below this were filled by this call and are not counted as hits
+    size_t done = 0;
+
+    while(done < len) {
+        uint64_t curr = addr + done;
+        uint64_t pageAddr = curr & ~(pageSize - 1);
+        auto page = getCachedPage(pageAddr);
+
+        if(page && pageAddr >= filledEnd) ++stats_.pageHits;
+        else if(!page) {
+            size_t run = 1;
+            while(pageAddr + run * pageSize <= lastPage && !getCachedPage(pageAddr + run * pageSize)) ++run;
+
+            auto filled = fillPages(pageAddr, run);
+            stats_.pageMisses += std::max<size_t>(filled, 1);
+            if(filled == 0) {
+                ++stats_.uncachedReads;
+                done += readUncached(curr, out + done, len - done);
+                break;
+            }
+            filledEnd = pageAddr + filled * pageSize;
+            page = getCachedPage(pageAddr);
+        }
+
+        auto offset = curr - pageAddr;
+        auto count = std::min(pageSize - offset, len - done);
+        std::memcpy(out + done, page + offset, count);
+        done += count;
+    }
+    return done;
+}
+
+/*
+    Each strategy returns the number of bytes it could read starting at addr. process_vm_readv() stops
+    at the first page it cannot access, so the remainder of the range is retried with the next strategy
+    (ex: a page that is mapped but not readable can still be read through /proc/pid/mem). A return of
+    zero from every strategy means the address itself is unreadable.
+*/
+size_t InferiorMemory::readUncached(uint64_t addr, uint8_t* out, size_t len) const {
+    size_t done = 0;
+
+    while(done < len) {
+        size_t n = readVM(addr + done, out + done, len - done);
+        if(n == 0) n = readProcMem(addr + done, out + done, len - done);
+        if(n == 0) n = readPeek(addr + done, out + done, len - done);
+        if(n == 0) break;
+        done += n;
+    }
+    return done;
+}
+
+size_t InferiorMemory::readVM(uint64_t addr, uint8_t* buffer, size_t len) const {
+    iovec local{buffer, len};
+    iovec remote{std::bit_cast<void*>(addr), len};
+
+    ++stats_.readSyscalls;
+    auto res = process_vm_readv(pid_, &local, 1, &remote, 1, 0);
+    if(res <= 0) lastError_ = (res == -1 ? errno : EFAULT);
+    return (res > 0 ? static_cast<size_t>(res) : 0);
+}
+
+size_t InferiorMemory::readProcMem(uint64_t addr, uint8_t* buffer, size_t len) const {
+    if(memFd_ == -1) return 0;
+    size_t done = 0;
+
+    while(done < len) {
+        ++stats_.readSyscalls;
+        auto res = pread(memFd_, buffer + done, len - done, static_cast<off_t>(addr + done));
+        if(res <= 0) {
+            lastError_ = (res == -1 ? errno : EIO);
+            break;
+        }
+        done += static_cast<size_t>(res);
+    }
+    return done;
+}
+
+size_t InferiorMemory::readPeek(uint64_t addr, uint8_t* buffer, size_t len) const {
+    size_t done = 0;
+
+    while(done < len) {
+        errno = 0;
+        ++stats_.readSyscalls;
+        long word = ptrace(PTRACE_PEEKDATA, pid_, addr + done, nullptr);
+        if(word == -1 && errno) {
+            lastError_ = errno;
+            break;
+        }
+
+        auto count = std::min(wordSize, len - done);
+        std::memcpy(buffer + done, &word, count);
+        done += count;
+    }
+    return done;
+}
+
+/*
+    Same fallback order as readUncached(). writable is a hint from the memory map: when the page is known 
+    to be read-only, process_vm_writev() is guaranteed to fail with EFAULT and is skipped entirely. Whatever
+    was written is copied into the pages cached for this stop.
+*/
+size_t InferiorMemory::write(uint64_t addr, const void* buffer, size_t len, bool writable) {
+    auto in = static_cast<const uint8_t*>(buffer);
+    size_t done = 0;
+
+    while(done < len) {
+        size_t n = (writable ? writeVM(addr + done, in + done, len - done) : 0);
+        if(n == 0) n = writeProcMem(addr + done, in + done, len - done);
+        if(n == 0) n = writePoke(addr + done, in + done, len - done);
+        if(n == 0) break;
+        done += n;
+    }
+
+    for(size_t i = 0; i < done;) {
+        uint64_t pageAddr = (addr + i) & ~(pageSize - 1);
+        auto offset = addr + i - pageAddr;
+        auto count = std::min(pageSize - offset, done - i);
+        auto it = pages_.find(pageAddr);
+
+        if(it != pages_.end() && it->second.generation == generation_) {
+            std::memcpy(it->second.data.data() + offset, in + i, count);
+        }
+        i += count;
+    }
+    return done;
+}
+
+size_t InferiorMemory::writeVM(uint64_t addr, const uint8_t* buffer, size_t len) {
+    iovec local{const_cast<uint8_t*>(buffer), len};
+    iovec remote{std::bit_cast<void*>(addr), len};
+
+    ++stats_.writeSyscalls;
+    auto res = process_vm_writev(pid_, &local, 1, &remote, 1, 0);
+    if(res <= 0) lastError_ = (res == -1 ? errno : EFAULT);
+    return (res > 0 ? static_cast<size_t>(res) : 0);
+}
+
+size_t InferiorMemory::writeProcMem(uint64_t addr, const uint8_t* buffer, size_t len) {
+    if(memFd_ == -1) return 0;
+    size_t done = 0;
+
+    while(done < len) {
+        ++stats_.writeSyscalls;
+        auto res = pwrite(memFd_, buffer + done, len - done, static_cast<off_t>(addr + done));
+        if(res <= 0) {
+            lastError_ = (res == -1 ? errno : EIO);
+            break;
+        }
+        done += static_cast<size_t>(res);
+    }
+    return done;
+}
+
+//A partial trailing word is merged with the bytes currently in memory so nothing past len is clobbered
+size_t InferiorMemory::writePoke(uint64_t addr, const uint8_t* buffer, size_t len) {
+    size_t done = 0;
+
+    while(done < len) {
+        uint64_t word = 0;
+        auto count = std::min(wordSize, len - done);
+        if(count < wordSize && readPeek(addr + done, std::bit_cast<uint8_t*>(&word), wordSize) != wordSize) {
+            break;
+        }
+        std::memcpy(&word, buffer + done, count);
+
+        errno = 0;
+        ++stats_.writeSyscalls;
+        if(ptrace(PTRACE_POKEDATA, pid_, addr + done, word) == -1) {
+            lastError_ = errno;
+            break;
+        }
+        done += count;
+    }
+    return done;
+}
+
+
+
+//Debugger memory related member functions
+
+/*
+    readMemoryBlock() returns the number of bytes read into buffer. The child's view of memory contains
+    an int3 (0xCC) at every enabled breakpoint, so the original byte saved by the breakpoint is written
+    back over the buffer. This way reads always show the program's actual instructions/data.
+*/
+size_t Debugger::readMemoryBlock(const uint64_t addr, uint8_t* buffer, const size_t len) const {
+    auto bytesRead = mem_.read(addr, buffer, len);
+
+    for(const auto& [bpAddr, bp] : addrToBp_) {
+        auto location = std::bit_cast<uint64_t>(bpAddr);
+        if(bp.isEnabled() && location >= addr && location - addr < bytesRead) {
+            buffer[location - addr] = bp.getData();
+        }
+    }
+    return bytesRead;
+}
+
+void Debugger::readMemory(const uint64_t addr, uint64_t &data) const {
+    uint64_t buffer;
+    if(readMemoryBlock(addr, std::bit_cast<uint8_t*>(&buffer), sizeof(buffer)) != sizeof(buffer)) {
+        throw std::runtime_error("\n[fatal] In Debugger::readMemory() - read error: "
+			+ std::string(strerror(mem_.getLastError())) + ".\n[fatal] Check Memory Address!\n");
+    }
+    data = buffer;
+}
+
+/*
+    writeMemoryBlock() returns the number of bytes written. Enabled breakpoints inside the range keep their
+    int3 in memory. The byte meant for that address becomes the breakpoint's saved byte instead, so it is
+    restored when the breakpoint is disabled and shows up in readMemoryBlock() right away. Saved bytes are
+    only replaced once the write has actually reached them.
+*/
+size_t Debugger::writeMemoryBlock(const uint64_t addr, const uint8_t* buffer, const size_t len) {
+    std::vector<uint8_t> patched;
+    std::vector<Breakpoint*> covered;
+    for(auto& [bpAddr, bp] : addrToBp_) {
+        auto location = std::bit_cast<uint64_t>(bpAddr);
+        if(!bp.isEnabled() || location < addr || location - addr >= len) continue;
+
+        if(patched.empty()) patched.assign(buffer, buffer + len);
+        patched[location - addr] = Breakpoint::int3;
+        covered.push_back(&bp);
+    }
+
+    bool writable = canWrite(addr).value_or(true);
+    size_t written = mem_.write(addr, (patched.empty() ? buffer : patched.data()), len, writable);
+
+    for(auto* bp : covered) {
+        auto offset = std::bit_cast<uint64_t>(bp->getAddr()) - addr;
+        if(offset < written) bp->setData(buffer[offset]);
+    }
+    return written;
+}
+
+/*
+    Pages watched by page watchpoints are read-only in /proc/pid/maps only because of the injected mprotect,
+    so they report the protection they had before being watched. Debugger writes to them then take the
+    same path as to any writable page, a failed process_vm_writev() falls back to /proc/pid/mem.
+*/
+std::optional<bool> Debugger::canWrite(uint64_t addr) const {
+    if(auto page = pageWatch_.getPage(addr)) return (page->prot & PROT_WRITE) != 0;
+    auto chunk = memMap_.getChunkFromAddr(addr);
+    if(!chunk) return std::nullopt;
+    return chunk.value().canWrite();
+}
+
+void Debugger::writeMemory(const uint64_t addr, const uint64_t &data) {
+    if(writeMemoryBlock(addr, std::bit_cast<const uint8_t*>(&data), sizeof(data)) != sizeof(data)) {
+       throw std::runtime_error("\n[fatal] In Debugger::writeMemory() - write error: " 
+			+ std::string(strerror(mem_.getLastError())) + ".\n[fatal] Check Memory Address!\n");
+    }
+}
+
+/*
+    Prints a block of memory read from the child. The format is one of:
+        x -> hexdump of bytes with an ascii column (default)
+        b, h, w, g -> 1, 2, 4 and 8 byte little endian units in hex
+    Each row covers 16 bytes and is prefixed by the absolute address of its first byte.
+*/
+void Debugger::dumpMemory(const uint64_t addr, const std::vector<uint8_t>& bytes, const char format) const {
+    constexpr size_t rowWidth = 16;
+    size_t unit = 1;
+    switch(format) {
+        case 'h': unit = 2; break;
+        case 'w': unit = 4; break;
+        case 'g': unit = 8; break;
+        default: break;
+    }
+
+    std::cout << std::hex << std::uppercase << std::setfill('0');
+    for(size_t row = 0; row < bytes.size(); row += rowWidth) {
+        auto rowEnd = std::min(row + rowWidth, bytes.size());
+        std::cout << "\n0x" << std::setw(12) << (addr + row) << ": ";
+
+        if(format == 'x') {
+            for(size_t i = row; i < row + rowWidth; i++) {
+                if(i < rowEnd) std::cout << std::setw(2) << static_cast<unsigned>(bytes[i]) << " ";
+                else std::cout << "   ";
+                if(i - row == rowWidth/2 - 1) std::cout << " ";
+            }
+            std::cout << " |";
+            for(size_t i = row; i < rowEnd; i++) {
+                std::cout << (std::isprint(bytes[i]) ? static_cast<char>(bytes[i]) : '.');
+            }
+            std::cout << "|";
+            continue;
+        }
+
+        for(size_t i = row; i + unit <= rowEnd; i += unit) {
+            uint64_t value = 0;
+            std::memcpy(&value, bytes.data() + i, unit);
+            std::cout << "0x" << std::setw(static_cast<int>(unit * 2)) << value << " ";
+        }
+    }
+    std::cout << std::setfill(' ') << "\n";
+}
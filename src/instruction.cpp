@@ -0,0 +1,224 @@
+#include "../include/instruction.h"
+
+#include <array>
+#include <algorithm>
+#include <optional>
+#include <cstdint>
+#include <cstddef>
+
+
+namespace {
+    //Operand layout of an opcode, immZ is 16 bits with an operand size prefix and immV is 64 with REX.W
+    enum Operands : uint8_t {
+        none = 0,
+        modrm = 1,
+        imm8 = 2,
+        imm16 = 4,
+        immZ = 8,
+        immV = 16,
+        rel8 = 32,
+        rel32 = 64,
+        invalid = 128
+    };
+
+    constexpr uint8_t oneByteOperands(unsigned op) {
+        if(op < 0x40) {
+            if((op & 7) < 4) return modrm;
+            if((op & 7) == 4) return imm8;
+            if((op & 7) == 5) return immZ;
+            return invalid;             //prefixes and the 0F escape are consumed before the lookup
+        }
+        if(op < 0x60) return none;      //REX is consumed before the lookup, 50-5F push/pop
+        if(op >= 0x70 && op <= 0x7F) return rel8;
+        if(op >= 0x84 && op <= 0x8F) return modrm;
+        if(op >= 0x90 && op <= 0x9F) return (op == 0x9A ? invalid : none);
+        if(op >= 0xA0 && op <= 0xA3) return none;       //moffs, sized by the address size
+        if(op >= 0xA4 && op <= 0xAF) return (op == 0xA8 ? imm8 : op == 0xA9 ? immZ : none);
+        if(op >= 0xB0 && op <= 0xB7) return imm8;
+        if(op >= 0xB8 && op <= 0xBF) return immV;
+        if(op >= 0xD8 && op <= 0xDF) return modrm;      //x87
+
+        switch(op) {
+            case 0x63: return modrm;
+            case 0x68: return immZ;
+            case 0x69: return modrm | immZ;
+            case 0x6A: return imm8;
+            case 0x6B: return modrm | imm8;
+            case 0x6C: case 0x6D: case 0x6E: case 0x6F: return none;
+            case 0x80: case 0x83: return modrm | imm8;
+            case 0x81: return modrm | immZ;
+            case 0xC0: case 0xC1: case 0xC6: return modrm | imm8;
+            case 0xC2: case 0xCA: return imm16;
+            case 0xC7: return modrm | immZ;
+            case 0xC8: return imm16 | imm8;
+            case 0xC3: case 0xC9: case 0xCB: case 0xCC: case 0xCF: return none;
+            case 0xCD: return imm8;
+            case 0xD0: case 0xD1: case 0xD2: case 0xD3: return modrm;
+            case 0xD7: return none;
+            case 0xE0: case 0xE1: case 0xE2: case 0xE3: case 0xEB: return rel8;
+            case 0xE4: case 0xE5: case 0xE6: case 0xE7: return imm8;
+            case 0xE8: case 0xE9: return rel32;
+            case 0xEC: case 0xED: case 0xEE: case 0xEF: return none;
+            case 0xF1: case 0xF4: case 0xF5: return none;
+            case 0xF6: case 0xF7: return modrm;         //the immediate depends on modrm.reg
+            case 0xF8: case 0xF9: case 0xFA: case 0xFB: case 0xFC: case 0xFD: return none;
+            case 0xFE: case 0xFF: return modrm;
+            default: return invalid;
+        }
+    }
+
+    constexpr uint8_t twoByteOperands(unsigned op) {
+        if(op >= 0x80 && op <= 0x8F) return rel32;
+        if(op >= 0xC8 && op <= 0xCF) return none;       //bswap
+        if(op >= 0x70 && op <= 0x73) return modrm | imm8;
+
+        switch(op) {
+            case 0x04: case 0x0A: case 0x0C: case 0x0F:
+            case 0x24: case 0x25: case 0x26: case 0x27:
+            case 0x36: case 0x38: case 0x39: case 0x3A: case 0x3B: case 0x3C: case 0x3D: case 0x3E: case 0x3F:
+            case 0x7A: case 0x7B:
+                return invalid;         //0F38 and 0F3A are separate maps
+            case 0x05: case 0x06: case 0x07: case 0x08: case 0x09: case 0x0B: case 0x0E:
+            case 0x30: case 0x31: case 0x32: case 0x33: case 0x34: case 0x35: case 0x37:
+            case 0x77: case 0xA0: case 0xA1: case 0xA2: case 0xA8: case 0xA9: case 0xAA:
+                return none;
+            case 0xA4: case 0xAC: case 0xBA: case 0xC2: case 0xC4: case 0xC5: case 0xC6:
+                return modrm | imm8;
+            default:
+                return modrm;
+        }
+    }
+
+    constexpr auto oneByteTable = [] {
+        std::array<uint8_t, 256> table{};
+        for(unsigned op = 0; op < 256; ++op) table[op] = oneByteOperands(op);
+        return table;
+    }();
+
+    constexpr auto twoByteTable = [] {
+        std::array<uint8_t, 256> table{};
+        for(unsigned op = 0; op < 256; ++op) table[op] = twoByteOperands(op);
+        return table;
+    }();
+
+    constexpr bool isLegacyPrefix(uint8_t byte) {
+        switch(byte) {
+            case 0xF0: case 0xF2: case 0xF3: case 0x2E: case 0x36: case 0x3E: case 0x26: case 0x64: case 0x65:
+            case 0x66: case 0x67:
+                return true;
+            default:
+                return false;
+        }
+    }
+}
+
+
+/*
+    Decoding runs in three steps: prefixes (legacy, then REX, or a VEX/EVEX prefix selecting an opcode map),
+    the opcode and its operand layout, then ModRM/SIB/displacement and the immediate. Map 0F38 has no
+    immediates and map 0F3A always has an imm8. VEX and EVEX instructions always have a ModRM byte, except
+    vzeroupper/vzeroall.
+*/
+std::optional<x86::Instruction> x86::decode(const uint8_t* code, size_t size) {
+    size = std::min(size, maxLength);
+    size_t i = 0;
+    bool operandSize = false, addressSize = false, rexW = false;
+
+    while(i < size && isLegacyPrefix(code[i])) {
+        if(code[i] == 0x66) operandSize = true;
+        else if(code[i] == 0x67) addressSize = true;
+        ++i;
+    }
+    if(i < size && (code[i] & 0xF0) == 0x40) rexW = (code[i++] & 0x08);
+    if(i >= size) return std::nullopt;
+    if(rexW) operandSize = false;       //REX.W wins over 66
+
+    unsigned map = 0;           //0: one byte, 1: 0F, 2: 0F38, 3: 0F3A
+    bool vex = false;
+    uint8_t lead = code[i];
+    if(lead == 0x8F && i + 1 < size && (code[i + 1] & 0x1F) >= 8) return std::nullopt;      //AMD XOP
+    if(lead == 0xC5) {
+        if(i + 1 >= size) return std::nullopt;
+        map = 1;
+        vex = true;
+        i += 2;
+    }
+    else if(lead == 0xC4 || lead == 0x62) {
+        size_t prefixLength = (lead == 0xC4 ? 3 : 4);
+        if(i + prefixLength > size) return std::nullopt;
+        map = code[i + 1] & (lead == 0xC4 ? 0x1F : 0x07);
+        rexW = (code[i + 2] & 0x80);
+        vex = true;
+        i += prefixLength;
+        if(map < 1 || map > 3) return std::nullopt;
+    }
+    else if(lead == 0x0F) {
+        if(i + 1 >= size) return std::nullopt;
+        map = (code[i + 1] == 0x38 ? 2 : code[i + 1] == 0x3A ? 3 : 1);
+        i += (map == 1 ? 1 : 2);
+    }
+    if(i >= size) return std::nullopt;
+
+    uint8_t op = code[i++];
+    uint8_t operands;
+    if(map == 0) operands = oneByteTable[op];
+    else if(map == 1) operands = (vex && op != 0x77 ? twoByteTable[op] | modrm : twoByteTable[op]);
+    else if(map == 2) operands = modrm;
+    else operands = modrm | imm8;
+    if(operands & invalid) return std::nullopt;
+    if(vex && (operands & (rel8 | rel32))) return std::nullopt;
+
+    Instruction insn;
+    size_t immediate = 0;
+    if(operands & modrm) {
+        if(i >= size) return std::nullopt;
+        uint8_t modRM = code[i++];
+        uint8_t mod = modRM >> 6, reg = (modRM >> 3) & 7, rm = modRM & 7;
+        size_t displacement = 0;
+
+        if(mod != 3 && rm == 4) {
+            if(i >= size) return std::nullopt;
+            if(mod == 0 && (code[i] & 7) == 5) displacement = 4;
+            ++i;
+        }
+        if(mod == 1) displacement = 1;
+        else if(mod == 2) displacement = 4;
+        else if(mod == 0 && rm == 5) {
+            if(addressSize) return std::nullopt;        //EIP-relative
+            insn.ripDisplacement = static_cast<uint8_t>(i);
+            displacement = 4;
+        }
+        i += displacement;
+
+        if(map == 0 && op == 0xF6 && reg < 2) immediate += 1;
+        if(map == 0 && op == 0xF7 && reg < 2) immediate += (operandSize ? 2 : 4);
+        if(map == 0 && op == 0xFF) {
+            if(reg == 2) insn.kind = Instruction::indirectCall;
+            else if(reg == 3 || reg == 5) return std::nullopt;          //far call/jmp
+        }
+    }
+
+    if(operands & imm8) immediate += 1;
+    if(operands & imm16) immediate += 2;
+    if(operands & immZ) immediate += (operandSize ? 2 : 4);
+    if(operands & immV) immediate += (rexW ? 8 : operandSize ? 2 : 4);
+    if(operands & rel8) {
+        immediate += 1;
+        insn.kind = Instruction::jump;
+    }
+    if(operands & rel32) {
+        if(operandSize) return std::nullopt;
+        immediate += 4;
+        insn.kind = (map == 0 && op == 0xE8 ? Instruction::call : Instruction::jump);
+    }
+    if(map == 0 && op >= 0xA0 && op <= 0xA3) immediate += (addressSize ? 4 : 8);
+
+    //Instructions that must run in place: int3, int n, int1, syscall/sysret, sysenter/sysexit
+    if(map == 0 && (op == 0xCC || op == 0xCD || op == 0xF1)) return std::nullopt;
+    if(map == 1 && !vex && (op == 0x05 || op == 0x07 || op == 0x34 || op == 0x35)) return std::nullopt;
+
+    i += immediate;
+    if(i > size) return std::nullopt;
+    insn.length = static_cast<uint8_t>(i);
+    return insn;
+}
@@ -0,0 +1,266 @@
+#include "../include/lineindex.h"
+
+#include <dwarf/dwarf++.hh>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <optional>
+#include <span>
+#include <utility>
+#include <cstdint>
+#include <tuple>
+#include <filesystem>
+
+
+//LineIndex::iterator Methods
+LineIndex::iterator::iterator(const LineIndex* index, size_t row) : index_(index), row_(row) {}
+
+const LineIndex::Entry& LineIndex::iterator::operator*() const { return index_->entries_[row_]; }
+const LineIndex::Entry* LineIndex::iterator::operator->() const { return &index_->entries_[row_]; }
+LineIndex::iterator& LineIndex::iterator::operator++() { ++row_; return *this; }
+LineIndex::iterator LineIndex::iterator::operator++(int) { auto prev = *this; ++row_; return prev; }
+const std::string& LineIndex::iterator::getFilePath() const { return index_->getFilePath((*this)->fileId); }
+size_t LineIndex::iterator::getRow() const { return row_; }
+
+
+
+//LineIndex Methods
+
+/*
+    A line's code locations are the statement rows where the line begins, ie: the line differs from the
+    previous row of the sequence. Rows that continue the same line (ex: a second is_stmt row for the
+    same line after a column change) do not start a new location.
+*/
+void LineIndex::addLocations(const std::vector<Entry>& sequence, std::vector<LineLocation>& locations) {
+    const Entry* prev = nullptr;
+    for(const auto& row : sequence) {
+        if(row.endSequence) break;
+        bool starts = !prev || prev->line != row.line || prev->fileId != row.fileId;
+        if(row.isStmt && starts) locations.push_back({row.fileId, row.line, row.address});
+        if(row.isStmt) prev = &row;
+    }
+}
+
+namespace {
+    /*
+        Rows are end_sequence first at equal addresses, so the last row at or below a pc is always the row
+        that covers it. This matches the behaviour of line_table::find_address().
+    */
+    bool rowBefore(const LineIndex::Entry& a, const LineIndex::Entry& b) {
+        return a.address < b.address || (a.address == b.address && a.endSequence && !b.endSequence);
+    }
+}
+
+/*
+    Rows are copied out of the unit's line table one sequence at a time. Sequences that start at address 0
+    are dropped: those belong to functions the linker discarded (ex: duplicate inline/template definitions),
+    and would otherwise shadow real code. The unit's rows are sorted here so only a merge is left to do.
+    Safe to run on any thread, it only touches this unit's line table.
+*/
+LineIndex::UnitLines LineIndex::readUnit(const dwarf::compilation_unit& cu) {
+    UnitLines unit;
+    const auto& lineTable = cu.get_line_table();
+    if(!lineTable.valid()) return unit;
+
+    std::unordered_map<const dwarf::line_table::file*, uint32_t> fileIds;
+    std::vector<Entry> sequence;
+    for(const auto& row : lineTable) {
+        auto [it, inserted] = fileIds.try_emplace(row.file, static_cast<uint32_t>(unit.files.size()));
+        if(inserted) unit.files.push_back(row.file ? row.file->path : "");
+
+        sequence.push_back({row.address, it->second, row.line, row.is_stmt, row.prologue_end, 
+            row.end_sequence});
+        if(row.end_sequence) {
+            if(sequence.front().address != 0) {
+                unit.entries.insert(unit.entries.end(), sequence.begin(), sequence.end());
+                addLocations(sequence, unit.locations);
+            }
+            sequence.clear();
+        }
+    }   //an unterminated sequence (malformed table) is dropped
+
+    std::stable_sort(unit.entries.begin(), unit.entries.end(), rowBefore);
+    return unit;
+}
+
+std::vector<LineIndex::UnitLines> LineIndex::readUnits(const dwarf::dwarf& dwarf, ThreadPool& pool) {
+    const auto& cus = dwarf.compilation_units();
+    std::vector<UnitLines> units(cus.size());
+    //One task per unit, every section was loaded by Debugger::loadDwarfSections() beforehand
+    pool.parallelFor(cus.size(), [&](size_t i) { units[i] = readUnit(cus[i]); });
+    return units;
+}
+
+LineIndex::LineIndex(const dwarf::dwarf& dwarf, ThreadPool& pool) : LineIndex(readUnits(dwarf, pool), &pool) {}
+
+/*
+    Units are merged in order: file paths are interned so every row only carries a 32-bit id, and each
+    unit's sorted rows are appended as one run. Adjacent runs are merged pairwise until one remains, every
+    level being a set of independent merges (handed to the pool if there is one). std::inplace_merge is
+    stable and the left run always holds the earlier units, so the result is the same as a stable sort of
+    every row in unit order.
+*/
+LineIndex::LineIndex(std::vector<UnitLines> units, ThreadPool* pool) {
+    std::unordered_map<std::string, uint32_t> fileIds;
+    std::vector<uint32_t> globalIds;
+    std::vector<size_t> runs{0};
+    for(auto& unit : units) {
+        globalIds.clear();
+        for(auto& path : unit.files) {
+            auto [it, inserted] = fileIds.try_emplace(path, static_cast<uint32_t>(files_.size()));
+            if(inserted) {
+                addFileSuffixes(path, it->second);
+                files_.push_back(std::move(path));
+            }
+            globalIds.push_back(it->second);
+        }
+
+        for(auto& entry : unit.entries) entry.fileId = globalIds[entry.fileId];
+        for(auto& location : unit.locations) location.fileId = globalIds[location.fileId];
+        if(!unit.entries.empty()) {
+            entries_.insert(entries_.end(), unit.entries.begin(), unit.entries.end());
+            runs.push_back(entries_.size());
+        }
+        locations_.insert(locations_.end(), unit.locations.begin(), unit.locations.end());
+        unit = UnitLines();
+    }
+
+    while(runs.size() > 2) {
+        std::vector<size_t> merged;
+        for(size_t i = 0; i + 1 < runs.size(); i += 2) merged.push_back(runs[i]);
+        merged.push_back(runs.back());
+        auto mergePair = [&](size_t pair) {
+            auto first = entries_.begin();
+            std::inplace_merge(first + runs[2 * pair], first + runs[2 * pair + 1], first + runs[2 * pair + 2],
+                rowBefore);
+        };
+        if(pool) pool->parallelFor((runs.size() - 1) / 2, mergePair);
+        else for(size_t pair = 0; pair < (runs.size() - 1) / 2; ++pair) mergePair(pair);
+        runs = std::move(merged);
+    }
+
+    addresses_.reserve(entries_.size());
+    for(const auto& entry : entries_) addresses_.push_back(entry.address);
+
+    std::sort(locations_.begin(), locations_.end(), [](const LineLocation& a, const LineLocation& b) {
+        return std::tie(a.fileId, a.line, a.address) < std::tie(b.fileId, b.line, b.address);
+    });
+    locations_.erase(std::unique(locations_.begin(), locations_.end(), [](const LineLocation& a, 
+        const LineLocation& b) { return a.fileId == b.fileId && a.line == b.line && a.address == b.address; }),
+        locations_.end());
+}
+
+//Files are stored as one '\0'-free arena plus offsets, the address array and path keys are rebuilt
+void LineIndex::save(IndexCache::Writer& writer) const {
+    std::string paths;
+    std::vector<uint32_t> offsets;
+    for(const auto& file : files_) {
+        offsets.push_back(static_cast<uint32_t>(paths.size()));
+        paths += file;
+    }
+    offsets.push_back(static_cast<uint32_t>(paths.size()));
+
+    writer.writeRecords(entries_, &Entry::address, &Entry::fileId, &Entry::line, &Entry::isStmt,
+        &Entry::prologueEnd, &Entry::endSequence);
+    writer.writeArray(locations_);
+    writer.writeString(paths);
+    writer.writeArray(offsets);
+}
+
+std::optional<LineIndex> LineIndex::load(IndexCache::Reader& reader) {
+    LineIndex index;
+    std::string paths;
+    std::vector<uint32_t> offsets;
+    if(!reader.readRecords(index.entries_, &Entry::address, &Entry::fileId, &Entry::line, &Entry::isStmt,
+            &Entry::prologueEnd, &Entry::endSequence)
+        || !reader.readArray(index.locations_) || !reader.readString(paths) || !reader.readArray(offsets)
+        || offsets.empty() || offsets.back() != paths.size()) return std::nullopt;
+
+    for(size_t i = 0; i + 1 < offsets.size(); ++i) {
+        if(offsets[i] > offsets[i + 1]) return std::nullopt;
+        index.files_.push_back(paths.substr(offsets[i], offsets[i + 1] - offsets[i]));
+        index.addFileSuffixes(index.files_.back(), static_cast<uint32_t>(i));
+    }
+
+    auto fileCount = index.files_.size();
+    for(size_t i = 0; i < index.entries_.size(); ++i) {
+        const auto& entry = index.entries_[i];
+        if(entry.fileId >= fileCount || (i > 0 && entry.address < index.entries_[i - 1].address)) return std::nullopt;
+        index.addresses_.push_back(entry.address);
+    }
+    for(const auto& location : index.locations_) {
+        if(location.fileId >= fileCount) return std::nullopt;
+    }
+    return index;
+}
+
+/*
+    Keys are built from the lexically normalized path, one per trailing run of components. An absolute
+    path also gets its full form as a key, so "/home/user/foo.cpp" and "home/user/foo.cpp" both match.
+*/
+void LineIndex::addFileSuffixes(const std::string& path, uint32_t fileId) {
+    std::string normal = std::filesystem::path(path).lexically_normal().string();
+    if(normal.empty()) return;
+    fileSuffixes_[normal].push_back(fileId);
+
+    for(size_t slash = normal.find('/'); slash != std::string::npos; slash = normal.find('/', slash + 1)) {
+        if(slash + 1 < normal.length()) fileSuffixes_[normal.substr(slash + 1)].push_back(fileId);
+    }
+}
+
+std::vector<uint32_t> LineIndex::findFiles(std::string_view path) const {
+    std::string normal = std::filesystem::path(path).lexically_normal().string();
+    auto it = fileSuffixes_.find(normal);
+    if(it == fileSuffixes_.end()) return {};
+    return it->second;
+}
+
+std::vector<uint64_t> LineIndex::getLineAddresses(uint32_t fileId, uint32_t line) const {
+    auto [first, last] = std::equal_range(locations_.begin(), locations_.end(), LineLocation{fileId, line, 0},
+        [](const LineLocation& a, const LineLocation& b) { 
+            return std::tie(a.fileId, a.line) < std::tie(b.fileId, b.line); 
+        });
+
+    std::vector<uint64_t> addresses;
+    for(auto it = first; it != last; ++it) addresses.push_back(it->address);
+    return addresses;
+}
+
+/*
+    Branch-free binary search for the last row whose address is at or below pc. The loop always runs
+    log2(n) times and the only data-dependent choice is a conditional move, so there are no mispredicted
+    branches on random lookups. An end_sequence row at that position means pc falls in a gap between
+    sequences.
+*/
+std::optional<LineIndex::iterator> LineIndex::find(uint64_t pc) const {
+    if(addresses_.empty() || pc < addresses_.front()) return std::nullopt;
+
+    const uint64_t* base = addresses_.data();
+    size_t n = addresses_.size();
+    while(n > 1) {
+        size_t half = n / 2;
+        base = (base[half] <= pc ? base + half : base);
+        n -= half;
+    }
+
+    size_t row = static_cast<size_t>(base - addresses_.data());
+    if(entries_[row].endSequence) return std::nullopt;
+    return iterator(this, row);
+}
+
+LineIndex::iterator LineIndex::lowerBound(uint64_t addr) const {
+    auto it = std::lower_bound(addresses_.begin(), addresses_.end(), addr);
+    return iterator(this, static_cast<size_t>(it - addresses_.begin()));
+}
+
+LineIndex::iterator LineIndex::begin() const { return iterator(this, 0); }
+LineIndex::iterator LineIndex::end() const { return iterator(this, entries_.size()); }
+std::span<const LineIndex::Entry> LineIndex::getEntries() const { return entries_; }
+
+const std::string& LineIndex::getFilePath(uint32_t fileId) const { return files_.at(fileId); }
+size_t LineIndex::size() const { return entries_.size(); }
+size_t LineIndex::fileCount() const { return files_.size(); }
+bool LineIndex::initialized() const { return !entries_.empty(); }
@@ -6,8 +6,12 @@
 #include <sys/ptrace.h>
 #include <signal.h>
 #include <sys/personality.h>
+#include <string_view>
+#include <utility>
 
 #include "../include/debugger.h"
+#include "../include/config.h"
+#include "../include/util.h"
 // #include "../include/state.h"
 
 // using state::STOPWAIT_SIGNAL;
@@ -21,12 +25,33 @@
 //Main Driver
 int main(int argc, char* argv[]) {
 
-    if(argc < 2) {
+    //Usage: pld [--jobs N] [--verbose] [--no-cache] [--lazy] <program>
+    Config config;
+    int arg = 1;
+    for(; arg < argc && std::string_view(argv[arg]).starts_with("--"); ++arg) {
+        std::string_view option = argv[arg];
+        uint64_t jobs = 0;
+        if(option == "--verbose") config.debugger_.timings_ = true;
+        else if(option == "--no-cache") config.debugger_.indexCache_ = false;
+        else if(option == "--lazy") config.debugger_.lazy_ = true;
+        else if(option == "--jobs" && arg + 1 < argc && util::validDecStol(jobs, argv[arg + 1]) && jobs > 0 
+            && jobs <= 1024) {
+            config.debugger_.jobs_ = static_cast<unsigned>(jobs);
+            ++arg;
+        }
+        else {
+            std::cerr << "[fatal] Invalid option: " << option << "\n"
+                "[fatal] Usage: pld [--jobs N] [--verbose] [--no-cache] [--lazy] <program>\n";
+            return 1;
+        }
+    }
+
+    if(arg >= argc) {
         std::cerr << "[fatal] Must specify Program name\n";
         return 1;
     }
     
-    auto progName = argv[1];
+    auto progName = argv[arg];
 
     //Masks STOPWAIT_SIGNAL
     sigset_t mask;
@@ -66,7 +91,7 @@ int main(int argc, char* argv[]) {
     //run debugger (if program reached here it is a parent)
     std::cout << "[debug] Entering parent debugger process....\n";
     
-    Debugger debug(pid, progName);
+    Debugger debug(pid, progName, std::move(config));
     debug.run();
 
     return 0;
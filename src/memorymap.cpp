@@ -6,16 +6,17 @@
 #include <sys/types.h>
 #include <vector>
 #include <bit>
-#include <fstream>
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
 #include <filesystem>
 #include <optional>
-#include <functional>
 
 
 
-using util::validHexStol;
-
-
 const std::array<MemoryMap::PathDescriptor, 10> MemoryMap::pathDescriptorList {{
     {"stack", MemoryMap::Path::stack},
     {"stackTID", MemoryMap::Path::stackTID},
@@ -36,51 +37,112 @@ bool MemoryMap::Chunk::canRead() const { return perms.read; }
 bool MemoryMap::Chunk::canWrite() const { return perms.write; }
 bool MemoryMap::Chunk::canExecute() const { return perms.execute; }
 
+uint64_t MemoryMap::Chunk::getFileOffset(uint64_t addr) const { return offset + (addr - addrLow); }
+
 // MemoryMap::MemoryMap() = default;
-MemoryMap::MemoryMap(pid_t pid, const std::string& pathToExectuable) : pid_ (pid), exec_(pathToExectuable) {
-    std::ifstream file;
-    file.open("/proc/" + std::to_string(pid) + "/maps");
-    if(!file.is_open()) {
+MemoryMap::MemoryMap(pid_t pid, const std::string& pathToExectuable) : pid_ (pid), exec_(pathToExectuable),
+    mapsPath_("/proc/" + std::to_string(pid) + "/maps") {
+    if(!parse()) {
         throw std::runtime_error("[fatal] In MemoryMap::MemoryMap() - "
             "/proc/pid/maps could not be opened! Check permisions.\n");
     }
-    std::string line = "";
-    
-    while(std::getline(file, line, '\n')) {
-        uint64_t low, high;
-        bool read = false, write = false, execute = false, shared = false;
-        Path path;
-        std::string pathname = "";
-        
-        std::string_view view(line);
-        auto dashPos = view.find_first_of('-');
-        auto spacePos = view.find_first_of(' ');
-
-        auto addrLow = view.substr(0, dashPos);
-        auto addrHigh = view.substr(dashPos + 1, spacePos - (dashPos + 1));
-        if(!validHexStol(low, addrLow) || !validHexStol(high, addrHigh)) {
-            file.close();
-            throw std::runtime_error("[fatal] In MemoryMap::MemoryMap() - "
-                "Address space not resolved correctly\n");
-        }
+}
 
-        view = view.substr(spacePos + 1);
-        if(view[0] == 'r') read = true;
-        if(view[1] == 'w') write = true;
-        if(view[2] == 'x') execute = true;
-        if(view[3] == 's') shared = true;
 
-        spacePos = view.find_last_of(" \t");
-        view = view.substr(spacePos + 1);
+namespace {
+    //Decodes digits of the given base at p, leaves p on the first character that is not one
+    template <unsigned base>
+    uint64_t parseNumber(const char*& p, const char* end) {
+        uint64_t value = 0;
+        for(; p < end; ++p) {
+            unsigned digit;
+            if(*p >= '0' && *p <= '9') digit = *p - '0';
+            else if(base == 16 && *p >= 'a' && *p <= 'f') digit = *p - 'a' + 10;
+            else if(base == 16 && *p >= 'A' && *p <= 'F') digit = *p - 'A' + 10;
+            else break;
+            value = value * base + digit;
+        }
+        return value;
+    }
+
+    void skipSpaces(const char*& p, const char* end) {
+        while(p < end && (*p == ' ' || *p == '\t')) ++p;
+    }
+}
 
-        pathname = std::string(view);
-        path = getPathFromFullPathname(view);
-        Permissions perms(read, write, execute, shared);
-        chunks_.emplace_back(Chunk(low, high, perms, path, pathname)); //fix suffix logic
+/*
+    /proc/pid/maps is read with raw read() calls into a buffer that is kept between parses, and every field
+    is decoded in place. Chunks are overwritten where they are and pathnames assigned into their existing
+    strings, so a reparse allocates nothing once the buffer, chunk array and strings have grown to fit.
+    Lines look like:
+        low-high perms offset major:minor inode    pathname
+    The pathname runs to the end of the line, it may contain spaces or end with " (deleted)".
+
+    Returns false if /proc/pid/maps could not be opened (ex: child is gone), chunks are left untouched.
+*/
+bool MemoryMap::parse() const {
+    int fd = open(mapsPath_.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd == -1) return false;
+
+    if(buffer_.empty()) buffer_.resize(initialBufferSize_);
+    size_t used = 0;
+    while(true) {
+        if(used == buffer_.size()) buffer_.resize(buffer_.size() * 2);
+        ssize_t res = read(fd, buffer_.data() + used, buffer_.size() - used);
+        if(res == -1 && errno == EINTR) continue;
+        if(res <= 0) break;
+        used += static_cast<size_t>(res);
     }
+    close(fd);
+
+    size_t count = 0;
+    lastHit_ = 0;
+    const char* p = buffer_.data();
+    const char* end = p + used;
+
+    while(p < end) {
+        const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+        if(!lineEnd) lineEnd = end;
+        const char* start = p;
+
+        if(count == chunks_.size()) chunks_.emplace_back();
+        Chunk& c = chunks_[count++];
+        c.addrLow = parseNumber<16>(p, lineEnd);
+        bool valid = (p != start && p < lineEnd && *p == '-');
+        const char* highStart = ++p;
+        c.addrHigh = parseNumber<16>(p, lineEnd);
+        valid = valid && p != highStart && lineEnd - p >= 5;
+        if(!valid) {
+            chunks_.resize(count - 1);
+            throw std::runtime_error("[fatal] In MemoryMap::parse() - "
+                "Address space not resolved correctly\n");
+        }
 
-    file.close();
+        ++p;    //perms
+        c.perms = Permissions(p[0] == 'r', p[1] == 'w', p[2] == 'x', p[3] == 's');
+        p += 4;
+        skipSpaces(p, lineEnd);
+        c.offset = parseNumber<16>(p, lineEnd);
+        skipSpaces(p, lineEnd);
+        c.devMajor = static_cast<uint32_t>(parseNumber<16>(p, lineEnd));
+        if(p < lineEnd && *p == ':') ++p;
+        c.devMinor = static_cast<uint32_t>(parseNumber<16>(p, lineEnd));
+        skipSpaces(p, lineEnd);
+        c.inode = parseNumber<10>(p, lineEnd);
+        skipSpaces(p, lineEnd);
+
+        c.pathname.assign(p, lineEnd - p);
+        c.path = getPathFromFullPathname(c.pathname);
+        p = lineEnd + 1;
+    }
+    chunks_.resize(count);
 
+    if(!std::is_sorted(chunks_.begin(), chunks_.end(), [](const Chunk& a, const Chunk& b) { 
+        return a.addrLow < b.addrLow; })) {
+        std::sort(chunks_.begin(), chunks_.end(), [](const Chunk& a, const Chunk& b) { 
+            return a.addrLow < b.addrLow; });
+    }
+    return true;
 }
 
 
@@ -93,7 +155,8 @@ MemoryMap::MemoryMap(pid_t pid, const std::string& pathToExectuable) : pid_ (pid
 
 
 MemoryMap::Path MemoryMap::getPathFromFullPathname(std::string_view pathname) const {
-    if(pathname[0] == '/') {
+    if(pathname.empty()) return Path::anon;
+    else if(pathname[0] == '/') {
         auto sharedLibraryCheck = pathname.find(".so");
         if(sharedLibraryCheck != std::string_view::npos) {
             auto possibleSO = pathname.substr(sharedLibraryCheck);
@@ -103,7 +166,7 @@ MemoryMap::Path MemoryMap::getPathFromFullPathname(std::string_view pathname) co
         else return Path::mmap;
     }
     else if(pathname[0] == '[') {
-        pathname = std::string(pathname.substr(1, pathname.find_first_of(']') - 1));
+        pathname = pathname.substr(1, pathname.find_first_of(']') - 1);
         //std::cout << "DEBUG: " << pathname << "\n";
         auto suffix = pathname.find(':');
         if(suffix != std::string_view::npos) pathname = pathname.substr(0, suffix);
@@ -123,11 +186,27 @@ MemoryMap::Path MemoryMap::getPathFromFullPathname(std::string_view pathname) co
 }
 
 void MemoryMap::reload() {
-    MemoryMap newMM(pid_, exec_);
-    chunks_ = std::move(newMM.chunks_);
+    stale_ = true;
+    refresh();
+}
+
+void MemoryMap::invalidate() { stale_ = true; }
+bool MemoryMap::isStale() const { return stale_; }
+uint64_t MemoryMap::getGeneration() const { return generation_; }
+
+/*
+    Reparses in place, which is only safe because no reference into chunks_ or its strings ever leaves
+    the class. If the maps can't be read anymore the last parsed chunks are kept, they are the best
+    information left.
+*/
+void MemoryMap::refresh() const {
+    if(!stale_) return;
+    if(parse()) ++generation_;
+    stale_ = false;
 }
 
-const std::vector<MemoryMap::Chunk>& MemoryMap::getChunks() const {
+std::vector<MemoryMap::Chunk> MemoryMap::getChunks() const {
+    refresh();
     return chunks_;
 }
 
@@ -147,7 +226,7 @@ std::string MemoryMap::getNameFromPath(Path p) {
 }
 
 
-std::string MemoryMap::getFileNameFromChunk(Chunk c) {
+std::string MemoryMap::getFileNameFromChunk(const Chunk& c) {
     if(c.path == Path::exec || c.path == Path::so || c.path == Path::mmap) {
         std::filesystem::path p(c.pathname);
         //std::cout << "[test] Pathname from filesystem path: " << c.pathname << "\n";
@@ -159,35 +238,39 @@ std::string MemoryMap::getFileNameFromChunk(Chunk c) {
 }
 
 void MemoryMap::printChunk(uint64_t pc) const {
+    refresh();
     if(chunks_.empty()) {
         std::cout << "[warning] No memory chunks have been mapped\n";
         return;
     }
 
-    std::cout << "\n";
-    for(const auto& c : chunks_) {
-        if(pc < c.addrLow || pc >= c.addrHigh ) continue;
-
-        const auto& perms = c.perms;
-        std::cout << "--------------------------------------------------------\n"
-            "Current Chunk --> " << c.pathname << "\n" 
-            "Path Type: " << getNameFromPath(c.path) << "\n"
-            "Permissions (read-write-execute-shared): " 
-                << (perms.read ? "r" : "-")
-                << (perms.write ? "w" : "-")
-                << (perms.execute ? "x" : "-")
-                << (perms.shared ? "s" : "p")
-                << "\n"
-            "Lowest Address: " << std::hex << std::uppercase << c.addrLow << "\n"
-            "Highest Address: " << c.addrHigh << "\n"
-            "(" << c.addrLow << "-" << c.addrHigh << ")\n"
-            "--------------------------------------------------------\n";
+    auto chunk = getChunkFromAddr(pc);
+    if(!chunk) {
+        std::cout << "[warning] Address is not in mapped memory\n";
         return;
     }
-    std::cout << "[warning] Address is not in mapped memory\n";
+
+    const auto& c = chunk.value();
+    const auto& perms = c.perms;
+    std::cout << "\n--------------------------------------------------------\n"
+        "Current Chunk --> " << c.pathname << "\n" 
+        "Path Type: " << getNameFromPath(c.path) << "\n"
+        "Permissions (read-write-execute-shared): " 
+            << (perms.read ? "r" : "-")
+            << (perms.write ? "w" : "-")
+            << (perms.execute ? "x" : "-")
+            << (perms.shared ? "s" : "p")
+            << "\n"
+        "Lowest Address: " << std::hex << std::uppercase << c.addrLow << "\n"
+        "Highest Address: " << c.addrHigh << "\n"
+        "(" << c.addrLow << "-" << c.addrHigh << ")\n"
+        "File Offset: 0x" << c.offset << " (device " << c.devMajor << ":" << c.devMinor 
+            << ", inode " << std::dec << c.inode << ")\n"
+        "--------------------------------------------------------\n";
 }
 
 void MemoryMap::dumpChunks() const {
+    refresh();
     if(chunks_.empty()) {
         std::cout << "[warning] No memory chunks have been mapped\n";
         return;
@@ -208,16 +291,22 @@ void MemoryMap::dumpChunks() const {
             "Lowest Address: " << std::hex << std::uppercase << c.addrLow << "\n"
             "Highest Address: " << c.addrHigh << "\n"
             "(" << c.addrLow << "-" << c.addrHigh << ")\n"
+            "File Offset: 0x" << c.offset << " (device " << c.devMajor << ":" << c.devMinor 
+                << ", inode " << std::dec << c.inode << ")\n"
             "--------------------------------------------------------\n";
         ++i;
     }
 }
 
-std::optional<std::reference_wrapper<const MemoryMap::Chunk>>MemoryMap::getChunkFromAddr(uint64_t addr) const {
-    for(const auto& c : chunks_) {
-        if(c.contains(addr)) return c;
-    }
-    return std::nullopt;
+std::optional<MemoryMap::Chunk> MemoryMap::getChunkFromAddr(uint64_t addr) const {
+    refresh();
+    if(lastHit_ < chunks_.size() && chunks_[lastHit_].contains(addr)) return chunks_[lastHit_];
+
+    auto it = std::upper_bound(chunks_.begin(), chunks_.end(), addr, 
+        [](uint64_t a, const Chunk& c) { return a < c.addrLow; });
+    if(it == chunks_.begin() || !(--it)->contains(addr)) return std::nullopt;
+    lastHit_ = static_cast<size_t>(it - chunks_.begin());
+    return *it;
 }
 
 bool MemoryMap::initialized() const {
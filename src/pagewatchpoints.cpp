@@ -0,0 +1,104 @@
+#include "../include/pagewatchpoints.h"
+
+#include <map>
+#include <vector>
+#include <optional>
+#include <functional>
+#include <utility>
+#include <stdexcept>
+#include <cstdint>
+
+
+namespace {
+    constexpr uint64_t pageOf(uint64_t addr) { return addr & ~(PageWatchpoints::pageSize - 1); }
+}
+
+
+
+//PageWatchpoints Methods
+std::pair<uint64_t, std::vector<PageWatchpoints::Run>> PageWatchpoints::add(uint64_t addr, uint64_t length,
+        const std::function<int(uint64_t)>& protection) {
+    std::vector<std::pair<uint64_t, int>> added;
+    for(uint64_t page = pageOf(addr); page < addr + length; page += pageSize) {
+        auto [it, inserted] = pages_.try_emplace(page, Page{0, 0});
+        if(inserted) {
+            it->second.prot = protection(page);
+            added.emplace_back(page, it->second.prot);
+        }
+        ++it->second.watchers;
+    }
+
+    uint64_t id = nextId_++;
+    watchpoints_.emplace(id, Watchpoint{addr, length});
+    return {id, coalesce(added)};
+}
+
+std::optional<std::vector<PageWatchpoints::Run>> PageWatchpoints::remove(uint64_t id) {
+    auto found = watchpoints_.find(id);
+    if(found == watchpoints_.end()) return std::nullopt;
+
+    std::vector<std::pair<uint64_t, int>> released;
+    const auto& wp = found->second;
+    for(uint64_t page = pageOf(wp.addr); page < wp.addr + wp.length; page += pageSize) {
+        auto it = pages_.find(page);
+        if(it == pages_.end() || --it->second.watchers) continue;
+        released.emplace_back(page, it->second.prot);
+        pages_.erase(it);
+    }
+    watchpoints_.erase(found);
+    return coalesce(released);
+}
+
+std::vector<PageWatchpoints::Run> PageWatchpoints::clear() {
+    std::vector<std::pair<uint64_t, int>> released;
+    for(const auto& [page, info] : pages_) released.emplace_back(page, info.prot);
+    pages_.clear();
+    watchpoints_.clear();
+    return coalesce(released);
+}
+
+std::optional<PageWatchpoints::Run> PageWatchpoints::getPage(uint64_t addr) const {
+    auto it = pages_.find(pageOf(addr));
+    if(it == pages_.end()) return std::nullopt;
+    return Run{it->first, pageSize, it->second.prot};
+}
+
+std::optional<uint64_t> PageWatchpoints::find(uint64_t addr) const {
+    for(const auto& [id, wp] : watchpoints_) {
+        if(addr >= wp.addr && addr - wp.addr < wp.length) return id;
+    }
+    return std::nullopt;
+}
+
+void PageWatchpoints::countFalseHit(uint64_t page) {
+    page = pageOf(page);
+    for(auto& [id, wp] : watchpoints_) {
+        if(pageOf(wp.addr) <= page && page < wp.addr + wp.length) ++wp.falseHits;
+    }
+}
+
+PageWatchpoints::Watchpoint& PageWatchpoints::get(uint64_t id) {
+    auto it = watchpoints_.find(id);
+    if(it == watchpoints_.end()) throw std::out_of_range("[fatal] In PageWatchpoints::get() - unknown id");
+    return it->second;
+}
+
+bool PageWatchpoints::empty() const { return watchpoints_.empty(); }
+
+const std::map<uint64_t, PageWatchpoints::Watchpoint>& PageWatchpoints::getWatchpoints() const {
+    return watchpoints_;
+}
+
+//Pages arrive in address order
+std::vector<PageWatchpoints::Run> PageWatchpoints::coalesce(const std::vector<std::pair<uint64_t, int>>& pages) {
+    std::vector<Run> runs;
+    for(const auto& [page, prot] : pages) {
+        if(!runs.empty() && runs.back().addr + runs.back().length == page && runs.back().prot == prot) {
+            runs.back().length += pageSize;
+        }
+        else {
+            runs.push_back(Run{page, pageSize, prot});
+        }
+    }
+    return runs;
+}
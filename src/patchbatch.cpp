@@ -0,0 +1,93 @@
+#include "../include/patchbatch.h"
+#include "../include/breakpoint.h"
+#include "../include/inferiormemory.h"
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <bit>
+
+
+//PatchBatch Methods
+PatchBatch::PatchBatch(InferiorMemory* mem) : mem_(mem) {}
+
+void PatchBatch::enable(Breakpoint& bp) { ops_.push_back({&bp, true}); }
+void PatchBatch::disable(Breakpoint& bp) { ops_.push_back({&bp, false}); }
+bool PatchBatch::empty() const { return ops_.empty(); }
+size_t PatchBatch::size() const { return ops_.size(); }
+
+size_t PatchBatch::apply() {
+    std::stable_sort(ops_.begin(), ops_.end(), [](const Op& a, const Op& b) {
+        return a.bp->getAddr() < b.bp->getAddr();
+    });
+
+    //The last operation per address wins, then anything that would not change a breakpoint is dropped
+    std::vector<Op> ops;
+    ops.reserve(ops_.size());
+    for(const auto& op : ops_) {
+        if(!ops.empty() && ops.back().bp->getAddr() == op.bp->getAddr()) ops.back() = op;
+        else ops.push_back(op);
+    }
+    std::erase_if(ops, [](const Op& op) { return op.bp->isEnabled() == op.enable; });
+    ops_.clear();
+
+    size_t patched = 0;
+    for(size_t i = 0; i < ops.size();) {
+        auto page = std::bit_cast<uint64_t>(ops[i].bp->getAddr()) & ~(InferiorMemory::pageSize - 1);
+        size_t j = i + 1;
+        while(j < ops.size() && (std::bit_cast<uint64_t>(ops[j].bp->getAddr()) & ~(InferiorMemory::pageSize - 1)) 
+            == page) ++j;
+        patched += applyPage(ops.data() + i, ops.data() + j);
+        i = j;
+    }
+    return patched;
+}
+
+/*
+    Ops are sorted and on the same page. If the span cannot be written in one go, every breakpoint is 
+    patched on its own from the bytes already read, so a partial write is never mistaken for original code.
+*/
+size_t PatchBatch::applyPage(const Op* first, const Op* last) {
+    auto low = std::bit_cast<uint64_t>(first->bp->getAddr());
+    auto length = std::bit_cast<uint64_t>((last - 1)->bp->getAddr()) - low + 1;
+    buffer_.resize(length);
+
+    errno = 0;
+    if(mem_->read(low, buffer_.data(), length) != length) {
+        std::cerr << "[critical] Breakpoint patch at 0x" << std::hex << std::uppercase << low
+            << " has failed: " << strerror(errno) << "\n";
+        return 0;
+    }
+
+    for(auto op = first; op != last; ++op) {
+        auto offset = std::bit_cast<uint64_t>(op->bp->getAddr()) - low;
+        if(op->enable) {
+            op->bp->setData(buffer_[offset]);
+            buffer_[offset] = Breakpoint::int3;
+        }
+        else buffer_[offset] = op->bp->getData();
+    }
+
+    if(mem_->write(low, buffer_.data(), length, false) == length) {
+        for(auto op = first; op != last; ++op) op->bp->setEnabled(op->enable);
+        return static_cast<size_t>(last - first);
+    }
+
+    size_t patched = 0;
+    for(auto op = first; op != last; ++op) {
+        uint8_t byte = (op->enable ? Breakpoint::int3 : op->bp->getData());
+        errno = 0;
+        if(mem_->write(std::bit_cast<uint64_t>(op->bp->getAddr()), &byte, 1, false) == 1) {
+            op->bp->setEnabled(op->enable);
+            ++patched;
+        }
+        else {
+            std::cerr << "[critical] " << (op->enable ? "Enable" : "Disable") << " Breakpoint has failed: " 
+                << strerror(errno) << "\n";
+        }
+    }
+    return patched;
+}
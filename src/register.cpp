@@ -9,6 +9,8 @@
 #include <algorithm>
 #include <bit>
 #include <iostream>
+#include <cstring>
+#include <cerrno>
 
 using namespace reg;
 
@@ -45,46 +47,71 @@ namespace reg {
 		{55, "gs", Reg::gs}
     }};
 
-	bool setRegisterValue(pid_t pid, Reg r, uint64_t val) {
-		errno = 0;
-		user_regs_struct regVals;
-		ptrace(PTRACE_GETREGS, pid, nullptr, &regVals);
+	//Reg enumerators follow the field order of user_regs_struct, so a register's index is its offset in words
+	static_assert(sizeof(user_regs_struct) == registerCount_ * sizeof(uint64_t));
 
-		auto it =
-			std::find_if(regDescriptorList.begin(), regDescriptorList.end(), [r](auto&& rd) {
-				return r == rd.r;
-			}
-		);
-		*(std::bit_cast<uint64_t*>(&regVals) + (it - regDescriptorList.begin())) = val;
+	RegisterCache::RegisterCache(pid_t pid) : pid_(pid) {}
 
-		return (ptrace(PTRACE_SETREGS, pid, nullptr, &regVals) != -1);
+	user_regs_struct& RegisterCache::get() {
+		if(valid_) {
+			++stats_.hits;
+			return regs_;
+		}
+		errno = 0;
+		++stats_.fetches;
+		if(ptrace(PTRACE_GETREGS, pid_, nullptr, &regs_) == -1) {
+			std::cerr << "[critical] register values could not be acquired: " << strerror(errno) << "\n";
+			return regs_;		//not marked valid, the next access retries
+		}
+		valid_ = true;
+		return regs_;
 	}
 
-    uint64_t getRegisterValue(const pid_t pid, const Reg r) {
+	void RegisterCache::markDirty() { dirty_ = true; }
+
+	bool RegisterCache::flush() {
+		if(!dirty_) return true;
 		errno = 0;
-		user_regs_struct regVals;
-		ptrace(PTRACE_GETREGS, pid, nullptr, &regVals);
+		++stats_.flushes;
+		if(ptrace(PTRACE_SETREGS, pid_, nullptr, &regs_) == -1) return false;	//stays dirty for a retry
+		dirty_ = false;
+		return true;
+	}
 
-		//auto&& -> reference to const regDescriptor struct
-		auto it =
-			std::find_if(regDescriptorList.begin(), regDescriptorList.end(), [r](auto&& rd) {
-				return r == rd.r;
-			}
-		);
-		return *(std::bit_cast<uint64_t*>(&regVals) + (it - regDescriptorList.begin()));
+	void RegisterCache::invalidate() {
+		valid_ = false;
+		dirty_ = false;
+	}
+
+	bool RegisterCache::isValid() const { return valid_; }
+	const RegisterCache::CacheStats& RegisterCache::getStats() const { return stats_; }
+	void RegisterCache::resetStats() { stats_ = CacheStats(); }
+
+
+	bool setRegisterValue(RegisterCache& cache, Reg r, uint64_t val) {
+		auto& regVals = cache.get();
+		if(!cache.isValid() || r == Reg::INVALID_REG) return false;
+
+		*(std::bit_cast<uint64_t*>(&regVals) + static_cast<int>(r)) = val;
+		cache.markDirty();
+		return true;
 	}
 
-    uint64_t getRegisterValue(const pid_t pid, const int dwarfNum) {
-		user_regs_struct regVals;
-		ptrace(PTRACE_GETREGS, pid, nullptr, &regVals);
+    uint64_t getRegisterValue(RegisterCache& cache, const Reg r) {
+		if(r == Reg::INVALID_REG) return 0;
+		auto& regVals = cache.get();
+		return *(std::bit_cast<uint64_t*>(&regVals) + static_cast<int>(r));
+	}
 
+    uint64_t getRegisterValue(RegisterCache& cache, const int dwarfNum) {
 		//auto&& -> reference to const regDescriptor struct
 		auto it =
 			std::find_if(regDescriptorList.begin(), regDescriptorList.end(), [dwarfNum](auto&& rd) {
 				return dwarfNum == rd.dwarfNum;
 			}
 		);
-		return *(std::bit_cast<uint64_t*>(&regVals) + (it - regDescriptorList.begin()));
+		if(it == regDescriptorList.end()) return 0;
+		return getRegisterValue(cache, it->r);
 	}
 
     std::string getRegisterName(const Reg r) {
@@ -103,18 +130,16 @@ namespace reg {
 		return it->r;
 	}
 
-	bool getAllRegisterValues(const pid_t pid, user_regs_struct& rawRegVals) {
-		errno = 0;
-		//auto res = ptrace(PTRACE_GETREGS, pid, nullptr, &rawRegVals);
-		return (ptrace(PTRACE_GETREGS, pid, nullptr, &rawRegVals) != -1);
-		//return std::bit_cast<uint64_t*>(&rawRegVals);	//dangling pointer if regVals is not a parameter!
+	bool getAllRegisterValues(RegisterCache& cache, user_regs_struct& rawRegVals) {
+		rawRegVals = cache.get();
+		return cache.isValid();
 	}
 
-	bool setAllRegisterValues(const pid_t pid, user_regs_struct& rawRegVals) {
-		errno = 0;
-		//static_assert(sizeof(user_regs_struct) % sizeof(uint64_t) == 0, "Mismatched size");
-		//auto userRegsStruct = *(std::bit_cast<user_regs_struct*>(rawRegVals));
-		return (ptrace(PTRACE_SETREGS, pid, nullptr, &rawRegVals) != -1);
+	bool setAllRegisterValues(RegisterCache& cache, user_regs_struct& rawRegVals) {
+		cache.get() = rawRegVals;
+		if(!cache.isValid()) return false;
+		cache.markDirty();
+		return true;
 	}
 
 }
@@ -130,10 +155,7 @@ namespace reg {
     */
 void Debugger::dumpRegisters() const {
     user_regs_struct rawRegVals;
-    if(!getAllRegisterValues(pid_, rawRegVals)) {
-		std::cerr << "[critical] register values could not be acquired: " << strerror(errno) << "\n";
-		return;
-	}
+    if(!getAllRegisterValues(regs_, rawRegVals)) return;	//error reported by the register cache
 	auto regVals = std::bit_cast<uint64_t*>(&rawRegVals);
     for(auto& rd : regDescriptorList) {     //uppercase vs nouppercase (default)
         std::cout << "\n" << rd.regName << ": " << std::hex << std::uppercase << "0x" << *regVals;    
@@ -143,26 +165,3 @@ void Debugger::dumpRegisters() const {
 
 }
 
-
-//add support for multiple words eventually (check notes/TODO)
-void Debugger::readMemory(const uint64_t addr, uint64_t &data) const {  //PEEKDATA, show errors if needed
-    errno = 0;
-    long res = ptrace(PTRACE_PEEKDATA, pid_, addr, nullptr);
-    
-    if(res == -1) {
-        throw std::runtime_error("\n[fatal] In Debugger::readMemory() - ptrace error: " 
-			+ std::string(strerror(errno)) + ".\n[fatal] Check Memory Address!\n");
-    }
-
-    data = std::bit_cast<uint64_t>(res);
-}
-
-void Debugger::writeMemory(const uint64_t addr, const uint64_t &data) { //POKEDATA, show errors if needed
-    errno = 0;
-    long res = ptrace(PTRACE_POKEDATA, pid_, addr, data);     //const on data since its just a write
-
-    if(res == -1) {
-       throw std::runtime_error("\n[fatal] In Debugger::writeMemory() - ptrace error: " 
-			+ std::string(strerror(errno)) + ".\n[fatal] Check Memory Address!\n");
-    }
-}
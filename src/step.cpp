@@ -4,15 +4,22 @@
 #include "../include/register.h"
 #include "../include/breakpoint.h"
 #include "../include/memorymap.h"
+#include "../include/patchbatch.h"
+#include "../include/instruction.h"
 
 #include <dwarf/dwarf++.hh>
 
 #include <sys/ptrace.h>
+#include <sys/mman.h>
 #include <stdexcept>
 #include <unordered_map>
 #include <utility>
 #include <bit>
 #include <cstdint>
+#include <cstring>
+#include <climits>
+#include <array>
+#include <algorithm>
 
 using namespace reg;
 using util::promptYesOrNo;
@@ -21,7 +28,9 @@ using namespace state;
 /* Below are all the Debugger class member functions that involve stepping. */
 
 
-void Debugger::singleStep() {
+//False if the registers could not be written back, the child is not stepped then
+bool Debugger::singleStep() {
+    if(!prepareToResume(true)) return false;
     errno = 0;
     long res = ptrace(PTRACE_SINGLESTEP, pid_, nullptr, nullptr);
 
@@ -30,9 +39,10 @@ void Debugger::singleStep() {
             + std::string(strerror(errno)) + "..\n[fatal] Single Step Failed!\n");
     }
     waitForSignal();
+    return true;
 }
 
-void Debugger::singleStepBreakpointCheck() {  
+bool Debugger::singleStepBreakpointCheck() {  
     auto addr = std::bit_cast<intptr_t>(getPC());
     auto it = addrToBp_.find(addr);
     
@@ -42,26 +52,143 @@ void Debugger::singleStepBreakpointCheck() {
             //"[debug] Preparing to cleanup and exit...\n";
         if(state_ == Child::running) state_ = Child::finish;
         else if(state_ == Child::faulting) state_ = Child::force_detach;
-        return;
+        return true;
     }
-    else if(it == addrToBp_.end()) {
-        singleStep();
-        return;
-    }
-    stepOverBreakpoint();
+    else if(it == addrToBp_.end()) return singleStep();
+    return stepOverBreakpoint();
 }
 
-void Debugger::stepOverBreakpoint() {
+//False if a breakpoint was to be stepped over but the child could not be stepped
+bool Debugger::stepOverBreakpoint() {
     uint64_t addr = getPC();        //pc points to bp, is altered
     auto it = addrToBp_.find(std::bit_cast<intptr_t>(addr));
 
     if(it != addrToBp_.end()) {
-        if(it->second.isEnabled()) {
+        if(it->second.isEnabled() && !displacedStep(addr)) {
+            ++inPlaceSteps_;
             it->second.disable();
-            singleStep();
+            bool stepped = singleStep();
             it->second.enable();
+            return stepped;
         }
     }
+    return true;
+}
+
+/*
+    The slot's copy is only rewritten when the instruction under the breakpoint changed, so resuming from
+    a hot breakpoint is a single step without any text writes. After the step, a fall through or a relative
+    branch is mapped back from the slot to the original code, a pc still on the slot means the instruction
+    faulted, and anything else is an absolute target (ex: ret) that is left alone.
+*/
+bool Debugger::displacedStep(uint64_t pc) {
+    auto scratch = getScratchArea();
+    if(!scratch) return false;
+
+    std::array<uint8_t, x86::maxLength> code{};
+    auto insn = x86::decode(code.data(), readMemoryBlock(pc, code.data(), code.size()));
+    if(!insn) return false;
+    using Kind = x86::Instruction::Kind;
+    bool relative = (insn->kind == Kind::jump || insn->kind == Kind::call);
+
+    auto bpAddr = std::bit_cast<intptr_t>(pc);
+    auto found = slotOf_.find(bpAddr);
+    size_t index = (found != slotOf_.end() ? found->second : nextSlot_);
+    uint64_t slotAddr = scratch.value() + index * scratchSlotSize_;
+    int64_t delta = static_cast<int64_t>(pc - slotAddr);
+
+    auto patched = code;
+    if(insn->ripDisplacement) {
+        int32_t disp;
+        std::memcpy(&disp, code.data() + insn->ripDisplacement, sizeof(disp));
+        int64_t rebased = disp + delta;
+        if(rebased < INT32_MIN || rebased > INT32_MAX) return false;
+        disp = static_cast<int32_t>(rebased);
+        std::memcpy(patched.data() + insn->ripDisplacement, &disp, sizeof(disp));
+    }
+    else if(relative && (delta < INT32_MIN || delta > INT32_MAX)) return false;
+
+    auto& slot = scratchSlots_[index];
+    if(found == slotOf_.end()) {
+        if(slot.owner) slotOf_.erase(slot.owner);
+        slot = ScratchSlot{};
+        slotOf_.emplace(bpAddr, index);
+        nextSlot_ = (nextSlot_ + 1) % scratchSlots_.size();
+    }
+    if(slot.owner != bpAddr || slot.length != insn->length || std::memcmp(slot.code.data(), code.data(), insn->length)) {
+        slot.owner = 0;
+        if(mem_.write(slotAddr, patched.data(), insn->length, false) != insn->length) return false;
+        slot.owner = bpAddr;
+        slot.length = insn->length;
+        slot.code = code;
+    }
+
+    setPC(slotAddr);
+    if(!singleStep()) {
+        setPC(pc);      //the in-place step fails the same way and reports it
+        return false;
+    }
+    ++displacedSteps_;
+    if(!isExecuting(state_)) return true;
+
+    uint64_t rip = getPC();
+    if(rip == slotAddr + insn->length) rip = pc + insn->length;
+    else if(rip == slotAddr) rip = pc;
+    else if(relative) rip = pc + (rip - slotAddr);
+
+    if((insn->kind == Kind::call || insn->kind == Kind::indirectCall) && rip != pc) {
+        uint64_t returnAddr = pc + insn->length;
+        mem_.write(getRegisterValue(regs_, Reg::rsp), &returnAddr, sizeof(returnAddr));
+    }
+    setPC(rip);
+    checkMainReturn();
+    return true;
+}
+
+/*
+    One read/execute page mapped with an injected mmap, placed below the executable when possible so
+    RIP-relative operands of the program's code stay within rel32 reach. cleanup() unmaps it again
+    (unmapScratchArea()), so the child is left without it after detaching.
+*/
+std::optional<uint64_t> Debugger::getScratchArea() {
+    if(scratch_ || scratchFailed_) return scratch_;
+
+    uint64_t base = getPC();
+    for(const auto& chunk : memMap_.getChunks()) {
+        if(chunk.isPathtypeExec()) base = std::min(base, chunk.addrLow);
+    }
+    base &= ~(scratchSize_ - 1);
+    uint64_t hint = (base > 0x1000000 ? base - 0x100000 : 0);
+    uint64_t flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+    //Without MAP_FIXED_NOREPLACE (Linux < 4.17) the flag is ignored and the hint is only a hint
+    scratch_ = injectSyscall(9, {hint, scratchSize_, PROT_READ | PROT_EXEC, flags | MAP_FIXED_NOREPLACE, 
+        static_cast<uint64_t>(-1), 0});
+    if(!scratch_ && isExecuting(state_)) {
+        scratch_ = injectSyscall(9, {hint, scratchSize_, PROT_READ | PROT_EXEC, flags, static_cast<uint64_t>(-1), 0});
+    }
+
+    if(!scratch_) {
+        std::cerr << "[warning] Could not map a scratch page for displaced stepping, breakpoints will be "
+            "stepped over in place.\n";
+        scratchFailed_ = true;
+        return std::nullopt;
+    }
+    scratchSlots_.assign(scratchSize_ / scratchSlotSize_, ScratchSlot{});
+    return scratch_;
+}
+
+//An injected munmap, pc is never on the page between commands since displaced steps map it back
+void Debugger::unmapScratchArea() {
+    if(!scratch_) return;
+    if(!injectSyscall(11, {scratch_.value(), scratchSize_, 0, 0, 0, 0}) && isExecuting(state_)) {
+        std::cerr << "[warning] Scratch page 0x" << std::hex << std::uppercase << scratch_.value() 
+            << " could not be unmapped, the program keeps it\n";
+    }
+    scratch_.reset();
+    scratchSlots_.clear();
+    slotOf_.clear();
+    nextSlot_ = 0;
 }
 
 
@@ -69,13 +196,13 @@ void Debugger::stepOverBreakpoint() {
 
 
 
-bool Debugger::validMemoryRegionShouldStep(std::optional<dwarf::line_table::iterator> itr, bool shouldStep) {
+bool Debugger::validMemoryRegionShouldStep(std::optional<LineIndex::iterator> itr, bool shouldStep) {
     if(isTerminated(state_)) return false;
     auto chunk = memMap_.getChunkFromAddr(getPC());
     
-    if (chunk && (!chunk->get().isPathtypeExec() || !itr)) {
+    if (chunk && (!chunk->isPathtypeExec() || !itr)) {
         if(shouldStep) {
-            auto c = chunk->get();
+            const auto& c = chunk.value();
             std::cout << "[warning] Memory Space " << MemoryMap::getNameFromPath(c.path) 
             << " has no dwarf info, stepping through instructions instead!\n";
             singleStepBreakpointCheck(); 
@@ -98,12 +225,13 @@ bool Debugger::validMemoryRegionShouldStep(std::optional<dwarf::line_table::iter
     std::pair<uint64_t, bool>. The first value in the pair represents the memory at the stack location 
     and the second value represents if the read/write was a success. For the read function, the stack 
     vector is passed in as an empty vector (or overwritten if there was a value there) and populated 
-    through readMemory() calls at rsp offsets. Likewise, the write memory takes a populated vector and 
-    writes to memory each index 'i' to its respective rsp offset via the formula:
+    through a single readMemoryBlock() call starting at rsp + 8. Likewise, the write memory takes a 
+    populated vector and writes to memory each index 'i' to its respective rsp offset via the formula:
 
     stack[i].address = rsp + 8*(i+1). 
 
-    The boolean at each index is populated by the return value of chunk.isReadable() and chunk.isWriteable(). 
+    The boolean at each index is populated by the bytes returned from readMemoryBlock() and by 
+    chunk.isWriteable(). 
     If an index wasn't read, readStackSnapshot() will return false and set each index not read to {0, false}. 
     If an index couldn't be written, writeStackSnapShot() will return a false and set the boolean of each 
     unwritten index to false. Note: an unread index will not necessarily fail writeStackSnapshot() as it will 
@@ -113,28 +241,25 @@ bool Debugger::readStackSnapshot(std::vector<std::pair<uint64_t, bool>>& stack,
     std::vector<std::pair<uint64_t, bool>> tempStack;
     size_t elements = bytes/8;
     tempStack.reserve(elements);
-    uint64_t rspOffset = getRegisterValue(pid_, Reg::rsp);
-    bool everyReadSucceeded = true;
+    uint64_t rspOffset = getRegisterValue(regs_, Reg::rsp);
 
-    // std::cout << "\nTEST - readStackSnapshot()\n";
-    // std::cout << "--------------------------------------------------------\n";
-    // std::cout << "rsp = 0x" << std::hex << std::uppercase << rspOffset 
-    //     << std::endl;
+    //One block read covers the whole snapshot, every word past the readable prefix is marked unread.
+    //ptrace can read through guard pages, so a slot also needs a readable chunk to count as read.
+    std::vector<uint64_t> words(elements);
+    auto bytesRead = readMemoryBlock(rspOffset + 8, std::bit_cast<uint8_t*>(words.data()), elements * 8);
+    bool everyReadSucceeded = true;
+    std::optional<MemoryMap::Chunk> chunk;
 
     for(size_t i = 0; i < elements; i++) {
-        rspOffset += 8;
-        auto chunk = memMap_.getChunkFromAddr(rspOffset);
-        if(chunk && chunk.value().get().canRead()) {
-            uint64_t data;
-            readMemory(rspOffset, data);
-            tempStack.push_back({data, true});
+        uint64_t slot = rspOffset + 8 * (i + 1);
+        if(!chunk || !chunk.value().contains(slot)) chunk = memMap_.getChunkFromAddr(slot);
+        if((i + 1) * 8 <= bytesRead && chunk && chunk.value().canRead()) {
+            tempStack.push_back({words[i], true});
         }
         else {
             tempStack.push_back({0, false});
             everyReadSucceeded = false;
         }
-        // std::cout << "Stack at rsp + 0x" << std::hex << std::uppercase << rspOffset << ": 0x"
-        //     << tempStack[i].first << " (was read: " << (tempStack[i].second ? "true" : "false") << ")\n";
     }
     stack = tempStack;
     return everyReadSucceeded;
@@ -143,7 +268,7 @@ bool Debugger::readStackSnapshot(std::vector<std::pair<uint64_t, bool>>& stack,
 //bytes are not really needed, can be used for stack.size() vs bytes messages
 bool Debugger::writeStackSnapshot(std::vector<std::pair<uint64_t, bool>>& stack, size_t bytes) {
     bool everyWriteSucceeded = true;
-    uint64_t rspOffset = getRegisterValue(pid_, Reg::rsp);
+    uint64_t rspOffset = getRegisterValue(regs_, Reg::rsp);
     // std::cout << "\nTEST - writeStackSnapshot()\n";
     // std::cout << "--------------------------------------------------------\n";
     // std::cout << "rsp = 0x" << std::hex << std::uppercase << rspOffset 
@@ -151,9 +276,8 @@ bool Debugger::writeStackSnapshot(std::vector<std::pair<uint64_t, bool>>& stack,
     // std::cout << (stack.empty() ? "[critical] STACK IS EMPTY" : "") << "\n";
     for(auto&[data, successfulRead] : stack) {
         rspOffset += 8;
-        auto chunk = memMap_.getChunkFromAddr(rspOffset);
         if(successfulRead) {
-            if(chunk && chunk.value().get().canWrite()) {
+            if(canWrite(rspOffset).value_or(false)) {
                 writeMemory(rspOffset, data);
             }
             else {  //function only fails when cannot write to a read place
@@ -179,29 +303,33 @@ void Debugger::stepOut() {
         std::cerr << "[warning] No DWARF info found — return may not land in calling function.\n";
     }
     
-    auto retAddrLocation = getRegisterValue(pid_, Reg::rbp) + 8;
-    auto chunk = memMap_.getChunkFromAddr(retAddrLocation);
-    if(!chunk || !chunk.value().get().canRead()) {
-        std::cerr << "[warning] Cannot step over with an invalid frame pointer or "
-            "return address. Stepping-in instead.\n";
+    auto caller = getCallerFrame();
+    if(!caller) {
+        std::cerr << "[warning] Cannot step out without call frame info or a valid frame pointer. "
+            "Stepping-in instead.\n";
         return stepIn();
     }
-    uint64_t retAddr;
-    readMemory(retAddrLocation, retAddr);
-    auto[it, inserted] = setBreakpointAtAddress(std::bit_cast<intptr_t>(retAddr));
+    auto[it, inserted] = setBreakpointAtAddress(std::bit_cast<intptr_t>(caller.value().pc));
 
     if(it == addrToBp_.end()) {
         std::cerr << "[warning] Step out failed, invalid return address\n";
         return;
     }
     else if(!inserted) {
+        //A user breakpoint already there stops in any frame, a disabled one is only borrowed
         bool prevEnabled = it->second.isEnabled();
-        if(!prevEnabled) it->second.enable();
+        if(!prevEnabled) {
+            it->second.enable();
+            framePredicates_.try_emplace(it->first, FramePredicate::stackPointer, caller.value().cfa);
+        }
         continueExecution();
+        framePredicates_.clear();
         if(!prevEnabled) it->second.disable();
         return;
     }
+    framePredicates_.try_emplace(it->first, FramePredicate::stackPointer, caller.value().cfa);
     continueExecution();
+    framePredicates_.clear();
     removeBreakpoint(it);
 }
 
@@ -215,14 +343,14 @@ void Debugger::stepIn() {
     
     user_regs_struct regs;
     std::vector<std::pair<uint64_t, bool>> stack;
-    bool readRegs = getAllRegisterValues(pid_, regs);
+    bool readRegs = getAllRegisterValues(regs_, regs);
     bool readStack = readStackSnapshot(stack);
     auto currFunc = getFunctionFromPCOffset(pcOffset);
 
     unsigned sourceLine = itr.value()->line;
     //Check if there is a line entry and if the line number has changed.
     while((itr = getLineEntryFromPC(pcOffset)) && (itr.value()->line == sourceLine)) {
-        singleStepBreakpointCheck();
+        if(!singleStepBreakpointCheck()) return;
         pcOffset = getPCOffsetAddress();
     }
     
@@ -231,7 +359,7 @@ void Debugger::stepIn() {
         return;
     }
     else if(itr) {
-        if(currFunc && !dwarf::die_pc_range(currFunc.value()).contains(pcOffset)) {
+        if(currFunc && !indexes_.getFunctionIndex(currFunc.value()).contains(currFunc.value(), pcOffset)) {
             stepIn();
         }
         return;
@@ -241,7 +369,7 @@ void Debugger::stepIn() {
     bool shouldRevertState = false;
     bool didRevertRegs = false;
     auto chunk = memMap_.getChunkFromAddr(getPC());
-    auto memoryLocation = (chunk ? MemoryMap::getNameFromPath(chunk.value().get().path) : "unmapped memory");
+    auto memoryLocation = (chunk ? MemoryMap::getNameFromPath(chunk.value().path) : "unmapped memory");
              
     if(!itr && isExecuting(state_)) {
         std::cout << "[info] Entered region with no DWARF info ("
@@ -251,7 +379,7 @@ void Debugger::stepIn() {
         shouldRevertState = promptYesOrNo();
     }
 
-    if(shouldRevertState && readRegs && (didRevertRegs = setAllRegisterValues(pid_, regs))) {
+    if(shouldRevertState && readRegs && (didRevertRegs = setAllRegisterValues(regs_, regs))) {
         std::cout << "[debug] Reverting memory state and stepping over...\n";
         if(!readStack) {
             for(size_t i = 0; i < stack.size(); i++) {  //warnings could be simplified
@@ -294,67 +422,129 @@ void Debugger::stepOver() {
     if(!validMemoryRegionShouldStep(currEntry, true)) return;
     auto func = getFunctionFromPCOffset(pcOffset);
     auto startAddr = addLoadAddress(currEntry.value()->address);
-    auto retAddrLocation = getRegisterValue(pid_, Reg::rbp) + 8;
-    auto chunk = memMap_.getChunkFromAddr(retAddrLocation);
+    auto caller = getCallerFrame();
 
     //You may still have DWARF info in an invalid, non-user-defined function. This check will handle that.
     if(!func) {
         std::cerr << "[warning] Cannot step over line in non-user-defined function. Stepping-in instead.\n";
         return stepIn();
     }
-    else if(!chunk || !chunk.value().get().canRead()) {
-        std::cerr << "[warning] Cannot step over with an invalid frame pointer or "
-            "return address. Stepping-in instead.\n";
+    else if(!caller) {
+        std::cerr << "[warning] Cannot step over without call frame info or a valid frame pointer. "
+            "Stepping-in instead.\n";
         return stepIn();
     }
 
     //All code from here assumes you are in a user-defined function with DWARF info.
-    auto low = dwarf::at_low_pc(func.value());
-    auto high = dwarf::at_high_pc(func.value());
-    auto lowEntry = getLineEntryFromPC(low);
-    if(!lowEntry) {
-        std::cout << "[debug] Function cannot be resolved in line table. Single stepping...\n";
-        singleStepBreakpointCheck();
-        return;
-    }
-    
-    std::vector<std::pair<std::intptr_t, bool>> addrshouldRemove;
     unsigned startLine = currEntry.value()->line;
-
-    for(auto val = lowEntry.value(); val->address < high; val++) {
-        auto addr = addLoadAddress(val->address);
-        
-        //Prior to placing a bp, check if the address is the same as starting address
-        //The if-statement is appended such that stepOver() will skip the current line completely
-        if(addr == startAddr || val->line == startLine || !val->is_stmt) continue; 
-        auto [it, inserted] = setBreakpointAtAddress(std::bit_cast<intptr_t>(addr));
-
-        if(it == addrToBp_.end()) continue;
-        else if(inserted) {
-            addrshouldRemove.push_back({it->first, true});
-        }
-        else if(!it->second.isEnabled()) {
-            addrshouldRemove.push_back({it->first, false});
-        }
-    }
+    uint64_t frameCfa = caller.value().cfa;
+    const auto& plan = getStepPlan(func.value(), pcOffset);
+
+    if(residentPlan_ != func.value().get().entry) {
+        retireStepPlan();
+        armStepPlan(func.value().get().entry, plan);
+    }
+    for(auto& [addr, inserted] : residentStops_) framePredicates_.at(addr).value = frameCfa;
+
+    //Only the current line's stops are lifted, so that stepOver() skips the current line completely
+    std::vector<std::intptr_t> muted;
+    PatchBatch batch(&mem_);
+    for(const auto& stop : plan.stops) {
+        if(stop.addr != std::bit_cast<intptr_t>(startAddr) && stop.line != startLine) continue;
+        auto it = addrToBp_.find(stop.addr);
+        if(!residentStops_.contains(stop.addr) || it == addrToBp_.end() || !it->second.isEnabled()) continue;
+        batch.disable(it->second);
+        muted.push_back(stop.addr);
+    }
+    batch.apply();
     
-    uint64_t retAddr;
-    readMemory(retAddrLocation, retAddr);
-    auto [it, inserted] = setBreakpointAtAddress(std::bit_cast<intptr_t>(retAddr));
+    //If the return address is also a line of this function (recursion), the line predicate covers both
+    std::optional<std::pair<std::intptr_t, bool>> returnBp;
+    auto [it, inserted] = setBreakpointAtAddress(std::bit_cast<intptr_t>(caller.value().pc));
 
     if(it != addrToBp_.end() && inserted) {
-        addrshouldRemove.push_back({it->first, true});
+        returnBp = {it->first, true};
     }
     else if(it != addrToBp_.end() && !it->second.isEnabled()) {
-        addrshouldRemove.push_back({it->first, false});
+        it->second.enable();
+        returnBp = {it->first, false};
     }
+    bool returnPredicate = (returnBp && 
+        framePredicates_.try_emplace(returnBp->first, FramePredicate::stackPointer, frameCfa).second);
     continueExecution();
 
-    for(auto &[addr, shouldRemove] : addrshouldRemove) {
-        //will crash if it doesn't exist, but should always exist
-        if(shouldRemove) removeBreakpoint(addr);
-        else addrToBp_.at(addr).disable();          
+    if(returnPredicate) framePredicates_.erase(returnBp->first);
+    if(!isExecuting(state_)) return retireStepPlan();
+    if(returnBp) {
+        if(returnBp->second) removeBreakpoint(returnBp->first);
+        else addrToBp_.at(returnBp->first).disable();
+    }
+    for(auto addr : muted) batch.enable(addrToBp_.at(addr));
+    batch.apply();
+}
+
+
+//Every is_stmt line of every fragment of the function (hot/cold split functions have several)
+const Debugger::StepPlan& Debugger::getStepPlan(FunctionIndex::FunctionRef func, uint64_t pc) {
+    auto [it, inserted] = stepPlans_.try_emplace(func.get().entry);
+    if(!inserted) return it->second;
+
+    const auto& lineIndex = indexes_.getLineIndex(pc);
+    for(const auto& range : indexes_.getFunctionIndex(func).getRanges(func)) {
+        for(auto val = lineIndex.lowerBound(range.low); val != lineIndex.end() && val->address < range.high; 
+            val++) {
+            if(!val->isStmt || val->endSequence) continue;
+            it->second.stops.push_back({std::bit_cast<intptr_t>(addLoadAddress(val->address)), val->line});
+        }
+    }
+    return it->second;
+}
+
+/*
+    Patches in a plan's stops, each guarded by a frame predicate. User breakpoints already enabled at a
+    stop are left alone (they stop in any frame), disabled ones are borrowed and disabled again on retire.
+*/
+void Debugger::armStepPlan(uint64_t entry, const StepPlan& plan) {
+    PatchBatch batch(&mem_);
+    for(const auto& stop : plan.stops) {
+        auto [it, inserted] = setBreakpointAtAddress(stop.addr, &batch);
+        if(it == addrToBp_.end()) continue;
+        else if(!inserted) {
+            if(it->second.isEnabled()) continue;
+            batch.enable(it->second);
+        }
+        residentStops_.try_emplace(it->first, inserted);
+    }
+    batch.apply();
+
+    //Stops that could not be patched in are dropped, and leave addrToBp_ if they were inserted here
+    std::erase_if(residentStops_, [this](const auto& stop) {
+        auto it = addrToBp_.find(stop.first);
+        if(it->second.isEnabled()) {
+            framePredicates_.try_emplace(stop.first, FramePredicate::frameAddress, 0);
+            return false;
+        }
+        if(stop.second) addrToBp_.erase(it);
+        return true;
+    });
+    residentPlan_ = entry;
+}
+
+void Debugger::retireStepPlan() {
+    if(!residentPlan_) return;
+    PatchBatch batch(&mem_);
+    for(auto& [addr, inserted] : residentStops_) {
+        framePredicates_.erase(addr);
+        auto it = addrToBp_.find(addr);
+        if(isExecuting(state_) && it != addrToBp_.end() && it->second.isEnabled()) batch.disable(it->second);
+    }
+    batch.apply();
+
+    for(auto& [addr, inserted] : residentStops_) {
+        if(inserted) addrToBp_.erase(addr);
     }
+    residentStops_.clear();
+    residentPlan_.reset();
 }
 
 
@@ -363,14 +553,14 @@ void Debugger::stepOver() {
 
 
 void Debugger::skipUnsafeInstruction(const size_t bytes) {
-    auto rip = getRegisterValue(pid_, Reg::rip);
+    auto rip = getRegisterValue(regs_, Reg::rip);
     auto newRip = rip + static_cast<uint64_t>(bytes);
 
-    if(!setRegisterValue(pid_, Reg::rip, newRip)) {
+    if(!setRegisterValue(regs_, Reg::rip, newRip)) {
         std::cerr << "[warning] RIP was not set properly\n";
         return;
     }
-    else if(uint64_t setRip = getRegisterValue(pid_, Reg::rip); setRip != newRip) {
+    else if(uint64_t setRip = getRegisterValue(regs_, Reg::rip); setRip != newRip) {
         std::cerr << "[critical] Read RIP does not match with set RIP (0x"
             << std::uppercase << std::hex << setRip << "). Proceed with caution.\n";
     }
@@ -381,10 +571,10 @@ void Debugger::skipUnsafeInstruction(const size_t bytes) {
     std::string newRipChunkMem = "Unmapped Memory";
 
     if(ripChunk) {
-        ripChunkMem = MemoryMap::getNameFromPath(ripChunk.value().get().path);
+        ripChunkMem = MemoryMap::getNameFromPath(ripChunk.value().path);
     }
     if(newRipChunk) {
-        newRipChunkMem = MemoryMap::getNameFromPath(newRipChunk.value().get().path);
+        newRipChunkMem = MemoryMap::getNameFromPath(newRipChunk.value().path);
     }
 
     std::cout << "[debug] Rip has been set 0x" << std::hex << std::uppercase << rip
@@ -395,13 +585,13 @@ void Debugger::skipUnsafeInstruction(const size_t bytes) {
 
 
 void Debugger::jumpToInstruction(const uint64_t newRip) {
-    auto rip = getRegisterValue(pid_, Reg::rip);
+    auto rip = getRegisterValue(regs_, Reg::rip);
 
-    if(!setRegisterValue(pid_, Reg::rip, newRip)) {
+    if(!setRegisterValue(regs_, Reg::rip, newRip)) {
         std::cerr << "[warning] RIP was not set properly\n";
         return;
     }
-    else if(uint64_t setRip = getRegisterValue(pid_, Reg::rip); setRip != newRip) {
+    else if(uint64_t setRip = getRegisterValue(regs_, Reg::rip); setRip != newRip) {
         std::cerr << "[critical] Read RIP does not match with set RIP (0x"
             << std::uppercase << std::hex << setRip << "). Proceed with caution.\n";
     }
@@ -412,10 +602,10 @@ void Debugger::jumpToInstruction(const uint64_t newRip) {
     std::string newRipChunkMem = "";
 
     if(ripChunk) {
-        ripChunkMem = MemoryMap::getNameFromPath(ripChunk.value().get().path);
+        ripChunkMem = MemoryMap::getNameFromPath(ripChunk.value().path);
     }
     if(newRipChunk) {
-        newRipChunkMem = MemoryMap::getNameFromPath(newRipChunk.value().get().path);
+        newRipChunkMem = MemoryMap::getNameFromPath(newRipChunk.value().path);
     }
     else {
         std::cerr << "[warning] Cannot jump to unmapped memory.";
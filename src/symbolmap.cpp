@@ -10,12 +10,274 @@
 #include <iostream>
 #include <vector>
 #include <cstdint>
+#include <string_view>
+#include <optional>
+#include <algorithm>
+#include <stdexcept>
+#include <iterator>
+#include <utility>
 
 using util::demangleSymbol;
 
 // SymbolMap::SymbolMap() = default;
-SymbolMap::SymbolMap(const elf::elf& elf, uint64_t loadAddress, Config::SymbolConfig* config) : 
-    elf_(elf), loadAddress_(loadAddress), config_(config) { }
+SymbolMap::SymbolMap(const elf::elf& elf, uint64_t loadAddress, Config::SymbolConfig* config, ThreadPool& pool) : 
+    elf_(elf), loadAddress_(loadAddress), config_(config) { 
+    build(pool);
+}
+
+/*
+    Every named symbol of every symtab/dynsym section is demangled exactly once here. Symbols listed in 
+    both .symtab and .dynsym are only kept once. The readable rewrite of a demangled name can reject 
+    unusual names, in which case the plain demangled form is kept instead.
+
+    Reading the symbol tables is cheap, demangling is not: raw names are collected first, then demangled
+    in fixed-size blocks across the pool (the name arena is only read meanwhile) and interned afterwards.
+*/
+void SymbolMap::build(ThreadPool& pool) {
+    if(!elf_.valid()) return;
+
+    for(auto& section : elf_.sections()) {
+        auto type = section.get_hdr().type;
+        if(type != elf::sht::symtab && type != elf::sht::dynsym) continue;
+
+        for(auto symbol : section.as_symtab()) {
+            auto symName = symbol.get_name();
+            if(symName.empty()) continue;
+
+            auto& symData = symbol.get_data();
+            Entry entry{symData.value, symData.size, intern(symName), {}, getSymFromElf(symData.type())};
+            if(symData.shnxd == 0) entry.size = 0;      //undefined, only a reference to another object
+            symbols_.push_back(entry);
+        }
+    }
+
+    static constexpr size_t blockSize = 1024;
+    std::vector<std::optional<std::string>> demangled(symbols_.size());
+    pool.parallelFor((symbols_.size() + blockSize - 1) / blockSize, [&](size_t block) {
+        size_t last = std::min(symbols_.size(), (block + 1) * blockSize);
+        for(size_t i = block * blockSize; i < last; ++i) {
+            std::string symName(getString(symbols_[i].raw));
+            try {
+                demangled[i] = demangleSymbol(symName);
+            }
+            catch(const std::logic_error&) {
+                demangled[i] = demangleSymbol(symName, false);
+            }
+        }
+    });
+    for(size_t i = 0; i < symbols_.size(); ++i) {
+        symbols_[i].demangled = (demangled[i] ? intern(demangled[i].value()) : symbols_[i].raw);
+    }
+
+    std::stable_sort(symbols_.begin(), symbols_.end(), [this](const Entry& a, const Entry& b) {
+        return a.addr < b.addr || (a.addr == b.addr && getString(a.raw) < getString(b.raw));
+    });
+    symbols_.erase(std::unique(symbols_.begin(), symbols_.end(), [this](const Entry& a, const Entry& b) {
+        return a.addr == b.addr && a.s == b.s && getString(a.raw) == getString(b.raw);
+    }), symbols_.end());
+
+    for(uint32_t i = 0; i < symbols_.size(); ++i) {
+        const auto& entry = symbols_[i];
+        bool code = (entry.s == Sym::func || entry.s == Sym::object);
+        if(code && entry.size > 0 && (addrIndex_.empty() || symbols_[addrIndex_.back()].addr != entry.addr)) {
+            addrIndex_.push_back(i);
+        }
+    }
+    indexNames();
+    buildSearchIndex();
+}
+
+void SymbolMap::indexNames() {
+    for(uint32_t i = 0; i < symbols_.size(); ++i) {
+        const auto& entry = symbols_[i];
+        byName_[std::string(getString(entry.demangled))].push_back(i);
+        if(entry.raw.offset != entry.demangled.offset) byName_[std::string(getString(entry.raw))].push_back(i);
+    }
+}
+
+//Everything but the name hash is stored as is, the hash is rebuilt from the arena on load
+void SymbolMap::save(IndexCache::Writer& writer) const {
+    writer.writeString(names_);
+    writer.writeRecords(symbols_, &Entry::addr, &Entry::size, &Entry::raw, &Entry::demangled, &Entry::s);
+    writer.writeArray(addrIndex_);
+    writer.writeString(searchText_);
+    writer.writeArray(searchOffsets_);
+    writer.writeArray(trigramKeys_);
+    writer.writeArray(trigramOffsets_);
+    writer.writeArray(postings_);
+}
+
+std::optional<SymbolMap> SymbolMap::load(IndexCache::Reader& reader, const elf::elf& elf, uint64_t loadAddress,
+    Config::SymbolConfig* config) {
+    SymbolMap map;
+    if(!reader.readString(map.names_) || !reader.readRecords(map.symbols_, &Entry::addr, &Entry::size, &Entry::raw,
+            &Entry::demangled, &Entry::s) || !reader.readArray(map.addrIndex_) 
+        || !reader.readString(map.searchText_) || !reader.readArray(map.searchOffsets_) 
+        || !reader.readArray(map.trigramKeys_) || !reader.readArray(map.trigramOffsets_) 
+        || !reader.readArray(map.postings_) || !map.validate()) return std::nullopt;
+
+    map.elf_ = elf;
+    map.loadAddress_ = loadAddress;
+    map.config_ = config;
+    map.indexNames();
+    return map;
+}
+
+//Checks every id and offset read from the index cache so lookups never index out of bounds
+bool SymbolMap::validate() const {
+    auto validName = [this](Name name) {
+        return name.offset <= names_.size() && name.length <= names_.size() - name.offset;
+    };
+    for(const auto& entry : symbols_) {
+        if(!validName(entry.raw) || !validName(entry.demangled) || entry.s > Sym::NULL_SYM) return false;
+    }
+    for(auto i : addrIndex_) {
+        if(i >= symbols_.size()) return false;
+    }
+
+    if(searchOffsets_.empty()) return searchText_.empty() && trigramKeys_.empty() && postings_.empty();
+    if(!std::is_sorted(searchOffsets_.begin(), searchOffsets_.end()) || searchOffsets_.back() != searchText_.size()) {
+        return false;
+    }
+    for(size_t i = 0; i + 1 < searchOffsets_.size(); ++i) {
+        if(searchOffsets_[i] == searchOffsets_[i + 1]) return false;       //every name ends with a '\0'
+    }
+
+    if(trigramOffsets_.size() != trigramKeys_.size() + 1 || trigramOffsets_.back() != postings_.size() 
+        || !std::is_sorted(trigramOffsets_.begin(), trigramOffsets_.end())) return false;
+    auto nameCount = searchOffsets_.size() - 1;
+    return std::all_of(postings_.begin(), postings_.end(), [&](uint32_t i) { return i < nameCount; });
+}
+
+/*
+    Trigrams are packed into the low 24 bits of a uint32_t, in a CSR layout: trigramKeys_[k] owns
+    postings_[trigramOffsets_[k], trigramOffsets_[k + 1]). The names are walked twice instead of collecting
+    every (trigram, name) pair: the first pass counts the names per trigram, which sizes postings_ exactly,
+    and the second writes each name into its trigrams' ranges. Only the distinct trigrams are held on the
+    side. Names are sorted, so query results come back in alphabetical order and every posting list is
+    sorted as it is filled.
+*/
+void SymbolMap::buildSearchIndex() {
+    std::vector<std::string_view> names;
+    names.reserve(symbols_.size());
+    for(const auto& entry : symbols_) names.push_back(getString(entry.demangled));
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+
+    std::vector<uint32_t> nameTrigrams;
+    auto collectTrigrams = [&nameTrigrams](std::string_view name) -> const std::vector<uint32_t>& {
+        nameTrigrams.clear();
+        for(size_t j = 0; j + 3 <= name.length(); ++j) {
+            nameTrigrams.push_back(static_cast<uint32_t>(static_cast<uint8_t>(name[j])) << 16 | 
+                static_cast<uint32_t>(static_cast<uint8_t>(name[j + 1])) << 8 | static_cast<uint8_t>(name[j + 2]));
+        }
+        std::sort(nameTrigrams.begin(), nameTrigrams.end());
+        nameTrigrams.erase(std::unique(nameTrigrams.begin(), nameTrigrams.end()), nameTrigrams.end());
+        return nameTrigrams;
+    };
+
+    std::unordered_map<uint32_t, uint32_t> cursor;      //trigram --> count, then next free postings_ slot
+    for(auto name : names) {
+        searchOffsets_.push_back(static_cast<uint32_t>(searchText_.size()));
+        searchText_.append(name);
+        searchText_.push_back('\0');
+        for(auto trigram : collectTrigrams(name)) ++cursor[trigram];
+    }
+    searchOffsets_.push_back(static_cast<uint32_t>(searchText_.size()));
+
+    trigramKeys_.reserve(cursor.size());
+    for(const auto& [trigram, count] : cursor) trigramKeys_.push_back(trigram);
+    std::sort(trigramKeys_.begin(), trigramKeys_.end());
+    trigramOffsets_.reserve(trigramKeys_.size() + 1);
+    uint32_t total = 0;
+    for(auto trigram : trigramKeys_) {
+        trigramOffsets_.push_back(total);
+        total += std::exchange(cursor[trigram], total);
+    }
+    trigramOffsets_.push_back(total);
+
+    postings_.resize(total);
+    for(uint32_t i = 0; i < names.size(); ++i) {
+        for(auto trigram : collectTrigrams(names[i])) postings_[cursor[trigram]++] = i;
+    }
+}
+
+std::string_view SymbolMap::getSearchName(uint32_t index) const {
+    return std::string_view(searchText_).substr(searchOffsets_[index], 
+        searchOffsets_[index + 1] - searchOffsets_[index] - 1);
+}
+
+std::vector<uint32_t> SymbolMap::searchNames(std::string_view query) const {
+    std::vector<uint32_t> matches;
+    if(query.empty() || searchOffsets_.size() < 2) return matches;
+
+    //Short queries have no trigram, scan the names directly. A hit can't span a '\0' separator.
+    if(query.length() < 3) {
+        size_t pos = std::string_view(searchText_).find(query);
+        while(pos != std::string_view::npos) {
+            auto next = std::upper_bound(searchOffsets_.begin(), searchOffsets_.end(), pos);
+            matches.push_back(static_cast<uint32_t>(next - searchOffsets_.begin() - 1));
+            pos = std::string_view(searchText_).find(query, *next);     //continue at the next name
+        }
+        return matches;
+    }
+
+    //Posting lists of every trigram in the query, smallest first
+    std::vector<std::pair<const uint32_t*, const uint32_t*>> lists;
+    for(size_t j = 0; j + 3 <= query.length(); ++j) {
+        uint32_t trigram = static_cast<uint32_t>(static_cast<uint8_t>(query[j])) << 16 | 
+            static_cast<uint32_t>(static_cast<uint8_t>(query[j + 1])) << 8 | static_cast<uint8_t>(query[j + 2]);
+        auto key = std::lower_bound(trigramKeys_.begin(), trigramKeys_.end(), trigram);
+        if(key == trigramKeys_.end() || *key != trigram) return matches;    //some trigram appears nowhere
+        auto k = key - trigramKeys_.begin();
+        lists.push_back({postings_.data() + trigramOffsets_[k], postings_.data() + trigramOffsets_[k + 1]});
+    }
+    std::sort(lists.begin(), lists.end(), [](const auto& a, const auto& b) {
+        return (a.second - a.first) < (b.second - b.first);
+    });
+
+    std::vector<uint32_t> candidates(lists[0].first, lists[0].second);
+    std::vector<uint32_t> scratch;
+    for(size_t l = 1; l < lists.size() && !candidates.empty(); ++l) {
+        scratch.clear();
+        std::set_intersection(candidates.begin(), candidates.end(), lists[l].first, lists[l].second, 
+            std::back_inserter(scratch));
+        candidates.swap(scratch);
+    }
+
+    //Trigrams only prove the pieces exist somewhere in the name, confirm they line up
+    for(auto index : candidates) {
+        if(getSearchName(index).find(query) != std::string_view::npos) matches.push_back(index);
+    }
+    return matches;
+}
+
+SymbolMap::Name SymbolMap::intern(std::string_view name) {
+    Name result{static_cast<uint32_t>(names_.size()), static_cast<uint32_t>(name.size())};
+    names_.append(name);
+    return result;
+}
+
+std::string_view SymbolMap::getString(Name name) const {
+    return std::string_view(names_).substr(name.offset, name.length);
+}
+
+SymbolMap::Symbol SymbolMap::makeSymbol(const Entry& entry) const {
+    return Symbol(entry.s, std::string(getString(entry.demangled)), std::bit_cast<uintptr_t>(entry.addr));
+}
+
+size_t SymbolMap::size() const { return symbols_.size(); }
+
+//Addresses are file addresses (st_value), ie: without the load address of a PIE
+std::optional<SymbolMap::Symbol> SymbolMap::getSymbolFromAddr(uint64_t addr) const {
+    auto it = std::upper_bound(addrIndex_.begin(), addrIndex_.end(), addr, 
+        [this](uint64_t a, uint32_t id) { return a < symbols_[id].addr; });
+    if(it == addrIndex_.begin()) return std::nullopt;
+
+    const auto& entry = symbols_[*(--it)];
+    if(addr - entry.addr >= entry.size) return std::nullopt;
+    return makeSymbol(entry);
+}
 
 // SymbolMap::SymbolMap(SymbolMap&&) = default;
 // SymbolMap& SymbolMap::operator=(SymbolMap&&) = default;
@@ -45,6 +307,12 @@ void SymbolMap::setMinCachedStringLength(uint8_t length) {
     return configure();
 }
 
+bool SymbolMap::getCacheEnabled() { return config_->cacheEnabled_; }
+void SymbolMap::setCacheEnabled(bool enabled) {
+    config_->cacheEnabled_ = enabled;
+    if(!enabled) clearCache();
+}
+
 size_t SymbolMap::getMaxSymbolCacheSize() { return config_->symbolCacheSize_; }
 void SymbolMap::setMaxSymbolCacheSize(size_t size) {
     config_->symbolCacheSize_ = size;
@@ -88,54 +356,37 @@ SymbolMap::Sym SymbolMap::getSymFromElf(elf::stt s) const {
 }
 
 std::vector<SymbolMap::Symbol> SymbolMap::getSymbolListFromName(const std::string& name, bool strict, bool cache) {
-    auto it = nonStrictSymbolCache_.find(name);
-    std::vector<Symbol> strictMatches;
+    //Strict lookups are exact, answered straight from the name hash without touching the cache
+    if(strict) {
+        std::vector<Symbol> strictMatches;
+        auto found = byName_.find(name);
+        if(found != byName_.end()) {
+            for(auto id : found->second) strictMatches.push_back(makeSymbol(symbols_[id]));
+        }
+        return strictMatches;
+    }
 
-    if(it != nonStrictSymbolCache_.end()) {
+    auto it = nonStrictSymbolCache_.find(name);
+    if(config_->cacheEnabled_ && it != nonStrictSymbolCache_.end()) {
         auto erase = config_->touchKey(name);
         if(erase != "") {
             std::cerr << "[warning] Cache is out of sync with LRU config. Clear cache to reset.";
         }
-
-        if(!strict) return it->second;
-        else {
-            for(auto& symbol : it->second) {
-                if(name == symbol.name) strictMatches.push_back(symbol);
-            }
-            return strictMatches;
-        }
+        return it->second;
     }
 
     std::vector<Symbol> nonStrictMatches;
-    for(auto& section : elf_.sections()) {
-        auto type = section.get_hdr().type;
-        if(type != elf::sht::symtab && type != elf::sht::dynsym) continue;
-
-        // std::cout << "\n------------------------TEST-BEGIN--------------------------\n";
-        for(auto symbol : section.as_symtab()) {
-            auto symName = symbol.get_name();
-            if(symName.empty()) continue;
-            auto demangled = demangleSymbol(symName);
-            if(demangled) symName = demangled.value();
-
-            if(strict && symName == name) {
-                auto& symData = symbol.get_data();
-                auto symElfType = getSymFromElf(symData.type());
-                nonStrictMatches.emplace_back(Symbol(symElfType, symName, 
-                    std::bit_cast<uintptr_t>(symData.value)));
-                strictMatches.emplace_back(Symbol(symElfType, symName, 
-                    std::bit_cast<uintptr_t>(symData.value)));    
-            }
-            else if(symName.find(name) != std::string::npos) {
-                auto& symData = symbol.get_data();
-                auto symElfType = getSymFromElf(symData.type());
-                nonStrictMatches.emplace_back(Symbol(symElfType, symName, 
-                    std::bit_cast<uintptr_t>(symData.value)));
+    for(auto index : searchNames(name)) {
+        auto found = byName_.find(std::string(getSearchName(index)));
+        if(found == byName_.end()) continue;
+        for(auto id : found->second) {      //the hash also holds raw names, keep demangled matches only
+            if(getString(symbols_[id].demangled) == found->first) {
+                nonStrictMatches.push_back(makeSymbol(symbols_[id]));
             }
         }
     }
     //Only cache non-strict symbols
-    if(cache && name.length() >= static_cast<size_t>(config_->minCachedStringLength_)) {
+    if(cache && config_->cacheEnabled_ && name.length() >= static_cast<size_t>(config_->minCachedStringLength_)) {
         nonStrictSymbolCache_[name] = std::move(nonStrictMatches);
         auto erase = config_->touchKey(name);
         if(!erase.empty()) {
@@ -144,13 +395,12 @@ std::vector<SymbolMap::Symbol> SymbolMap::getSymbolListFromName(const std::strin
                 nonStrictSymbolCache_.erase(found);
             }
         }
-        if(strict) return strictMatches;
         return nonStrictSymbolCache_[name];
         // it = nonStrictSymbolCache_.find(name);
         // return it->second;
     }
     //If the name is too short to be cached
-    return (strict ? strictMatches : nonStrictMatches);
+    return nonStrictMatches;
     
 }
 
@@ -0,0 +1,125 @@
+#include "../include/threadpool.h"
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <memory>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+
+
+ThreadPool::ThreadPool(unsigned threads) {
+    if(threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    queueCount_ = threads;
+    queues_ = std::make_unique<Queue[]>(queueCount_);
+
+    workers_.reserve(queueCount_ - 1);
+    for(unsigned i = 1; i < queueCount_; ++i) workers_.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for(auto& worker : workers_) worker.join();
+}
+
+unsigned ThreadPool::size() const { return queueCount_; }
+
+/*
+    Indices are split into one contiguous block per queue before any worker is woken. task_ is published
+    before the queues are filled, and every pop/steal goes through a queue mutex, so a worker that gets an
+    index always sees the task it belongs to. The caller drains its own block (and steals) like any other
+    worker, then sleeps until the last task finishes.
+*/
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& task) {
+    if(count == 0) return;
+    if(queueCount_ == 1 || count == 1) {
+        for(size_t i = 0; i < count; ++i) task(i);
+        return;
+    }
+
+    std::lock_guard<std::mutex> submit(submitMutex_);
+    task_ = &task;
+    error_ = nullptr;
+    remaining_.store(count);
+    for(unsigned q = 0; q < queueCount_; ++q) {
+        size_t first = count * q / queueCount_, last = count * (q + 1) / queueCount_;
+        std::lock_guard<std::mutex> lock(queues_[q].mutex);
+        for(size_t i = first; i < last; ++i) queues_[q].tasks.push_back(i);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++generation_;
+    }
+    wake_.notify_all();
+
+    drain(0);
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]{ return remaining_.load() == 0; });
+    task_ = nullptr;
+    if(error_) std::rethrow_exception(std::exchange(error_, nullptr));
+}
+
+void ThreadPool::workerLoop(unsigned self) {
+    uint64_t seen = 0;
+    while(true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [&]{ return stopping_ || generation_ != seen; });
+            if(stopping_) return;
+            seen = generation_;
+        }
+        drain(self);
+    }
+}
+
+void ThreadPool::drain(unsigned self) {
+    size_t index;
+    while(pop(self, index) || steal(self, index)) run(index);
+}
+
+bool ThreadPool::pop(unsigned self, size_t& index) {
+    auto& queue = queues_[self];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if(queue.tasks.empty()) return false;
+    index = queue.tasks.front();
+    queue.tasks.pop_front();
+    return true;
+}
+
+//Victims are probed starting from the next queue so thieves spread out instead of all hitting queue 0
+bool ThreadPool::steal(unsigned self, size_t& index) {
+    for(unsigned i = 1; i < queueCount_; ++i) {
+        auto& queue = queues_[(self + i) % queueCount_];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if(queue.tasks.empty()) continue;
+        index = queue.tasks.back();
+        queue.tasks.pop_back();
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::run(size_t index) {
+    try {
+        (*task_)(index);
+    }
+    catch(...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(!error_) error_ = std::current_exception();
+    }
+
+    if(remaining_.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(mutex_);     //pairs with the predicate check in parallelFor()
+        done_.notify_all();
+    }
+}
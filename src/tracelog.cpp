@@ -0,0 +1,87 @@
+#include "../include/tracelog.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <iostream>
+#include <utility>
+
+
+
+//TraceLog Methods
+TraceLog::TraceLog(TraceLog&& other) noexcept : fd_(std::exchange(other.fd_, 1)),
+    path_(std::exchange(other.path_, "-")), buffer_(std::move(other.buffer_)), stats_(other.stats_) {}
+
+TraceLog& TraceLog::operator=(TraceLog&& other) noexcept {
+    if(this != &other) {
+        flush();
+        closeFile();
+        fd_ = std::exchange(other.fd_, 1);
+        path_ = std::exchange(other.path_, "-");
+        buffer_ = std::move(other.buffer_);
+        stats_ = other.stats_;
+    }
+    return *this;
+}
+
+TraceLog::~TraceLog() {
+    flush();
+    closeFile();
+}
+
+bool TraceLog::open(const std::string& path) {
+    int fd = 1;
+    if(path != "-") {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if(fd == -1) return false;
+    }
+    flush();
+    closeFile();
+    fd_ = fd;
+    path_ = path;
+    return true;
+}
+
+const std::string& TraceLog::getPath() const { return path_; }
+
+std::string& TraceLog::line() {
+    if(buffer_.capacity() < capacity) buffer_.reserve(capacity);
+    return buffer_;
+}
+
+void TraceLog::commit() {
+    ++stats_.lines;
+    if(buffer_.size() >= capacity) flush();
+}
+
+//A failed write drops the batch rather than stalling the child on a full disk
+void TraceLog::flush() {
+    if(buffer_.empty()) return;
+    if(fd_ == 1) std::cout.flush();
+
+    const char* data = buffer_.data();
+    size_t left = buffer_.size();
+    while(left) {
+        auto written = ::write(fd_, data, left);
+        if(written == -1 && errno == EINTR) continue;
+        if(written <= 0) {
+            std::cerr << "[warning] Trace output to " << path_ << " failed: " << strerror(errno) << "\n";
+            break;
+        }
+        data += written;
+        left -= static_cast<size_t>(written);
+    }
+    stats_.bytes += buffer_.size() - left;
+    ++stats_.flushes;
+    buffer_.clear();
+}
+
+const TraceLog::Stats& TraceLog::getStats() const { return stats_; }
+void TraceLog::resetStats() { stats_ = Stats(); }
+
+void TraceLog::closeFile() {
+    if(fd_ != 1) close(fd_);
+    fd_ = 1;
+}
@@ -0,0 +1,177 @@
+#include "../include/tracepoint.h"
+#include "../include/condition.h"
+#include "../include/inferiormemory.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <optional>
+#include <chrono>
+#include <charconv>
+#include <cstring>
+#include <cctype>
+#include <cstdint>
+#include <sys/user.h>
+
+
+namespace {
+    constexpr std::string_view conversions = "diuxXpcs";
+
+    //to_chars into a small buffer, then padded to the width
+    void appendNumber(std::string& out, uint64_t value, char conversion, bool zeroPad, uint8_t width) {
+        std::array<char, 24> digits;
+        char* first = digits.data();
+        char* last = digits.data() + digits.size();
+        bool negative = ((conversion == 'd' || conversion == 'i') && static_cast<int64_t>(value) < 0);
+        if(negative) value = -value;
+
+        int base = (conversion == 'x' || conversion == 'X' || conversion == 'p' ? 16 : 10);
+        char* end = std::to_chars(first, last, value, base).ptr;
+        if(conversion == 'X') {
+            for(char* c = first; c != end; ++c) *c = static_cast<char>(std::toupper(static_cast<unsigned char>(*c)));
+        }
+
+        size_t length = static_cast<size_t>(end - first) + (negative ? 1 : 0) + (conversion == 'p' ? 2 : 0);
+        size_t pad = (width > length ? width - length : 0);
+        if(!zeroPad) out.append(pad, ' ');
+        if(negative) out += '-';
+        if(conversion == 'p') out += "0x";
+        if(zeroPad) out.append(pad, '0');
+        out.append(first, end);
+    }
+
+    //Reads page by page up to the terminator, so a string ending right before an unmapped page still prints
+    void appendString(std::string& out, uint64_t addr, const InferiorMemory& mem) {
+        std::array<char, Tracepoint::maxString> text;
+        size_t length = 0;
+        while(length < text.size()) {
+            size_t chunk = std::min(text.size() - length, 
+                InferiorMemory::pageSize - (addr + length) % InferiorMemory::pageSize);
+            size_t read = mem.read(addr + length, text.data() + length, chunk);
+            auto nul = std::memchr(text.data() + length, 0, read);
+            if(nul) {
+                length = static_cast<size_t>(static_cast<char*>(nul) - text.data());
+                break;
+            }
+            length += read;
+            if(read < chunk) {
+                if(!length) out += "<unreadable>";
+                break;
+            }
+        }
+        out.append(text.data(), length);
+    }
+}
+
+
+
+//Tracepoint Methods
+std::optional<Tracepoint> Tracepoint::compile(std::string_view format, const std::vector<std::string_view>& args,
+        std::string& error) {
+    Tracepoint tp;
+    Segment segment;
+    for(size_t i = 0; i < format.length(); ++i) {
+        char c = format[i];
+        if(c == '\\' && i + 1 < format.length()) {
+            char next = format[++i];
+            segment.text += (next == 'n' ? '\n' : next == 't' ? '\t' : next);
+            continue;
+        }
+        if(c != '%') {
+            segment.text += c;
+            continue;
+        }
+        if(i + 1 < format.length() && format[i + 1] == '%') {
+            segment.text += format[++i];
+            continue;
+        }
+
+        ++i;
+        if(i < format.length() && format[i] == '0') {
+            segment.zeroPad = true;
+            ++i;
+        }
+        size_t width = 0;
+        while(i < format.length() && std::isdigit(static_cast<unsigned char>(format[i])) && width < 64) {
+            width = width * 10 + static_cast<size_t>(format[i++] - '0');
+        }
+        if(i >= format.length() || conversions.find(format[i]) == std::string_view::npos) {
+            error = "unsupported conversion in \"" + std::string(format) + "\", use %d %i %u %x %X %p %c %s or %%";
+            return std::nullopt;
+        }
+        segment.width = static_cast<uint8_t>(std::min<size_t>(width, 64));
+        segment.conversion = format[i];
+        tp.segments_.push_back(std::move(segment));
+        segment = Segment{};
+    }
+    //One hit is one line, a trailing \n in the format is not doubled
+    if(segment.text.empty() || segment.text.back() != '\n') segment.text += '\n';
+    tp.segments_.push_back(std::move(segment));
+
+    if(tp.segments_.size() - 1 != args.size()) {
+        error = std::to_string(tp.segments_.size() - 1) + " conversions but " + std::to_string(args.size())
+            + " arguments";
+        return std::nullopt;
+    }
+
+    tp.source_ = "\"" + std::string(format) + "\"";
+    for(auto arg : args) {
+        std::string argError;
+        auto compiled = Condition::compile(arg, argError);
+        if(!compiled) {
+            error = "argument \"" + std::string(arg) + "\": " + argError;
+            return std::nullopt;
+        }
+        tp.args_.push_back(std::move(compiled.value()));
+        tp.source_ += ", " + std::string(arg);
+    }
+    return tp;
+}
+
+Tracepoint::Verdict Tracepoint::hit(std::chrono::steady_clock::time_point now) {
+    ++stats_.hits;
+    if(ignoreCount_) {
+        --ignoreCount_;
+        ++stats_.ignored;
+        return Verdict::ignored;
+    }
+    if(rateLimit_) {
+        if(now - window_ >= std::chrono::seconds(1)) {
+            window_ = now;
+            windowCount_ = 0;
+        }
+        if(windowCount_ >= rateLimit_) {
+            ++stats_.limited;
+            return Verdict::limited;
+        }
+        ++windowCount_;
+    }
+    ++stats_.logged;
+    return Verdict::log;
+}
+
+void Tracepoint::format(const user_regs_struct& regs, const InferiorMemory& mem, std::string& out) const {
+    for(size_t i = 0; i < segments_.size(); ++i) {
+        const auto& segment = segments_[i];
+        out += segment.text;
+        if(!segment.conversion) continue;
+
+        auto value = args_[i].evaluate(regs, mem);
+        if(!value) out += "<error>";
+        else if(segment.conversion == 'c') out += static_cast<char>(value.value());
+        else if(segment.conversion == 's') appendString(out, value.value(), mem);
+        else appendNumber(out, value.value(), segment.conversion, segment.zeroPad, segment.width);
+    }
+}
+
+void Tracepoint::setIgnoreCount(uint64_t count) { ignoreCount_ = count; }
+void Tracepoint::setRateLimit(uint64_t perSecond) {
+    rateLimit_ = perSecond;
+    windowCount_ = 0;
+}
+uint64_t Tracepoint::getIgnoreCount() const { return ignoreCount_; }
+uint64_t Tracepoint::getRateLimit() const { return rateLimit_; }
+const std::string& Tracepoint::getSource() const { return source_; }
+const Tracepoint::Stats& Tracepoint::getStats() const { return stats_; }
@@ -0,0 +1,476 @@
+#include "../include/unwinder.h"
+#include "../include/inferiormemory.h"
+
+#include <elf/elf++.hh>
+
+#include <array>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <optional>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <sys/user.h>
+
+
+namespace {
+    constexpr uint8_t rbpRegister = 6;
+    constexpr uint8_t rspRegister = 7;
+    constexpr uint8_t omitEncoding = 0xFF;      //DW_EH_PE_omit
+
+    uint32_t bit(size_t reg) { return uint32_t(1) << reg; }
+
+    //Bounds checked reader over a CFI section, a read past the end clears ok and returns 0
+    struct Cursor {
+        const uint8_t* pos;
+        const uint8_t* end;
+        const uint8_t* begin;       //start of the section
+        uint64_t address;           //address of the section, for pc-relative pointers
+        bool ok = true;
+
+        size_t remaining() const { return static_cast<size_t>(end - pos); }
+
+        template<typename T>
+        T fixed() {
+            T value{};
+            if(remaining() < sizeof(T)) {
+                ok = false;
+                return value;
+            }
+            std::memcpy(&value, pos, sizeof(T));
+            pos += sizeof(T);
+            return value;
+        }
+
+        uint64_t uleb() {
+            uint64_t value = 0;
+            for(unsigned shift = 0; pos < end; shift += 7) {
+                uint8_t byte = *pos++;
+                if(shift < 64) value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                if(!(byte & 0x80)) return value;
+            }
+            ok = false;
+            return value;
+        }
+
+        int64_t sleb() {
+            int64_t value = 0;
+            unsigned shift = 0;
+            while(pos < end) {
+                uint8_t byte = *pos++;
+                if(shift < 64) value |= static_cast<int64_t>(static_cast<uint64_t>(byte & 0x7F) << shift);
+                shift += 7;
+                if(!(byte & 0x80)) {
+                    if(shift < 64 && (byte & 0x40)) value |= -(static_cast<int64_t>(1) << shift);
+                    return value;
+                }
+            }
+            ok = false;
+            return value;
+        }
+
+        std::string_view string() {
+            auto* terminator = static_cast<const uint8_t*>(std::memchr(pos, '\0', remaining()));
+            if(!terminator) {
+                ok = false;
+                return {};
+            }
+            std::string_view str(reinterpret_cast<const char*>(pos), static_cast<size_t>(terminator - pos));
+            pos = terminator + 1;
+            return str;
+        }
+
+        //DW_EH_PE encoded pointer, only absolute and pc-relative ones are meaningful in an executable
+        uint64_t pointer(uint8_t encoding) {
+            if(encoding == omitEncoding) return 0;
+            uint64_t fieldAddress = address + static_cast<uint64_t>(pos - begin);
+            uint64_t value = 0;
+            switch(encoding & 0x0F) {
+                case 0x00: value = fixed<uint64_t>(); break;
+                case 0x01: value = uleb(); break;
+                case 0x02: value = fixed<uint16_t>(); break;
+                case 0x03: value = fixed<uint32_t>(); break;
+                case 0x04: value = fixed<uint64_t>(); break;
+                case 0x09: value = static_cast<uint64_t>(sleb()); break;
+                case 0x0A: value = static_cast<uint64_t>(static_cast<int64_t>(fixed<int16_t>())); break;
+                case 0x0B: value = static_cast<uint64_t>(static_cast<int64_t>(fixed<int32_t>())); break;
+                case 0x0C: value = fixed<uint64_t>(); break;
+                default: ok = false; return 0;
+            }
+            switch(encoding & 0x70) {
+                case 0x00: break;
+                case 0x10: value += fieldAddress; break;
+                default: ok = false; break;
+            }
+            return value;
+        }
+    };
+}
+
+
+
+Unwinder::Unwinder(const elf::elf& elf, uint64_t loadAddress) : elf_(elf), loadAddress_(loadAddress) {
+    if(!elf_.valid()) return;
+    readSection(".eh_frame", true);
+    readSection(".debug_frame", false);
+
+    //the same function in both sections keeps its .eh_frame entry
+    std::stable_sort(fdes_.begin(), fdes_.end(), [](const Fde& a, const Fde& b) { return a.low < b.low; });
+    fdes_.erase(std::unique(fdes_.begin(), fdes_.end(), [](const Fde& a, const Fde& b) {
+        return a.low == b.low;
+    }), fdes_.end());
+}
+
+/*
+    Both sections are a list of length-prefixed CIEs and FDEs. They differ in how a CIE is marked (id 0 in
+    .eh_frame, all ones in .debug_frame) and how an FDE points at its CIE (backwards from the id field in
+    .eh_frame, a section offset in .debug_frame). CIEs are parsed when first referenced. Entries that can't
+    be parsed are skipped, their functions fall back to the frame pointer.
+*/
+void Unwinder::readSection(const std::string& name, bool ehFrame) {
+    const auto& section = elf_.get_section(name);
+    if(!section.valid() || !section.data()) return;
+    const auto* begin = static_cast<const uint8_t*>(section.data());
+    size_t size = section.size();
+    Cursor cursor{begin, begin + size, begin, section.get_hdr().addr};
+    std::unordered_map<uint64_t, std::optional<uint32_t>> cieAt;     //section offset --> index into cies_
+
+    auto parseCie = [&](uint64_t offset) -> std::optional<uint32_t> {
+        if(auto found = cieAt.find(offset); found != cieAt.end()) return found->second;
+        auto& result = cieAt[offset];
+        if(offset >= size) return result;
+
+        Cursor cie{begin + offset, cursor.end, begin, cursor.address};
+        uint64_t length = cie.fixed<uint32_t>();
+        bool is64 = (length == 0xFFFFFFFF);
+        if(is64) length = cie.fixed<uint64_t>();
+        if(!cie.ok || length > cie.remaining()) return result;
+        cie.end = cie.pos + length;
+        cie.pos += (is64 ? 8 : 4);      //CIE id
+
+        Cie record;
+        auto version = cie.fixed<uint8_t>();
+        auto augmentation = cie.string();
+        if(augmentation.find("eh") != std::string_view::npos) return result;    //pre-2.0 GCC layout
+        if(version >= 4) {
+            auto addressSize = cie.fixed<uint8_t>();
+            auto segmentSize = cie.fixed<uint8_t>();
+            if(addressSize != 8 || segmentSize != 0) return result;
+        }
+        record.codeAlign = cie.uleb();
+        record.dataAlign = cie.sleb();
+        auto returnRegister = (version == 1 ? cie.fixed<uint8_t>() : cie.uleb());
+        if(returnRegister >= registerCount) return result;
+        record.returnRegister = static_cast<uint8_t>(returnRegister);
+
+        if(augmentation.starts_with("z")) {
+            record.augmented = true;
+            auto dataLength = cie.uleb();
+            if(dataLength > cie.remaining()) return result;
+            const auto* dataEnd = cie.pos + dataLength;
+            for(char c : augmentation.substr(1)) {
+                if(c == 'R') record.pointerEncoding = cie.fixed<uint8_t>();
+                else if(c == 'L') cie.fixed<uint8_t>();
+                else if(c == 'P') cie.pointer(cie.fixed<uint8_t>());
+                else if(c != 'S') break;
+            }
+            cie.pos = dataEnd;
+        }
+        else if(!augmentation.empty()) return result;
+        if(!cie.ok) return result;
+
+        record.instructions = cie.pos;
+        record.end = cie.end;
+        cies_.push_back(record);
+        result = static_cast<uint32_t>(cies_.size() - 1);
+        return result;
+    };
+
+    while(cursor.ok && cursor.remaining() >= 4) {
+        const auto* entry = cursor.pos;
+        uint64_t length = cursor.fixed<uint32_t>();
+        if(length == 0) {
+            if(ehFrame) break;      //terminator
+            continue;
+        }
+        bool is64 = (length == 0xFFFFFFFF);
+        if(is64) length = cursor.fixed<uint64_t>();
+        if(!cursor.ok || length > cursor.remaining()) break;
+
+        const auto* idField = cursor.pos;
+        const auto* entryEnd = cursor.pos + length;
+        uint64_t id = (is64 ? cursor.fixed<uint64_t>() : cursor.fixed<uint32_t>());
+        bool isCie = (ehFrame ? id == 0 : id == (is64 ? UINT64_MAX : 0xFFFFFFFF));
+        if(isCie) {
+            parseCie(static_cast<uint64_t>(entry - begin));
+            cursor.pos = entryEnd;
+            continue;
+        }
+
+        uint64_t cieOffset = (ehFrame ? static_cast<uint64_t>(idField - begin) - id : id);
+        auto cie = parseCie(cieOffset);
+        if(!cie) {
+            cursor.pos = entryEnd;
+            continue;
+        }
+
+        Cursor fde{cursor.pos, entryEnd, begin, cursor.address};
+        const auto& record = cies_[cie.value()];
+        uint64_t low = fde.pointer(record.pointerEncoding);
+        uint64_t range = fde.pointer(record.pointerEncoding & 0x0F);
+        if(record.augmented) fde.pos += std::min<uint64_t>(fde.uleb(), fde.remaining());
+        if(fde.ok && low != 0 && range > 0) fdes_.push_back({low, low + range, cie.value(), fde.pos, entryEnd});
+        cursor.pos = entryEnd;
+    }
+}
+
+/*
+    Runs the CIE's initial instructions, then the FDE's until the row that covers pc. Registers the CIE
+    does not mention keep their value, except the return address column which must be described. Any
+    opcode this reader does not know fails the whole rule.
+*/
+std::optional<Unwinder::Rule> Unwinder::evaluate(const Fde& fde, uint64_t pc) const {
+    const auto& cie = cies_[fde.cie];
+    Rule rule;
+    rule.returnRegister = cie.returnRegister;
+    rule.registers[cie.returnRegister].kind = RegisterRule::undefined;
+    Rule initial;
+    std::vector<Rule> remembered;
+
+    auto execute = [&](const uint8_t* pos, const uint8_t* end, uint64_t stopAt) {
+        Cursor in{pos, end, pos, 0};
+        uint64_t loc = fde.low;
+        auto setRule = [&](uint64_t reg, RegisterRule::Kind kind, int64_t value) {
+            if(reg < registerCount) rule.registers[reg] = {kind, value};
+        };
+
+        while(in.ok && in.pos < in.end) {
+            uint8_t op = in.fixed<uint8_t>();
+            uint8_t operand = op & 0x3F;
+            uint64_t advance = 0;
+            bool advancing = true;
+            switch(op & 0xC0) {
+                case 0x40: advance = operand; break;                                           //advance_loc
+                case 0x80: setRule(operand, RegisterRule::offset,                              //offset
+                    static_cast<int64_t>(in.uleb()) * cie.dataAlign); continue;
+                case 0xC0: if(operand < registerCount) rule.registers[operand] = initial.registers[operand];
+                    continue;                                                                  //restore
+                default: advancing = false; break;
+            }
+
+            if(!advancing) {
+                advancing = (op >= 0x02 && op <= 0x04);
+                switch(op) {
+                    case 0x00: break;                                                          //nop
+                    case 0x02: advance = in.fixed<uint8_t>(); break;                           //advance_loc1
+                    case 0x03: advance = in.fixed<uint16_t>(); break;                          //advance_loc2
+                    case 0x04: advance = in.fixed<uint32_t>(); break;                          //advance_loc4
+                    case 0x05: {                                                               //offset_extended
+                        auto reg = in.uleb();
+                        setRule(reg, RegisterRule::offset, static_cast<int64_t>(in.uleb()) * cie.dataAlign);
+                        break;
+                    }
+                    case 0x06: {                                                               //restore_extended
+                        auto reg = in.uleb();
+                        if(reg < registerCount) rule.registers[reg] = initial.registers[reg];
+                        break;
+                    }
+                    case 0x07: setRule(in.uleb(), RegisterRule::undefined, 0); break;          //undefined
+                    case 0x08: setRule(in.uleb(), RegisterRule::sameValue, 0); break;          //same_value
+                    case 0x09: {                                                               //register
+                        auto reg = in.uleb();
+                        setRule(reg, RegisterRule::reg, static_cast<int64_t>(in.uleb()));
+                        break;
+                    }
+                    case 0x0A: remembered.push_back(rule); break;                              //remember_state
+                    case 0x0B:                                                                 //restore_state
+                        if(remembered.empty()) return false;
+                        rule = remembered.back();
+                        remembered.pop_back();
+                        break;
+                    case 0x0C:                                                                 //def_cfa
+                        rule.cfaRegister = static_cast<uint8_t>(std::min<uint64_t>(in.uleb(), registerCount));
+                        rule.cfaOffset = static_cast<int64_t>(in.uleb());
+                        rule.cfaSupported = true;
+                        break;
+                    case 0x0D:                                                                 //def_cfa_register
+                        rule.cfaRegister = static_cast<uint8_t>(std::min<uint64_t>(in.uleb(), registerCount));
+                        break;
+                    case 0x0E: rule.cfaOffset = static_cast<int64_t>(in.uleb()); break;        //def_cfa_offset
+                    case 0x0F:                                                                 //def_cfa_expression
+                        in.pos += std::min<uint64_t>(in.uleb(), in.remaining());
+                        rule.cfaSupported = false;
+                        break;
+                    case 0x10:                                                                 //expression
+                    case 0x16: {                                                               //val_expression
+                        auto reg = in.uleb();
+                        in.pos += std::min<uint64_t>(in.uleb(), in.remaining());
+                        setRule(reg, RegisterRule::unsupported, 0);
+                        break;
+                    }
+                    case 0x11: {                                                               //offset_extended_sf
+                        auto reg = in.uleb();
+                        setRule(reg, RegisterRule::offset, in.sleb() * cie.dataAlign);
+                        break;
+                    }
+                    case 0x12:                                                                 //def_cfa_sf
+                        rule.cfaRegister = static_cast<uint8_t>(std::min<uint64_t>(in.uleb(), registerCount));
+                        rule.cfaOffset = in.sleb() * cie.dataAlign;
+                        rule.cfaSupported = true;
+                        break;
+                    case 0x13: rule.cfaOffset = in.sleb() * cie.dataAlign; break;              //def_cfa_offset_sf
+                    case 0x14: {                                                               //val_offset
+                        auto reg = in.uleb();
+                        setRule(reg, RegisterRule::valOffset, static_cast<int64_t>(in.uleb()) * cie.dataAlign);
+                        break;
+                    }
+                    case 0x15: {                                                               //val_offset_sf
+                        auto reg = in.uleb();
+                        setRule(reg, RegisterRule::valOffset, in.sleb() * cie.dataAlign);
+                        break;
+                    }
+                    case 0x2E: in.uleb(); break;                                               //GNU_args_size
+                    case 0x2F: {                                                               //GNU_negative_offset_extended
+                        auto reg = in.uleb();
+                        setRule(reg, RegisterRule::offset, -static_cast<int64_t>(in.uleb()) * cie.dataAlign);
+                        break;
+                    }
+                    default: return false;      //set_loc and vendor opcodes
+                }
+            }
+
+            if(advancing) {
+                loc += advance * cie.codeAlign;
+                if(loc > stopAt) return true;
+            }
+        }
+        return in.ok;
+    };
+
+    if(!execute(cie.instructions, cie.end, UINT64_MAX)) return std::nullopt;
+    initial = rule;
+    if(!execute(fde.instructions, fde.end, pc)) return std::nullopt;
+    return rule;
+}
+
+//pc is a file address, rules (and the lack of one) are cached per pc
+const std::optional<Unwinder::Rule>& Unwinder::findRule(uint64_t pc) {
+    if(auto found = rules_.find(pc); found != rules_.end()) {
+        ++stats_.ruleHits;
+        return found->second;
+    }
+    ++stats_.ruleMisses;
+    if(rules_.size() >= maxCachedRules) rules_.clear();
+
+    std::optional<Rule> rule;
+    auto fde = std::upper_bound(fdes_.begin(), fdes_.end(), pc,
+        [](uint64_t addr, const Fde& entry) { return addr < entry.low; });
+    if(fde != fdes_.begin() && pc < (--fde)->high) rule = evaluate(*fde, pc);
+    return rules_.emplace(pc, std::move(rule)).first->second;
+}
+
+Unwinder::Frame Unwinder::makeFrame(const user_regs_struct& regs) {
+    Frame frame;
+    frame.regs = {regs.rax, regs.rdx, regs.rcx, regs.rbx, regs.rsi, regs.rdi, regs.rbp, regs.rsp,
+        regs.r8, regs.r9, regs.r10, regs.r11, regs.r12, regs.r13, regs.r14, regs.r15, regs.rip};
+    frame.known = bit(registerCount) - 1;
+    frame.pc = regs.rip;
+    return frame;
+}
+
+/*
+    A caller's pc is a return address, which may already belong to the next function (ex: a call to a
+    noreturn function ending the caller), so its rule is looked up at pc - 1. The caller's CFA must lie
+    above the callee's stack pointer, otherwise the stack is corrupt (or was never set up) and unwinding
+    stops there.
+*/
+std::optional<Unwinder::Frame> Unwinder::unwind(const Frame& frame, const InferiorMemory& mem) {
+    uint64_t lookup = frame.pc - (frame.innermost ? 0 : 1);
+    const std::optional<Rule>* rule = nullptr;
+    if(lookup >= loadAddress_) rule = &findRule(lookup - loadAddress_);
+    if(!rule || !rule->has_value() || !rule->value().cfaSupported || rule->value().cfaRegister >= registerCount
+        || !(frame.known & bit(rule->value().cfaRegister))) {
+        ++stats_.fallbacks;
+        return unwindFramePointer(frame, mem);
+    }
+
+    const auto& current = rule->value();
+    uint64_t cfa = frame.regs[current.cfaRegister] + static_cast<uint64_t>(current.cfaOffset);
+    Frame caller;
+    caller.innermost = false;
+    auto set = [&caller](size_t reg, uint64_t value) {
+        caller.regs[reg] = value;
+        caller.known |= bit(reg);
+    };
+
+    for(size_t reg = 0; reg < registerCount; ++reg) {
+        const auto& registerRule = current.registers[reg];
+        switch(registerRule.kind) {
+            case RegisterRule::sameValue:
+                if(frame.known & bit(reg)) set(reg, frame.regs[reg]);
+                break;
+            case RegisterRule::offset: {
+                uint64_t value;
+                if(mem.read(cfa + static_cast<uint64_t>(registerRule.value), &value, sizeof(value)) == sizeof(value)) {
+                    set(reg, value);
+                }
+                break;
+            }
+            case RegisterRule::valOffset:
+                set(reg, cfa + static_cast<uint64_t>(registerRule.value));
+                break;
+            case RegisterRule::reg: {
+                auto source = static_cast<size_t>(registerRule.value);
+                if(source < registerCount && (frame.known & bit(source))) set(reg, frame.regs[source]);
+                break;
+            }
+            case RegisterRule::undefined:
+            case RegisterRule::unsupported:
+                break;
+        }
+    }
+    set(rspRegister, cfa);
+
+    if(!(caller.known & bit(current.returnRegister))) return std::nullopt;      //outermost frame
+    caller.pc = caller.regs[current.returnRegister];
+    caller.cfa = cfa;
+    if(caller.pc == 0 || ((frame.known & bit(rspRegister)) && cfa <= frame.regs[rspRegister])) return std::nullopt;
+    return caller;
+}
+
+//[rbp] is the caller's rbp and [rbp + 8] the return address, nothing else can be recovered
+std::optional<Unwinder::Frame> Unwinder::unwindFramePointer(const Frame& frame, const InferiorMemory& mem) const {
+    if(!(frame.known & bit(rbpRegister))) return std::nullopt;
+    uint64_t fp = frame.regs[rbpRegister];
+    if(fp == 0 || fp % 8 != 0 || ((frame.known & bit(rspRegister)) && fp < frame.regs[rspRegister])) {
+        return std::nullopt;
+    }
+
+    std::array<uint64_t, 2> saved;
+    if(mem.read(fp, saved.data(), sizeof(saved)) != sizeof(saved) || saved[1] == 0) return std::nullopt;
+    Frame caller;
+    caller.innermost = false;
+    caller.pc = saved[1];
+    caller.cfa = fp + 16;
+    caller.regs[rbpRegister] = saved[0];
+    caller.regs[rspRegister] = fp + 16;
+    caller.regs[registerCount - 1] = saved[1];
+    caller.known = bit(rbpRegister) | bit(rspRegister) | bit(registerCount - 1);
+    return caller;
+}
+
+std::vector<Unwinder::Frame> Unwinder::backtrace(const user_regs_struct& regs, const InferiorMemory& mem) {
+    std::vector<Frame> frames{makeFrame(regs)};
+    while(frames.size() < maxFrames) {
+        auto caller = unwind(frames.back(), mem);
+        if(!caller) break;
+        frames.push_back(caller.value());
+    }
+    return frames;
+}
+
+size_t Unwinder::size() const { return fdes_.size(); }
+const Unwinder::CacheStats& Unwinder::getStats() const { return stats_; }
+void Unwinder::resetStats() { stats_ = CacheStats(); }
@@ -81,6 +81,28 @@ namespace util {
         return false;
     }
 
+    /*
+        validHexBytes() parses a string of hex digit pairs (optionally prefixed by 0x) into raw bytes in the 
+        order they are written, ex: "0xDEADBEEF" --> {DE, AD, BE, EF}. The bytes are appended to the vector 
+        passed in. On failure (empty string, odd number of digits or an invalid character) false is returned 
+        and the vector is left exactly as it was.
+    */
+    bool validHexBytes(std::vector<uint8_t>& bytes, std::string_view hex) {
+        hex = stripAddrPrefix(hex);
+        if(hex.empty() || hex.length() % 2 != 0) return false;
+
+        std::vector<uint8_t> buffer;
+        buffer.reserve(hex.length() / 2);
+        for(size_t i = 0; i < hex.length(); i += 2) {
+            uint8_t byte;
+            auto[ptr, ec] = std::from_chars(hex.data() + i, hex.data() + i + 2, byte, 16);
+            if(ptr != hex.data() + i + 2 || ec != std::errc()) return false;
+            buffer.push_back(byte);
+        }
+        bytes.insert(bytes.end(), buffer.begin(), buffer.end());
+        return true;
+    }
+
 
     bool hasWhiteSpace(const std::string_view s) {
         return s.find_first_of(" \t") != std::string_view::npos;
@@ -115,7 +137,6 @@ namespace util {
 
 
 
-    static std::string demangledToReadable(const std::string& demangled);
     /*
         Handle demangling of symbols below. The demangling process uses the libstdc++ ABI library in linux.
         The demangling doesn't fully result in a readable string - so I take steps to make common symbols more 
@@ -196,7 +217,7 @@ namespace util {
     4) Simplify common container types in std namespace (vector, map, etc.).
 
 */
-    static std::string demangledToReadable(const std::string& demangled) {
+    std::string demangledToReadable(const std::string& demangled) {
         std::string readable = demangled;
         //DEBUG STATEMENT
         //return readable 